@@ -0,0 +1,455 @@
+// g++ -I./fastflow -O3 -fopenmp -o main_a4 assignment4.cpp && ./main_a4 40 2 100 ff
+// g++ -DNO_DEFAULT_MAPPING -I./fastflow -O3 -fopenmp -o main_a4_nodefm assignment4.cpp && ./main_a4_nodefm 40 2 100 omp
+// g++ -DFF_CORE_BUDGET -I./fastflow -O3 -fopenmp -o main_a4_budget assignment4.cpp && ./main_a4_budget 40 2 100 ff:omp
+
+
+#include <iostream>
+#include <stdlib.h>
+#include <vector>
+#include <string>
+#include <memory>
+#include <chrono>
+#include <functional>
+#if defined(_OPENMP)
+#include <omp.h>
+#endif
+using namespace std;
+
+#include <ff/ff.hpp>
+#include <ff/pipeline.hpp>
+#include <ff/farm.hpp>
+#include <ff/node.hpp>
+#include <ff/parallel_for.hpp>
+#include <ff/profiler.hpp>
+using namespace ff;
+
+using Matrix = vector<vector<float>>;
+using Clock = chrono::steady_clock;
+using msecs = chrono::duration<double, milli>;
+
+/*
+1 - generates a stream of NxN matrices of floats
+2 - changes each element in a matrix with its square
+3 - implements NUM_ITER iterations of assignment three on each matrix
+4 - just prints the first items of the resulting matrix
+
+Stages 2 and 3 run their loops on a backend chosen at runtime:
+ seq - plain sequential loop
+ ff  - FastFlow ParallelFor
+ omp - OpenMP parallel for (only if compiled with -fopenmp)
+*/
+
+int N = 40;
+int NUM_ITER = 2;
+int NUM_MAT = 100;
+
+// a matrix travelling in the pipeline, with its creation time to measure the latency
+struct Task {
+    Matrix m;
+    Clock::time_point created;
+};
+
+// Execution backend of the loops over the rows of a matrix
+struct Backend {
+    virtual ~Backend() {}
+    virtual void parallel_rows(const function<void(long)>& body) = 0;
+};
+
+struct SeqBackend : Backend {
+    void parallel_rows(const function<void(long)>& body){
+        for(long i=0; i<N; i++)
+            body(i);
+    }
+};
+
+// the ParallelFor is created once per stage, not for every matrix
+struct FFBackend : Backend {
+    FFBackend(long nw) : nw(nw), pf(nw) {}
+
+    void parallel_rows(const function<void(long)>& body){
+        pf.parallel_for(0, N, body, nw);
+    }
+
+    long nw;
+    ParallelFor pf;
+};
+
+#if defined(_OPENMP)
+struct OMPBackend : Backend {
+    OMPBackend(int nw) : nw(nw) {}
+
+    void parallel_rows(const function<void(long)>& body){
+#if defined(FF_CORE_BUDGET)
+        // the team uses only cores left free by the stage threads and the
+        // other parallel regions
+        coreLease lease(nw - 1);
+        #pragma omp parallel num_threads(lease.teamSize())
+#else
+        // the stage threads are not in the budget: the team has nw threads
+        #pragma omp parallel num_threads(nw)
+#endif
+        {
+#if defined(FF_CORE_BUDGET)
+            lease.pin(omp_get_thread_num());
+#endif
+
+            #pragma omp for schedule(static)
+            for(long i=0; i<N; i++)
+                body(i);
+        }
+    }
+
+    int nw;
+};
+#endif
+
+bool valid_backend(const string& name){
+#if defined(_OPENMP)
+    if(name == "omp") return true;
+#endif
+    return name == "seq" || name == "ff";
+}
+
+// nw <= 0 means all the cores
+unique_ptr<Backend> make_backend(const string& name, int nw){
+    if(name == "seq")
+        return make_unique<SeqBackend>();
+    if(name == "ff")
+        return make_unique<FFBackend>((nw > 0) ? nw : FF_AUTO);
+#if defined(_OPENMP)
+    if(name == "omp")
+        return make_unique<OMPBackend>((nw > 0) ? nw : omp_get_max_threads());
+#endif
+    return nullptr;
+}
+
+// number of parallel stages of the pipeline, see stage_threads
+int parallel_stages = 1;
+
+// Threads of a parallel stage asked with nw=K (nw <= 0: all the cores).
+// The backends are built in svc_init, after the initial barrier, when every
+// stage thread already owns its core of the budget. With -DFF_CORE_BUDGET
+// "all the cores" is an equal share of the cores left free, computed once
+// by the first stage that asks: a ParallelFor team uses one core of the
+// share for its scheduler thread, an OpenMP team includes the stage thread,
+// that does not take a core of the share.
+int stage_threads(int nw, const string& backend){
+#if defined(FF_CORE_BUDGET)
+    if(nw <= 0){
+        static const int share = max(1, (int)coreBudget::instance()->available() / parallel_stages);
+        if(backend == "ff")  return max(1, share - 1);
+        if(backend == "omp") return share + 1;
+        return share;
+    }
+#else
+    (void)backend;
+#endif
+    return nw;
+}
+
+// Kernel of Stage 2: squares every element
+void square(Matrix& m, Backend& be){
+    be.parallel_rows([&](const long i){
+        for(int j=0; j<N; j++){
+            m[i][j] *= m[i][j];
+        }
+    });
+}
+
+// Kernel of Stage 3: NUM_ITER stencil iterations.
+// With square_first the square of Stage 2 is computed on the fly while loading
+// the neighbours of the first iteration (fused Stage 2+3)
+void stencil(Matrix& m, Backend& be, bool square_first=false){
+
+    Matrix tmp(N, vector<float>(N));
+    auto sq = [](float x){ return x * x; };
+    int it = 0;
+
+    do{
+        be.parallel_rows([&](const long i){
+            int i_up = (i - 1 + N) % N;
+            int i_down = (i + 1) % N;
+
+            for(int j=0; j<N; j++){
+                int j_left = (j - 1 + N) % N;
+                int j_right = (j + 1) % N;
+
+                float sum;
+                if(square_first && it == 0){
+                    sum =
+                        sq(m[i_up][j_left])   + sq(m[i_up][j])   + sq(m[i_up][j_right])   +
+                        sq(m[i][j_left])      + sq(m[i][j])      + sq(m[i][j_right])      +
+                        sq(m[i_down][j_left]) + sq(m[i_down][j]) + sq(m[i_down][j_right]);
+                } else {
+                    sum =
+                        m[i_up][j_left]   + m[i_up][j]   + m[i_up][j_right]   +
+                        m[i][j_left]      + m[i][j]      + m[i][j_right]      +
+                        m[i_down][j_left] + m[i_down][j] + m[i_down][j_right];
+                }
+
+                tmp[i][j] = sum / 9.0f;
+            }
+        });
+
+        m.swap(tmp);
+    } while(++it < NUM_ITER);
+}
+
+// Node Stage 1: generate a stream ( -- NUM_MAT -- ) NxN matrix
+struct Stage1 : ff_node_t<Task> {
+
+    Task* svc(Task*) {
+
+        for(int nm=0; nm<NUM_MAT; nm++){
+            Task* t = new Task{Matrix(N, vector<float>(N, 0.0f)), Clock::now()};
+
+            for(int i=0; i<N; i++){
+                for(int j=0; j<N; j++){
+                    // identical matrices
+                    t->m[i][j] = ((j == 0) ? 0 : (i / static_cast<float>(j)) * 1000) + i + j;
+                }
+            }
+            ff_send_out(t);
+        }
+
+        return EOS;
+    }
+};
+
+// Node Stage 2
+struct Stage2 : ff_node_t<Task> {
+    Stage2(const string& backend, int nw) : backend(backend), nw(nw) {}
+
+    int svc_init(){
+        be = make_backend(backend, stage_threads(nw, backend));
+        return be ? 0 : -1;
+    }
+
+    Task* svc(Task* t){
+        square(t->m, *be);
+        return t;
+    }
+
+    string backend;
+    int nw;
+    unique_ptr<Backend> be;
+};
+
+// Node Stage 3 (Stage 2+3 if fused: the matrix is swept once less and
+// Stage2's output never goes through a queue)
+struct Stage3 : ff_node_t<Task> {
+    Stage3(const string& backend, int nw, bool fused) : backend(backend), nw(nw), fused(fused) {}
+
+    int svc_init(){
+        be = make_backend(backend, stage_threads(nw, backend));
+        return be ? 0 : -1;
+    }
+
+    Task* svc(Task* t){
+        stencil(t->m, *be, fused);
+        return t;
+    }
+
+    string backend;
+    int nw;
+    bool fused;
+    unique_ptr<Backend> be;
+};
+
+// Farm worker: one replica of the compute stages working on whole matrices
+// with small backends of 'inner' threads
+struct Replica : ff_node_t<Task> {
+    Replica(const string& b2, const string& b3, int inner, bool fused) :
+        b2(b2), b3(b3), inner(inner), fused(fused) {}
+
+    int svc_init(){
+        if(!fused)
+            be2 = make_backend(b2, inner);
+        be3 = make_backend(b3, inner);
+        return (be3 && (fused || be2)) ? 0 : -1;
+    }
+
+    Task* svc(Task* t){
+        if(!fused)
+            square(t->m, *be2);
+        stencil(t->m, *be3, fused);
+        return t;
+    }
+
+    string b2, b3;
+    int inner;
+    bool fused;
+    unique_ptr<Backend> be2, be3;
+};
+
+// Node Stage 4: print results and collect the latency of each matrix
+struct Stage4 : ff_node_t<Task> {
+    Stage4(bool quiet) : quiet(quiet) {}
+
+    Task* svc(Task* t){
+        double lat = msecs(Clock::now() - t->created).count();
+        lat_sum += lat;
+        lat_max = max(lat_max, lat);
+        ++count;
+
+        if(!quiet){
+            for(int i=0; i<N; i++){
+                printf("%.2f\n", t->m[i][0]);
+            }
+            printf("\n");
+        }
+
+        delete t;
+        return GO_ON;
+    }
+
+    bool quiet;
+    long count = 0;
+    double lat_sum = 0.0, lat_max = 0.0;
+};
+
+// replicas x inner threads split used by the farm mode
+struct Split {
+    int replicas;
+    int inner;
+};
+
+/*
+Picks the replicas x inner-threads split from N, the cost of the compute stages
+and the number of cores. Two quantities are measured on this machine:
+ - cost: sequential time of the compute stages on one NxN matrix
+ - ovh:  fork/join overhead of one (empty) parallel region of the backend
+A replica runs 1+NUM_ITER parallel regions per matrix (NUM_ITER if fused), so
+with t inner threads its service time is T(t) = cost/t + regions*ovh (no ovh if
+t=1) and the farm throughput is (cores/t)/T(t). The t with the highest
+throughput wins, on ties the larger t since it has lower latency.
+Stage1 and Stage4 (emitter and collector of the farm) keep one core each.
+*/
+Split autotune(int ncores, const string& backend, bool fused){
+    int avail = max(1, ncores - 2);
+
+    Matrix sample(N, vector<float>(N, 1.0f));
+    SeqBackend seq;
+    int reps = 0;
+    auto start = Clock::now();
+    do{
+        if(!fused)
+            square(sample, seq);
+        stencil(sample, seq, fused);
+        ++reps;
+    } while(msecs(Clock::now() - start).count() < 1.0);
+    double cost = msecs(Clock::now() - start).count() / reps;
+
+    double ovh = 0.0;
+    if(avail > 1 && backend != "seq"){
+        unique_ptr<Backend> be = make_backend(backend, avail);
+        be->parallel_rows([](const long){});   // spawns the threads
+        const int samples = 20;
+        start = Clock::now();
+        for(int r=0; r<samples; r++)
+            be->parallel_rows([](const long){});
+        ovh = msecs(Clock::now() - start).count() / samples;
+    }
+    int regions = (fused ? 0 : 1) + NUM_ITER;
+    int max_inner = (backend == "seq") ? 1 : min(avail, N);
+
+    Split best = {avail, 1};
+    double best_thr = 0.0;
+    for(int t=1; t<=max_inner; t++){
+        int r = min(avail / t, NUM_MAT);
+        double T = cost / t + ((t > 1) ? regions * ovh : 0.0);
+        double thr = r / T;
+        if(thr >= best_thr){
+            best_thr = thr;
+            best = {r, t};
+        }
+    }
+    return best;
+}
+
+int usage(const char* prog){
+    cerr << "Usage: " << prog << " N num_iter num_mat [backend | backend2:backend3] [fused] [farm] [nw=K] [quiet] [profile]" << endl;
+    cerr << "  backend: seq | ff";
+#if defined(_OPENMP)
+    cerr << " | omp";
+#endif
+    cerr << " (default ff)" << endl;
+    cerr << "  nw=K: threads of each parallel stage (default: all the cores)" << endl;
+    return -1;
+}
+
+int main(int argc, char* argv[]){
+
+    if(argc < 4)
+        return usage(argv[0]);
+    N = atoi(argv[1]);
+    NUM_ITER = atoi(argv[2]);
+    NUM_MAT = atoi(argv[3]);
+    if(N < 1 || NUM_ITER < 1 || NUM_MAT < 1)
+        return usage(argv[0]);
+
+    string b2 = "ff", b3 = "ff";
+    bool fused = false, farm = false, quiet = false, profile = false;
+    int nw = 0;
+    for(int a=4; a<argc; a++){
+        string opt(argv[a]);
+        if(opt == "fused") fused = true;
+        else if(opt == "farm") farm = true;
+        else if(opt == "quiet") quiet = true;
+        else if(opt == "profile") profile = true;
+        else if(opt.compare(0, 3, "nw=") == 0) nw = atoi(opt.c_str() + 3);
+        else{
+            size_t colon = opt.find(':');
+            b2 = opt.substr(0, colon);
+            b3 = (colon == string::npos) ? b2 : opt.substr(colon + 1);
+        }
+    }
+    if(!valid_backend(b2) || !valid_backend(b3))
+        return usage(argv[0]);
+
+    ff_pipeline pipe;
+    Stage4* sink = new Stage4(quiet);
+    string mode = fused ? "fused-" : "";
+    if(farm){
+        // Stage1 and Stage4 become emitter and collector of a farm of replicas
+        Split split = autotune(ff_numCores(), b3, fused);
+        if(nw > 0) split = {max(1, (int)ff_numCores() - 2) / nw, nw};
+        split.replicas = max(1, split.replicas);
+        mode += "farm(" + to_string(split.replicas) + "x" + to_string(split.inner) + ")";
+
+        vector<unique_ptr<ff_node>> W;
+        for(int r=0; r<split.replicas; r++)
+            W.push_back(make_unique<Replica>(b2, b3, split.inner, fused));
+        pipe.add_stage(new ff_Farm<Task>(std::move(W), make_unique<Stage1>(), unique_ptr<ff_node>(sink)), true);
+    } else {
+        mode += "pipeline";
+        parallel_stages = fused ? 1 : 2;
+        pipe.add_stage(new Stage1, true);
+        if(!fused)
+            pipe.add_stage(new Stage2(b2, nw), true);
+        pipe.add_stage(new Stage3(b3, nw, fused), true);
+        pipe.add_stage(sink, true);
+    }
+
+    ff_pipeline_profiler prof(pipe);
+    if(profile) prof.start();
+    if(pipe.run_and_wait_end() < 0){
+        cerr << "Error running pipeline" << endl;
+        return -1;
+    }
+    if(profile){
+        prof.stop();
+        prof.report(cerr);
+    }
+
+    // one line per run, easy to grep when sweeping sizes and backends
+    double time = pipe.ffTime();
+    cerr << "N=" << N << " num_iter=" << NUM_ITER << " num_mat=" << NUM_MAT
+         << " backend=" << b2 << ":" << b3 << " mode=" << mode
+         << " time_ms=" << time
+         << " throughput_mat_s=" << sink->count / (time / 1000.0)
+         << " latency_avg_ms=" << sink->lat_sum / sink->count
+         << " latency_max_ms=" << sink->lat_max << endl;
+
+    return 0;
+}
@@ -0,0 +1,204 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*!
+ *  \file backoff.hpp
+ *  \ingroup building_blocks
+ *
+ *  \brief Adaptive backoff used by the non-blocking mode when a channel is
+ *  empty (pop) or full (push).
+ */
+
+/* ***************************************************************************
+ *
+ *  FastFlow is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License version 3 as
+ *  published by the Free Software Foundation.
+ *  Starting from version 3.0.1 FastFlow is dual licensed under the GNU LGPLv3
+ *  or MIT License (https://github.com/ParaGroup/WindFlow/blob/vers3.x/LICENSE.MIT)
+ *
+ *  This program is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ ****************************************************************************
+ */
+
+/*
+ * Each node (and the emitter/collector of a farm) has one ff_backoff for its
+ * input side and one for its output side, used by losetime_in/losetime_out.
+ * A wait is the streak of consecutive failed pops (pushes); it ends when the
+ * node does something else for a while (FF_BACKOFF_GAP_TICKS). For each
+ * channel the backoff keeps the average length of its waits (i.e. the
+ * inter-arrival time seen by the node when the channel is empty) and:
+ *
+ *   - the first spin of a wait is 1/8 of the average wait, then it doubles
+ *     at each retry, in [FF_BACKOFF_MIN_TICKS, FF_BACKOFF_MAX_TICKS];
+ *   - after 'spinlimit' ticks of spinning the node sleeps, starting from
+ *     FF_BACKOFF_SLEEP_MIN_NS and doubling up to FF_BACKOFF_SLEEP_MAX_NS;
+ *   - 'spinlimit' doubles when a wait ends right after the first sleep
+ *     (spinning a bit more would have been enough) and halves when a wait
+ *     goes on sleeping (the channel is idle, spinning is wasted CPU).
+ *     There is no spinning with one core only.
+ *
+ * So a steady channel spins for short and well sized periods, and a bursty
+ * one spins during the bursts and sleeps between them.
+ * The counters can be read by any thread while the node is running
+ * (see ff_node::get_backoff_in/get_backoff_out).
+ *
+ * Define FF_NO_ADAPTIVE_BACKOFF to spin for the given number of ticks only
+ * (the statistics are kept anyway).
+ */
+
+#ifndef FF_BACKOFF_HPP
+#define FF_BACKOFF_HPP
+
+#include <ctime>
+#include <atomic>
+#include <unistd.h>
+#include <ff/config.hpp>
+#include <ff/cycle.h>
+#include <ff/utils.hpp>
+
+namespace ff {
+
+/*
+ * snapshot of the statistics of one channel
+ */
+struct ff_backoff_stats {
+    unsigned long waits;     // number of waits (streaks of failed attempts)
+    unsigned long retries;   // number of failed attempts
+    unsigned long sleeps;    // retries that slept instead of spinning
+    ticks         lostticks; // total ticks lost in waiting
+    ticks         avgwait;   // average length of a wait (ticks)
+    ticks         spinlimit; // current spinning budget of a wait (ticks)
+};
+
+class ff_backoff {
+    static inline ticks spinmax() {
+        static const long ncores = sysconf(_SC_NPROCESSORS_ONLN);
+        return (ncores > 1) ? FF_BACKOFF_SPIN_MAX_TICKS : 0;
+    }
+    static inline ticks clamp(ticks v, ticks lo, ticks hi) {
+        return (v<lo) ? lo : ((v>hi) ? hi : v);
+    }
+
+    // the previous wait has ended, learns from it and starts a new one
+    inline void newwait(ticks now, ticks hint) {
+        if (start) {
+            const ticks len = last - start;
+            const ticks avg = _avgwait.load(std::memory_order_relaxed);
+            _avgwait.store(avg ? (7*avg + len)/8 : len, std::memory_order_relaxed);
+            ticks limit = _spinlimit.load(std::memory_order_relaxed);
+            if (nsleeps == 1)
+                limit = (2*limit < maxlimit) ? (limit ? 2*limit : FF_BACKOFF_MIN_TICKS) : maxlimit;
+            else if (nsleeps > 2)
+                limit = (limit/2 < FF_BACKOFF_MIN_TICKS) ? FF_BACKOFF_MIN_TICKS : limit/2;
+            if (limit > maxlimit) limit = maxlimit;
+            _spinlimit.store(limit, std::memory_order_relaxed);
+        }
+        const ticks avg = _avgwait.load(std::memory_order_relaxed);
+        chunk   = avg ? clamp(avg/8, FF_BACKOFF_MIN_TICKS, FF_BACKOFF_MAX_TICKS) : hint;
+        sleepns = FF_BACKOFF_SLEEP_MIN_NS;
+        nsleeps = 0;
+        start   = now;
+        _waits.store(_waits.load(std::memory_order_relaxed)+1, std::memory_order_relaxed);
+    }
+
+    static inline void spin(ticks t) {
+#if defined(SPIN_USE_PAUSE)
+        const long n = (long)t/2000;
+        for(int i=0;i<=n;++i) PAUSE();
+#else
+        ticks_wait(t);
+#endif /* SPIN_USE_PAUSE */
+    }
+
+public:
+    ff_backoff():maxlimit(spinmax()) {
+        reset();
+    }
+    // the state is not copied
+    ff_backoff(const ff_backoff&):ff_backoff() {}
+    ff_backoff& operator=(const ff_backoff&) { return *this; }
+
+    void reset() {
+        start = last = 0;
+        chunk = FF_BACKOFF_MIN_TICKS;
+        sleepns = FF_BACKOFF_SLEEP_MIN_NS;
+        nsleeps = 0;
+        _waits.store(0, std::memory_order_relaxed);
+        _retries.store(0, std::memory_order_relaxed);
+        _sleeps.store(0, std::memory_order_relaxed);
+        _lost.store(0, std::memory_order_relaxed);
+        _avgwait.store(0, std::memory_order_relaxed);
+        _spinlimit.store((FF_BACKOFF_SPIN_TICKS<maxlimit)?FF_BACKOFF_SPIN_TICKS:maxlimit,
+                         std::memory_order_relaxed);
+    }
+
+    /*
+     * Called by the owner thread after a failed pop (push). 'hint' is the
+     * number of ticks requested by the caller, it is the first spin when
+     * there is no history.
+     */
+    inline void wait(ticks hint) {
+        const ticks now = getticks();
+#if defined(FF_NO_ADAPTIVE_BACKOFF)
+        if ((now - last) > FF_BACKOFF_GAP_TICKS)
+            _waits.store(_waits.load(std::memory_order_relaxed)+1, std::memory_order_relaxed);
+        spin(hint);
+#else
+        if ((now - last) > FF_BACKOFF_GAP_TICKS) newwait(now, hint);
+        if ((now - start) < _spinlimit.load(std::memory_order_relaxed)) {
+            spin(chunk);
+            chunk = (2*chunk < FF_BACKOFF_MAX_TICKS) ? 2*chunk : FF_BACKOFF_MAX_TICKS;
+        } else {
+            struct timespec ts = { 0, (long)sleepns };
+            nanosleep(&ts, NULL);
+            sleepns = (2*sleepns < FF_BACKOFF_SLEEP_MAX_NS) ? 2*sleepns : FF_BACKOFF_SLEEP_MAX_NS;
+            ++nsleeps;
+            _sleeps.store(_sleeps.load(std::memory_order_relaxed)+1, std::memory_order_relaxed);
+        }
+#endif
+        last = getticks();
+        _retries.store(_retries.load(std::memory_order_relaxed)+1, std::memory_order_relaxed);
+        _lost.store(_lost.load(std::memory_order_relaxed)+(last-now), std::memory_order_relaxed);
+    }
+
+    /*
+     * It can be called by any thread.
+     */
+    ff_backoff_stats stats() const {
+        ff_backoff_stats s;
+        s.waits     = _waits.load(std::memory_order_relaxed);
+        s.retries   = _retries.load(std::memory_order_relaxed);
+        s.sleeps    = _sleeps.load(std::memory_order_relaxed);
+        s.lostticks = _lost.load(std::memory_order_relaxed);
+        s.avgwait   = _avgwait.load(std::memory_order_relaxed);
+        s.spinlimit = _spinlimit.load(std::memory_order_relaxed);
+        return s;
+    }
+
+private:
+    const ticks   maxlimit;
+    // used only by the owner thread
+    ticks         start;     // beginning of the current wait
+    ticks         last;      // end of the last retry
+    ticks         chunk;     // next spin
+    unsigned long sleepns;   // next sleep
+    unsigned long nsleeps;   // sleeps in the current wait
+    // statistics, written only by the owner thread
+    std::atomic<unsigned long> _waits;
+    std::atomic<unsigned long> _retries;
+    std::atomic<unsigned long> _sleeps;
+    std::atomic<ticks>         _lost;
+    std::atomic<ticks>         _avgwait;
+    std::atomic<ticks>         _spinlimit;
+};
+
+} // namespace ff
+
+#endif /* FF_BACKOFF_HPP */
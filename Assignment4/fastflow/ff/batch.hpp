@@ -0,0 +1,151 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*!
+ *  \file batch.hpp
+ *  \ingroup building_blocks
+ *
+ *  \brief Bundles of tasks sent by the farm's Emitter to the workers.
+ */
+
+/* ***************************************************************************
+ *
+ *  FastFlow is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License version 3 as
+ *  published by the Free Software Foundation.
+ *  Starting from version 3.0.1 FastFlow is dual licensed under the GNU LGPLv3
+ *  or MIT License (https://github.com/ParaGroup/WindFlow/blob/vers3.x/LICENSE.MIT)
+ *
+ *  This program is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ ****************************************************************************
+ */
+
+/*
+ * With very small tasks the cost of a farm is the per task cost of the
+ * Emitter (scheduling and push), of the channel and of the worker's loop
+ * (pop and wake-up). With batching (see ff_farm::set_batching) the Emitter
+ * puts up to B consecutive tasks in a bundle and the bundle goes to a
+ * worker as a single task, so the scheduling decision, the push, the pop
+ * and the notification are paid once every B tasks:
+ *
+ *  - the tasks sent with ff_send_out (or returned by the Emitter's svc) fill
+ *    one bundle, sent to the worker chosen by the scheduling policy when it
+ *    is full;
+ *  - the tasks sent with ff_send_out_to to a worker fill a bundle of that
+ *    worker;
+ *  - a bundle is also sent when its first task is older than the flush
+ *    period (the age of all the bundles is checked whenever a task is sent
+ *    and while the Emitter waits for its input; in blocking mode they are
+ *    sent before waiting), and all the bundles are sent before a broadcast
+ *    (e.g. the EOS) and when the Emitter terminates.
+ *
+ * The worker's run-time loop calls svc on each task of the bundle, so svc
+ * is unchanged, and then gives the bundle back to the Emitter through a
+ * channel of the worker, the Emitter reuses it. If svc returns GO_OUT the
+ * tasks of the bundle not yet served are kept and served first on the next
+ * run of the worker. The default size
+ * (FF_BATCH_SIZE) makes a bundle of one cache line.
+ */
+
+#ifndef FF_BATCH_HPP
+#define FF_BATCH_HPP
+
+#include <cstddef>
+#include <cstdlib>
+#include <vector>
+#include <ff/config.hpp>
+#include <ff/sysdep.h>
+#include <ff/cycle.h>
+#include <ff/ubuffer.hpp>
+
+namespace ff {
+
+struct ff_bundle {
+    size_t n;         // tasks in the bundle
+    ticks  t0;        // when the first task has been added
+    void*  task[1];   // the tasks, the bundle has room for size() of them
+
+    // bytes of a bundle of \p B tasks (cache lines)
+    static inline size_t bytes(size_t B) {
+        const size_t sz = offsetof(ff_bundle, task) + B*sizeof(void*);
+        return ((sz + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE) * CACHE_LINE_SIZE;
+    }
+};
+
+/*
+ * The bundles of a farm, owned by the Emitter. Each worker gives back the
+ * bundles it has served through its own channel.
+ */
+class ff_batcher {
+public:
+    ff_batcher(size_t nworkers, size_t size, ticks flush):
+        B(size ? size : 1), flush(flush), ret(nworkers, nullptr) {}
+
+    ~ff_batcher() {
+        for(size_t i=0;i<ret.size();++i) delete ret[i];
+        for(size_t i=0;i<all.size();++i) freeAlignedMemory(all[i]);
+    }
+
+    ff_batcher(const ff_batcher&) = delete;
+    ff_batcher& operator=(const ff_batcher&) = delete;
+
+    bool init() {
+        for(size_t i=0;i<ret.size();++i) {
+            ret[i] = new uSWSR_Ptr_Buffer(FF_BATCH_RETURN);
+            if (!ret[i] || !ret[i]->init()) return false;
+        }
+        return true;
+    }
+
+    // Emitter: an empty bundle
+    inline ff_bundle* get() {
+        if (freel.empty()) reclaim();
+        if (freel.empty()) {
+            ff_bundle* b = (ff_bundle*)getAlignedMemory(CACHE_LINE_SIZE, ff_bundle::bytes(B));
+            if (!b) return nullptr;
+            all.push_back(b);
+            freel.push_back(b);
+        }
+        ff_bundle* b = freel.back();
+        freel.pop_back();
+        b->n = 0;
+        return b;
+    }
+
+    // worker \p id: the tasks of \p b have been served
+    inline void done(size_t id, ff_bundle* b) { ret[id]->push(b); }
+
+    // Emitter: bundle \p b has been sent
+    inline void sent(const ff_bundle* b) { ++nbundles; ntasks += b->n; }
+
+    inline size_t size()        const { return B; }
+    inline ticks  flush_ticks() const { return flush; }
+
+    // bundles and tasks sent so far (read them after the farm has terminated)
+    unsigned long bundles()   const { return nbundles; }
+    unsigned long tasks()     const { return ntasks; }
+    size_t        allocated() const { return all.size(); }
+
+private:
+    void reclaim() {
+        void* b;
+        for(size_t i=0;i<ret.size();++i)
+            while(ret[i]->pop(&b)) freel.push_back((ff_bundle*)b);
+    }
+
+    const size_t                   B;
+    const ticks                    flush;
+    std::vector<uSWSR_Ptr_Buffer*> ret;
+    std::vector<ff_bundle*>        freel, all;
+    unsigned long                  nbundles = 0, ntasks = 0;
+};
+
+} // namespace ff
+
+#endif /* FF_BATCH_HPP */
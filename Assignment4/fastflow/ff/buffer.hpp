@@ -61,6 +61,7 @@
 
 #include <ff/sysdep.h>
 #include <ff/config.hpp>
+#include <ff/ringmem.hpp>
 
 #if defined(__APPLE__)
 #include <AvailabilityMacros.h>
@@ -117,6 +118,7 @@ private:
 #endif
     size_t     size;
     void    ** buf;
+    size_t     bufbytes;   // memory of buf (see ff_ring_alloc)
     
 #if defined(SWSR_MULTIPUSH)
     /* massimot: experimental code (see multipush)
@@ -141,7 +143,7 @@ public:
      *  \param n the size of the buffer
      */
     SWSR_Ptr_Buffer(unsigned long n, const bool=true):
-        pread(0),pwrite(0),size(n),buf(0) {
+        pread(0),pwrite(0),size(n),buf(0),bufbytes(0) {
         pushPMF=&SWSR_Ptr_Buffer::push;
         popPMF =&SWSR_Ptr_Buffer::pop;
         // Avoid unused private field warning on padding1, padding2
@@ -153,8 +155,8 @@ public:
      * Default destructor 
      */
     ~SWSR_Ptr_Buffer() {
-        // freeAlignedMemory is a function defined in 'sysdep.h'
-        freeAlignedMemory(buf);
+        // ff_ring_free is a function defined in 'ringmem.hpp'
+        ff_ring_free(buf, bufbytes);
     }
     
     /** 
@@ -170,8 +172,8 @@ public:
 #if defined(SWSR_MULTIPUSH)
         if (size<MULTIPUSH_BUFFER_SIZE) return false;
 #endif
-        // getAlignedMemory is a function defined in 'sysdep.h'
-        buf=(void**)getAlignedMemory(longxCacheLine*sizeof(long),size*sizeof(void*));
+        // ff_ring_alloc is a function defined in 'ringmem.hpp'
+        buf=(void**)ff_ring_alloc(longxCacheLine*sizeof(long),size*sizeof(void*),bufbytes);
         if (!buf) return false;
 
         reset(startatlineend);
@@ -225,6 +227,31 @@ public:
         return tmp;
     }
 
+    /**
+     * It moves the ring to the NUMA node \p node, it can be called while the
+     * buffer is being used (see ringmem.hpp).
+     *
+     * \return false if the ring cannot be moved
+     */
+    bool place(int node) { return ff_ring_bind(buf, bufbytes, node); }
+
+    /**
+     * memory of the ring, it does not change with changesize
+     */
+    inline size_t ringbytes() const { return bufbytes; }
+
+    /**
+     * Producer side, after a push: true if the consumer had already taken
+     * the element before the one just pushed, that is if the push has
+     * found the buffer empty (see doorbell.hpp). That slot is usually in
+     * the producer's cache, unless the consumer has just freed it.
+     */
+    inline bool pushed_into_empty() const {
+        if (size < 2) return true;
+        const unsigned long prev = (pwrite >= 2) ? (pwrite-2) : (pwrite+size-2);
+        return ((*(volatile unsigned long *)(&buf[prev]))==0);
+    }
+
     
     /** 
      *  Push method: push the input value into the queue. A Write Memory
@@ -347,8 +374,36 @@ public:
         *data = buf[pread];
         //std::atomic_thread_fence(std::memory_order_acquire);
         return inc();
-    } 
-        
+    }
+
+    /**
+     *  Multipop method: it gets up to \p max consecutive values from the
+     *  FIFO buffer. The slots are read first and then given back to the
+     *  producer all together, so that the cache lines of the buffer are
+     *  transferred once per batch instead of once per element.
+     *
+     *  \param data array of at least \p max elements where the values are stored
+     *
+     *  \return the number of values popped (0 if the buffer is empty)
+     */
+    inline size_t multipop(void ** data, size_t max) {  /* modify only pread pointer */
+        size_t n=0;
+        unsigned long r=pread;
+        if (max>size) max=size;  // the slots are given back only at the end
+        while(n<max) {
+#if defined(NO_VOLATILE_POINTERS)
+            void * v = (void*)(*(volatile unsigned long *)(&buf[r]));
+#else
+            void * v = buf[r];
+#endif
+            if (v==NULL) break;
+            data[n++] = v;
+            r = r + ((r+1 >= size) ? (1-size): 1);
+        }
+        for(size_t i=0;i<n;++i) inc();
+        return n;
+    }
+
     /** 
      *  It returns the "head" of the buffer, i.e. the element pointed by the read
      *  pointer (it is a FIFO queue, so \p push on the tail and \p pop from the
@@ -538,6 +593,219 @@ public:
     }
 };
 
+/*!
+ * \class SWSR_Cached_Buffer
+ * \ingroup building_blocks
+ *
+ * \brief SPSC bound channel with cached slot probing
+ *
+ * Same interface and NULL-slot protocol of the \p SWSR_Ptr_Buffer, but
+ * each side keeps a private count of the slots it already knows to be
+ * free (producer) or full (consumer). When the count drops to zero the
+ * slot PROBE_BATCH positions ahead is probed (halving the distance down to
+ * the next slot if needed, as in the B-Queue): since both sides proceed in
+ * order, a free (full) slot implies that all the slots before it are free
+ * (full) too. This way, under high load, the producer and the consumer
+ * touch each other's cache lines once per batch instead of once per
+ * element. The indexes and the cached counts of the two sides are kept on
+ * separate cache lines.
+ *
+ * It can be used as FastFlow channel compiling with
+ * -DFFBUFFER=SWSR_Cached_Buffer (bounded channels) or as internal buffer
+ * of the unbounded channel with -DINTERNAL_BUFFER_T=SWSR_Cached_Buffer
+ * (see config.hpp and ubuffer.hpp).
+ *
+ * This class is defined in \ref buffer.hpp
+ */
+class SWSR_Cached_Buffer {
+    /**
+     * distance of the first probe, 4 cache lines of pointers
+     */
+    enum {PROBE_BATCH=4*longxCacheLine};
+
+private:
+    long padding0[longxCacheLine];
+    // producer's cache line
+    volatile unsigned long pwrite;
+    unsigned long          nfree;   // slots known to be free from pwrite
+    long padding1[longxCacheLine-2];
+    // consumer's cache line
+    volatile unsigned long pread;
+    unsigned long          nfull;   // slots known to be full from pread
+    long padding2[longxCacheLine-2];
+
+    size_t     size;
+    size_t     batch;
+    void    ** buf;
+    size_t     bufbytes;   // memory of buf (see ff_ring_alloc)
+
+    inline void * slot(unsigned long i) const {
+        return (void*)(*(volatile unsigned long *)(&buf[i]));
+    }
+    // index of the slot d positions after i (d<=size)
+    inline unsigned long ahead(unsigned long i, unsigned long d) const {
+        return (i+d >= size) ? (i+d-size) : (i+d);
+    }
+
+    // producer: looks for a run of free slots starting at pwrite
+    inline bool probe_free() {
+        for(unsigned long d=batch; d>0; d>>=1)
+            if (slot(ahead(pwrite,d-1))==NULL) { nfree=d; return true; }
+        return false;
+    }
+    // consumer: looks for a run of full slots starting at pread
+    inline bool probe_full() {
+        for(unsigned long d=batch; d>0; d>>=1)
+            if (slot(ahead(pread,d-1))!=NULL) { nfull=d; return true; }
+        return false;
+    }
+
+public:
+    /* pointer to member function for the push method */
+    bool (SWSR_Cached_Buffer::*pushPMF)(void * const);
+    /* pointer to member function for the pop method */
+    bool (SWSR_Cached_Buffer::*popPMF)(void **);
+
+public:
+    SWSR_Cached_Buffer(unsigned long n, const bool=true):
+        pwrite(0),nfree(0),pread(0),nfull(0),size(n),buf(0),bufbytes(0) {
+        batch = (size<(size_t)PROBE_BATCH) ? size : (size_t)PROBE_BATCH;
+        pushPMF=&SWSR_Cached_Buffer::push;
+        popPMF =&SWSR_Cached_Buffer::pop;
+        (void)padding0; (void)padding1; (void)padding2;
+    }
+
+    ~SWSR_Cached_Buffer() {
+        ff_ring_free(buf, bufbytes);
+    }
+
+    bool init(const bool startatlineend=false) {
+        if (buf || (size==0)) return false;
+        buf=(void**)ff_ring_alloc(longxCacheLine*sizeof(long),size*sizeof(void*),bufbytes);
+        if (!buf) return false;
+        reset(startatlineend);
+        return true;
+    }
+
+    /**
+     * It returns true if the buffer is empty.
+     */
+    inline bool empty() { return (slot(pread)==NULL); }
+
+    /**
+     * It returns true if there is at least one room in the buffer.
+     * It has to be called by the producer.
+     */
+    inline bool available() { return (nfree>0 || probe_free()); }
+
+    inline size_t buffersize() const { return size; };
+
+    /**
+     * See \p SWSR_Ptr_Buffer::changesize, the cached counts are dropped.
+     */
+    size_t changesize(size_t newsz) {
+        size_t tmp=size;
+        size=newsz;
+        batch = (size<(size_t)PROBE_BATCH) ? size : (size_t)PROBE_BATCH;
+        nfree=nfull=0;
+        return tmp;
+    }
+
+    /**
+     * See \p SWSR_Ptr_Buffer::place.
+     */
+    bool place(int node) { return ff_ring_bind(buf, bufbytes, node); }
+
+    /**
+     * memory of the ring, it does not change with changesize
+     */
+    inline size_t ringbytes() const { return bufbytes; }
+
+    /**
+     * See \p SWSR_Ptr_Buffer::pushed_into_empty.
+     */
+    inline bool pushed_into_empty() const {
+        if (size < 2) return true;
+        return (slot((pwrite >= 2) ? (pwrite-2) : (pwrite+size-2))==NULL);
+    }
+
+    inline bool push(void * const data) {     /* modify only pwrite pointer */
+        assert(data != NULL);
+        if (!available()) return false;
+        WMB();
+        buf[pwrite] = data;
+        pwrite = ahead(pwrite,1);
+        --nfree;
+        return true;
+    }
+
+    inline bool inc() {
+        buf[pread]=NULL;
+        pread = ahead(pread,1);
+        if (nfull) --nfull;
+        return true;
+    }
+
+    inline bool pop(void ** data) {          /* modify only pread pointer */
+        if (!nfull && !probe_full()) return false;
+        *data = buf[pread];
+        return inc();
+    }
+
+    /**
+     * See \p SWSR_Ptr_Buffer::multipop.
+     */
+    inline size_t multipop(void ** data, size_t max) {
+        size_t n=0;
+        while(n<max) {
+            if (!nfull && !probe_full()) break;
+            size_t k = (nfull < max-n) ? nfull : max-n;
+            for(size_t i=0;i<k;++i) {
+                data[n++] = buf[pread];
+                inc();
+            }
+        }
+        return n;
+    }
+
+    inline void * top() const { return buf[pread]; }
+
+    inline void reset(const bool startatlineend=false) {
+        if (startatlineend) {
+            pwrite = longxCacheLine-1;
+            pread  = longxCacheLine-1;
+        } else {
+            pread=0;
+            pwrite=0;
+        }
+        nfree=nfull=0;
+        if (size<=512) for(unsigned long i=0;i<size;++i) buf[i]=0;
+        else memset(buf,0,size*sizeof(void*));
+    }
+
+    inline unsigned long length() const {
+        long tpread=pread, tpwrite=pwrite;
+        long len = tpwrite-tpread;
+        if (len>0) return (unsigned long)len;
+        if (len<0) return (unsigned long)(size+len);
+        if (buf[tpwrite]==NULL) return 0;
+        return size;
+    }
+
+    // Not yet implemented
+    inline bool mp_push(void *const) {
+        abort();
+        return false;
+    }
+    // Not yet implemented
+    inline bool mc_pop(void **) {
+        abort();
+        return false;
+    }
+
+    inline bool isFixedSize() const { return true; }
+};
+
 /*!
  *  @}
  *  \endlink
@@ -735,6 +735,7 @@ protected:
     // uses as output channel(s) the one(s) of the second node.
     // these functions should not be called if the node is multi-output
     inline bool  get(void **ptr)                 { return comp_nodes[1]->get(ptr);}
+    inline size_t multiget(void **ptr, size_t max) { return comp_nodes[1]->multiget(ptr,max);}
     inline pthread_cond_t    &get_cons_c()  {
         ff_node *n = getFirst();
         if (n->isMultiInput()) return ff_minode::get_cons_c();
@@ -1197,11 +1198,11 @@ static inline const ff_pipeline combine_ofarm_farm(ff_farm& farm1, ff_farm& farm
     
     ordered_lb* _lb= new ordered_lb(farm1.getNWorkers());
     assert(_lb);
-    const size_t memsize = farm1.getNWorkers() * (2*newfarm1.ondemand_buffer()+3)+ DEF_OFARM_ONDEMAND_MEMORY; 
+    const size_t memsize = ff_reorder_window::roundup(farm1.getNWorkers() * (2*newfarm1.ondemand_buffer()+3)+ DEF_OFARM_ONDEMAND_MEMORY);
     newfarm1.ordered_resize_memory(memsize);
     _lb->init(newfarm1.ordered_get_memory(), memsize);
     newfarm1.setlb(_lb, true);
-    OrderedCollectorWrapper* cw = new OrderedCollectorWrapper(DEF_OFARM_ONDEMAND_MEMORY);
+    OrderedCollectorWrapper* cw = new OrderedCollectorWrapper(_lb->window());
     assert(cw);
     
     // emitter1 
@@ -80,6 +80,15 @@
  * NOTE: if FF_MAPPING_STRING is "" (default), FastFlow executes a linear
  *       mapping of threads. 
  */
+/*
+ * If FF_CORE_BUDGET is defined, the mapping is no longer round-robin: the
+ * core contexts (in the FF_MAPPING_STRING order) form a process-wide budget
+ * (see ff/corebudget.hpp). Each thread takes a core that no other thread
+ * owns, ParallelFor teams are sized on the cores left free, and OpenMP
+ * regions can do the same through a coreLease. So nested parallelism (e.g. a
+ * ParallelFor or an OpenMP loop inside a pipeline stage) does not
+ * oversubscribe the machine and no mapping string has to be hand-tuned.
+ */
 #if !defined MAPPING_STRING
 #define FF_MAPPING_STRING ""
 #else
@@ -115,7 +124,12 @@
 
 // WARNING: Do not change the following with SWSR_Ptr_Buffer unless
 // you know what your are doing....
+// The bounded channels may also be SWSR_Cached_Buffer (-DFFBUFFER=SWSR_Cached_Buffer,
+// see buffer.hpp), it can also be used inside the unbounded ones
+// (-DINTERNAL_BUFFER_T=SWSR_Cached_Buffer, see ubuffer.hpp).
+#if !defined(FFBUFFER)
 #define FFBUFFER uSWSR_Ptr_Buffer
+#endif
 
 /*
  * This is the default buffer capacity and the default difference between the input
@@ -126,6 +140,187 @@
 #define DEFAULT_BUFFER_CAPACITY              2048
 #endif
 
+/*
+ * Max number of tasks a node (or a gatherer) takes from one input channel
+ * at each wake-up (see multipop in buffer.hpp/ubuffer.hpp). The tasks are
+ * then passed to svc one at a time. 1 means one pop per task.
+ */
+#if !defined(FF_MULTIPOP_SIZE)
+#define FF_MULTIPOP_SIZE                     16
+#endif
+
+/*
+ * Memory of the unbounded channels (uSWSR_Ptr_Buffer): each channel caches
+ * up to FF_UBUFFER_HIGHWATER internal buffers, when the channel has been
+ * quiet for FF_UBUFFER_QUIET_US microseconds the cached buffers are freed
+ * down to FF_UBUFFER_LOWWATER (0 us disables this).
+ */
+#if !defined(FF_UBUFFER_HIGHWATER)
+#define FF_UBUFFER_HIGHWATER                 32
+#endif
+#if !defined(FF_UBUFFER_LOWWATER)
+#define FF_UBUFFER_LOWWATER                  2
+#endif
+#if !defined(FF_UBUFFER_QUIET_US)
+#define FF_UBUFFER_QUIET_US                  100000
+#endif
+/*
+ * Memory of the channel rings (see ringmem.hpp): define FF_RING_HUGEPAGES
+ * to allocate them on huge pages of FF_HUGEPAGE_SIZE bytes and FF_RING_NUMA
+ * to move them to the NUMA node of their consumer at run() time.
+ */
+#if !defined(FF_HUGEPAGE_SIZE)
+#define FF_HUGEPAGE_SIZE                     (2UL<<20)
+#endif
+#if !defined(FF_NUMA_MAX_NODES)
+#define FF_NUMA_MAX_NODES                    1024
+#endif
+
+/*
+ * Lock-free mp_dynqueue (see mpdynqueue.hpp): each thread keeps up to
+ * FF_EBR_FREELIST free nodes, the others are moved in batches of
+ * FF_EBR_BATCH nodes to a global pool of at most FF_EBR_POOL batches. The
+ * epoch is advanced every FF_EBR_RETIRE_THRESHOLD nodes popped by a thread.
+ */
+#if !defined(FF_EBR_FREELIST)
+#define FF_EBR_FREELIST                      1024
+#endif
+#if !defined(FF_EBR_BATCH)
+#define FF_EBR_BATCH                         64
+#endif
+#if !defined(FF_EBR_POOL)
+#define FF_EBR_POOL                          1024
+#endif
+#if !defined(FF_EBR_RETIRE_THRESHOLD)
+#define FF_EBR_RETIRE_THRESHOLD              64
+#endif
+
+// a bounded uSWSR_Ptr_Buffer checks for a pending resize every
+// FF_UBUFFER_RESIZE_CHECK pushes (see uSWSR_Ptr_Buffer::resize)
+#if !defined(FF_UBUFFER_RESIZE_CHECK)
+#define FF_UBUFFER_RESIZE_CHECK              1024
+#endif
+
+/*
+ * Capacity tuning of the bounded channels (see qtuner.hpp): the channels
+ * are sampled every FF_QTUNER_PERIOD_MS milliseconds, a decision is taken
+ * every FF_QTUNER_WINDOW samples, a channel is shrunk after FF_QTUNER_QUIET
+ * windows without stalls. The capacity is kept in
+ * [FF_QTUNER_MIN_SIZE, FF_QTUNER_MAX_SIZE].
+ */
+#if !defined(FF_QTUNER_PERIOD_MS)
+#define FF_QTUNER_PERIOD_MS                  10
+#endif
+#if !defined(FF_QTUNER_WINDOW)
+#define FF_QTUNER_WINDOW                     10
+#endif
+#if !defined(FF_QTUNER_QUIET)
+#define FF_QTUNER_QUIET                      3
+#endif
+#if !defined(FF_QTUNER_MIN_SIZE)
+#define FF_QTUNER_MIN_SIZE                   64
+#endif
+#if !defined(FF_QTUNER_MAX_SIZE)
+#define FF_QTUNER_MAX_SIZE                   65536
+#endif
+
+/*
+ * Typed by-value channels (see valuechannel.hpp): number of slots of the
+ * ring of each producer and max size of a message that can be sent by value.
+ */
+#if !defined(FF_VALUE_SLOTS)
+#define FF_VALUE_SLOTS                       (2*DEFAULT_BUFFER_CAPACITY)
+#endif
+#if !defined(FF_VALUE_MAX_SIZE)
+#define FF_VALUE_MAX_SIZE                    (4*CACHE_LINE_SIZE)
+#endif
+
+/*
+ * Cost-aware scheduling of the farm (see lbpolicy.hpp): weight of the last
+ * service time in the per-worker estimate is 1/2^FF_LB_EWMA_SHIFT.
+ */
+#if !defined(FF_LB_EWMA_SHIFT)
+#define FF_LB_EWMA_SHIFT                     3
+#endif
+
+/*
+ * Elastic farm (see elastic.hpp): sampling period of the manager, target,
+ * high and low utilization of the active workers (percent), backlog per
+ * worker that triggers a new worker, number of low utilization samples
+ * before removing workers.
+ */
+#if !defined(FF_ELASTIC_PERIOD_MS)
+#define FF_ELASTIC_PERIOD_MS                 50
+#endif
+#if !defined(FF_ELASTIC_TARGET)
+#define FF_ELASTIC_TARGET                    70
+#endif
+#if !defined(FF_ELASTIC_HIGH)
+#define FF_ELASTIC_HIGH                      90
+#endif
+#if !defined(FF_ELASTIC_LOW)
+#define FF_ELASTIC_LOW                       40
+#endif
+#if !defined(FF_ELASTIC_BACKLOG)
+#define FF_ELASTIC_BACKLOG                   16
+#endif
+#if !defined(FF_ELASTIC_QUIET)
+#define FF_ELASTIC_QUIET                     4
+#endif
+
+/*
+ * Minimum number of input channels of a gatherer (e.g. the farm's
+ * Collector) for probing only the non-empty ones (see doorbell.hpp).
+ */
+#if !defined(FF_DOORBELL_MIN_CHANNELS)
+#define FF_DOORBELL_MIN_CHANNELS             16
+#endif
+/*
+ * Rounds without data after which the gatherer probes all its input
+ * channels, to recover a missed doorbell (see doorbell.hpp).
+ */
+#if !defined(FF_DOORBELL_SWEEP)
+#define FF_DOORBELL_SWEEP                    64
+#endif
+
+/*
+ * Key-partitioned farm (see kpartition.hpp): points of each worker on the
+ * consistent hashing ring, tasks per window, number of frequent keys
+ * counted, load (percent of the mean) above which keys are moved and max
+ * number of keys moved per window.
+ */
+#if !defined(FF_KP_VNODES)
+#define FF_KP_VNODES                         64
+#endif
+#if !defined(FF_KP_WINDOW)
+#define FF_KP_WINDOW                         4096
+#endif
+#if !defined(FF_KP_TOPK)
+#define FF_KP_TOPK                           32
+#endif
+#if !defined(FF_KP_IMBALANCE)
+#define FF_KP_IMBALANCE                      125
+#endif
+#if !defined(FF_KP_MAX_MOVES)
+#define FF_KP_MAX_MOVES                      4
+#endif
+
+/*
+ * Batch-aware farm (see batch.hpp): default number of tasks per bundle
+ * (with 64-bit pointers a bundle is one cache line), max age (ticks) of
+ * the first task of a bundle not yet sent and size of the chunks of the
+ * channels that give the bundles back to the Emitter.
+ */
+#if !defined(FF_BATCH_SIZE)
+#define FF_BATCH_SIZE                        6
+#endif
+#if !defined(FF_BATCH_FLUSH_TICKS)
+#define FF_BATCH_FLUSH_TICKS                 100000
+#endif
+#if !defined(FF_BATCH_RETURN)
+#define FF_BATCH_RETURN                      512
+#endif
+
 
 /* To save energy and improve hyperthreading performance
  * define the following macro
@@ -177,11 +372,32 @@
  */
 #define FF_TIMEDWAIT_NS   200000
 
+/* Used in blocking mode by the hybrid spin-then-park wait (see parking.hpp).
+ * Before parking a consumer spins for a window learned at run-time in
+ * [FF_SPIN_MIN_TICKS, FF_SPIN_MAX_TICKS], checking its input every
+ * FF_SPIN_CHUNK_TICKS. A parked consumer whose input channels can be
+ * re-checked sleeps for at most FF_PARK_TIMEOUT_NS (it cannot be greater
+ * than 1e+9).
+ */
+#if !defined(FF_SPIN_MIN_TICKS)
+#define FF_SPIN_MIN_TICKS    2000
+#endif
+#if !defined(FF_SPIN_MAX_TICKS)
+#define FF_SPIN_MAX_TICKS    200000
+#endif
+#if !defined(FF_SPIN_CHUNK_TICKS)
+#define FF_SPIN_CHUNK_TICKS  500
+#endif
+#if !defined(FF_PARK_TIMEOUT_NS)
+#define FF_PARK_TIMEOUT_NS   1000000
+#endif
+
 /*
  * Used in the ordered farm pattern (ff_OFarm). 
  * It is the maximum amount of data elements buffered in the farm's collector
- * to preserve output ordering. In some case such value has to be increased
- * (see set_scheduling_ondemand in ff_ofarm.hpp)
+ * to preserve output ordering. The reorder window is this value plus the
+ * tasks that can be in the workers' channels, rounded up to a power of 2,
+ * when it is full the emitter waits for the collector.
  */
 #define DEF_OFARM_ONDEMAND_MEMORY 10000
 
@@ -215,6 +431,35 @@
 #define BACKOFF_MAX 1024
 #endif
 
+// Adaptive backoff of the nodes' channels in non-blocking mode (see
+// backoff.hpp). The spins are in [FF_BACKOFF_MIN_TICKS,FF_BACKOFF_MAX_TICKS],
+// a wait spins for at most FF_BACKOFF_SPIN_TICKS at the beginning (learned
+// at run-time up to FF_BACKOFF_SPIN_MAX_TICKS) and then sleeps for
+// FF_BACKOFF_SLEEP_MIN_NS..FF_BACKOFF_SLEEP_MAX_NS.
+// BACKOFF_MIN/MAX above are used only by the MPMC queues.
+#if !defined(FF_BACKOFF_MIN_TICKS)
+#define FF_BACKOFF_MIN_TICKS      250
+#endif
+#if !defined(FF_BACKOFF_MAX_TICKS)
+#define FF_BACKOFF_MAX_TICKS      16000
+#endif
+#if !defined(FF_BACKOFF_SPIN_TICKS)
+#define FF_BACKOFF_SPIN_TICKS     100000
+#endif
+#if !defined(FF_BACKOFF_SPIN_MAX_TICKS)
+#define FF_BACKOFF_SPIN_MAX_TICKS 2000000
+#endif
+#if !defined(FF_BACKOFF_SLEEP_MIN_NS)
+#define FF_BACKOFF_SLEEP_MIN_NS   1000
+#endif
+#if !defined(FF_BACKOFF_SLEEP_MAX_NS)
+#define FF_BACKOFF_SLEEP_MAX_NS   200000
+#endif
+// a retry more than FF_BACKOFF_GAP_TICKS after the previous one starts a new wait
+#if !defined(FF_BACKOFF_GAP_TICKS)
+#define FF_BACKOFF_GAP_TICKS      2000
+#endif
+
 #if !defined(CACHE_LINE_SIZE)
 #define CACHE_LINE_SIZE 64
 #endif
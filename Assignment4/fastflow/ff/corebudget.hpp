@@ -0,0 +1,255 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+
+/*!
+ *  \link
+ *  \file corebudget.hpp
+ *  \ingroup shared_memory_fastflow
+ *
+ *  \brief This file contains the process-wide core budget used to avoid
+ *  oversubscription when FastFlow threads, ParallelFor teams and OpenMP
+ *  regions are nested.
+ */
+
+#ifndef FF_COREBUDGET_HPP
+#define FF_COREBUDGET_HPP
+
+/* ***************************************************************************
+ *
+ *  FastFlow is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License version 3 as
+ *  published by the Free Software Foundation.
+ *  Starting from version 3.0.1 FastFlow is dual licensed under the GNU LGPLv3
+ *  or MIT License (https://github.com/ParaGroup/WindFlow/blob/vers3.x/LICENSE.MIT)
+ *
+ *  This program is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ ****************************************************************************
+ */
+
+#include <vector>
+#include <mutex>
+#include <ff/config.hpp>
+#include <ff/mapper.hpp>
+#include <ff/mapping_utils.hpp>
+
+namespace ff {
+
+/*!
+ *  \ingroup shared_memory_fastflow
+ *
+ *  @{
+ */
+
+/*!
+ * \class coreBudget
+ * \ingroup shared_memory_fastflow
+ *
+ * \brief Process-wide set of core contexts handed out as disjoint subsets.
+ *
+ * The budget contains the core ids of the threadMapper list (i.e. the linear
+ * list 0..ff_numCores()-1, or the order given by FF_MAPPING_STRING, without
+ * duplicates). Each core is owned by at most one thread at a time.
+ *
+ * When the library is compiled with FF_CORE_BUDGET defined:
+ *  - each ff_thread (pipeline stages, farm emitters/workers/collectors, ...)
+ *    takes one free core of the budget when it is spawned and gives it back
+ *    in wait(). If no core is free the thread is not pinned at all;
+ *  - ParallelFor teams take their cores at construction time (see
+ *    reserveTeam), one per worker and one for the scheduler thread, and
+ *    give them back when they are destroyed;
+ *  - OpenMP regions (or any user-level team) can get cores through a
+ *    \ref coreLease.
+ * This way nested parallelism never runs more pinned threads than cores.
+ *
+ * This class is defined in \ref corebudget.hpp
+ */
+class coreBudget {
+public:
+    static inline coreBudget* instance() {
+        static coreBudget cb;
+        return &cb;
+    }
+
+    coreBudget() {
+        threadMapper* tm = threadMapper::instance();
+        const ssize_t nc = ff_numCores();
+        for(unsigned int i=0; i<tm->getCListSize(); ++i) {
+            const int id = (int)tm->getCoreId(i);
+            if (id < 0 || (nc > 0 && id >= nc)) continue;
+            bool dup = false;
+            for(size_t j=0; j<cores.size(); ++j)
+                if (cores[j] == id) { dup = true; break; }
+            if (!dup) cores.push_back(id);
+        }
+        busy.assign(cores.size(), false);
+        nfree = cores.size();
+    }
+
+    /**
+     * It restricts the budget to the given cores (e.g. to leave some cores to
+     * other processes). It fails if some core is currently owned.
+     *
+     * \return 0 on success, -1 otherwise
+     */
+    int setCores(const std::vector<int> &list) {
+        std::lock_guard<std::mutex> lk(mtx);
+        if (nfree != cores.size()) {
+            error("coreBudget::setCores, some cores are in use\n");
+            return -1;
+        }
+        cores = list;
+        busy.assign(cores.size(), false);
+        nfree = cores.size();
+        return 0;
+    }
+
+    /**
+     * It takes up to \p n free cores, appending their ids to \p out.
+     *
+     * \return the number of cores actually granted (possibly 0)
+     */
+    size_t acquire(size_t n, std::vector<int> &out) {
+        std::lock_guard<std::mutex> lk(mtx);
+        size_t granted = 0;
+        for(size_t i=0; i<cores.size() && granted<n; ++i) {
+            if (busy[i]) continue;
+            busy[i] = true;
+            out.push_back(cores[i]);
+            ++granted;
+        }
+        nfree -= granted;
+        return granted;
+    }
+
+    /**
+     * It takes one free core.
+     *
+     * \return the core id, -1 if the budget is exhausted
+     */
+    int acquire() {
+        std::vector<int> one;
+        return (acquire(1, one) == 1) ? one[0] : -1;
+    }
+
+    // It gives back a core previously acquired.
+    void release(int id) {
+        std::lock_guard<std::mutex> lk(mtx);
+        for(size_t i=0; i<cores.size(); ++i)
+            if (cores[i] == id && busy[i]) {
+                busy[i] = false;
+                ++nfree;
+                return;
+            }
+    }
+    void release(const std::vector<int> &ids) {
+        for(size_t i=0; i<ids.size(); ++i) release(ids[i]);
+    }
+
+    // number of cores currently free
+    size_t available() {
+        std::lock_guard<std::mutex> lk(mtx);
+        return nfree;
+    }
+    // number of cores in the budget
+    size_t size() {
+        std::lock_guard<std::mutex> lk(mtx);
+        return cores.size();
+    }
+
+    /**
+     * It takes the cores of a team of \p wanted threads plus \p extra helper
+     * threads (e.g. a scheduler), appending their ids to \p ids: the first
+     * ones are for the team threads, the others for the helpers. The team
+     * is shrunk to the cores granted, so two teams built at the same time
+     * get disjoint cores. The cores have to be given back with release.
+     *
+     * \return the size of the team, at least 1 (the threads without a core
+     * are not pinned)
+     */
+    ssize_t reserveTeam(ssize_t wanted, ssize_t extra, std::vector<int> &ids) {
+        if (wanted < 1) wanted = 1;
+        if (extra < 0)  extra  = 0;
+        const ssize_t granted = (ssize_t)acquire((size_t)(wanted+extra), ids);
+        if (granted - extra < wanted) wanted = granted - extra;
+        return (wanted < 1) ? 1 : wanted;
+    }
+
+protected:
+    std::mutex        mtx;
+    std::vector<int>  cores;
+    std::vector<bool> busy;
+    size_t            nfree;
+};
+
+/*!
+ * \class coreLease
+ * \ingroup shared_memory_fastflow
+ *
+ * \brief RAII handle of a set of cores taken from the \ref coreBudget.
+ *
+ * It is meant for teams of threads not created by FastFlow, e.g. an OpenMP
+ * region executed inside a FastFlow node. The calling thread already owns
+ * its core, so a team of nt threads needs nt-1 cores:
+ *
+ * \code
+ *   coreLease lease(8-1);
+ *   #pragma omp parallel num_threads(lease.teamSize())
+ *   {
+ *       lease.pin(omp_get_thread_num());
+ *       ...
+ *   }
+ * \endcode
+ *
+ * This class is defined in \ref corebudget.hpp
+ */
+class coreLease {
+public:
+    explicit coreLease(size_t n) { coreBudget::instance()->acquire(n, ids); }
+    ~coreLease() { coreBudget::instance()->release(ids); }
+
+    coreLease(const coreLease&) = delete;
+    coreLease& operator=(const coreLease&) = delete;
+
+    // number of cores granted
+    size_t size() const { return ids.size(); }
+    // team size including the calling thread
+    int teamSize() const { return (int)ids.size() + 1; }
+    int operator[](size_t i) const { return ids[i]; }
+
+    /**
+     * It pins the calling thread, i.e. the member \p thid of the team, on its
+     * core. The member 0 is the calling thread and it is not moved.
+     * Pinning is done only with FF_CORE_BUDGET, otherwise the FastFlow threads
+     * are not accounted in the budget and may already be on these cores.
+     *
+     * \return 0 on success
+     */
+    int pin(int thid) const {
+        if (thid <= 0 || (size_t)thid > ids.size()) return 0;
+#if defined(FF_CORE_BUDGET) && !defined(NO_DEFAULT_MAPPING)
+        return (int)ff_mapThreadToCpu(ids[thid-1]);
+#else
+        return 0;
+#endif
+    }
+
+protected:
+    std::vector<int> ids;
+};
+
+/*!
+ *
+ * @}
+ * \link
+ */
+
+} // namespace ff
+
+#endif /* FF_COREBUDGET_HPP */
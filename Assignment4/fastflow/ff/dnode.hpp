@@ -285,6 +285,13 @@ protected:
         return pop(ptr);
     }
 
+    // messages coming from the network are received one at a time
+    virtual inline size_t MultiPop(void **ptr, size_t max) {
+        if (skipdnode || P) return ff_node::MultiPop(ptr,max);
+        Pop(ptr);
+        return 1;
+    }
+
 public:
     /**
      *  \brief Initializes distributed communication channel
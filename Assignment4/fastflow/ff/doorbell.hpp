@@ -0,0 +1,157 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*!
+ *  \file doorbell.hpp
+ *  \ingroup building_blocks
+ *
+ *  \brief Bitmap of the non-empty input channels of a gatherer.
+ */
+
+/* ***************************************************************************
+ *
+ *  FastFlow is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License version 3 as
+ *  published by the Free Software Foundation.
+ *  Starting from version 3.0.1 FastFlow is dual licensed under the GNU LGPLv3
+ *  or MIT License (https://github.com/ParaGroup/WindFlow/blob/vers3.x/LICENSE.MIT)
+ *
+ *  This program is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ ****************************************************************************
+ */
+
+/*
+ * The gatherer (the farm's Collector, the multi-input nodes) polls its
+ * input channels round-robin, so with many channels most of the probes
+ * find an empty channel. When it has at least FF_DOORBELL_MIN_CHANNELS
+ * channels, each channel gets a bit in a ff_doorbell shared with the
+ * producers:
+ *
+ *  - the producer, after a push that has found the channel empty, sets
+ *    the bit of the channel (see pushed_into_empty in buffer.hpp). The
+ *    other pushes do not touch the doorbell;
+ *  - the gatherer looks only at the channels whose bit is set, round-robin
+ *    starting after the last channel served, so every channel with data is
+ *    served once before any other channel is served again. If a channel
+ *    is found empty its bit is cleared and the channel is probed again.
+ *
+ * The producer does not fence its push against the check of the previous
+ * slot, so a push racing with the clear may, rarely, neither be found by
+ * the second probe nor set the bit. The gatherer recovers it by probing
+ * all the channels every FF_DOORBELL_SWEEP rounds without data and before
+ * sleeping (see ff_gatherer::sweep_doorbell).
+ *
+ * The cost of a gather depends on the channels with data, not on the
+ * number of channels. The bit is set by the push of the channel itself
+ * (see uSWSR_Ptr_Buffer::set_doorbell), whatever node is the producer.
+ * With a channel type without doorbell support the gatherer polls as
+ * before.
+ */
+
+#ifndef FF_DOORBELL_HPP
+#define FF_DOORBELL_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdlib>
+#include <atomic>
+#include <vector>
+#include <ff/config.hpp>
+#include <ff/sysdep.h>
+#include <ff/platforms/platform.h>
+
+namespace ff {
+
+class ff_doorbell {
+    static inline size_t ctz(uint64_t v) {
+#if defined(__GNUC__)
+        return (size_t)__builtin_ctzll(v);
+#else
+        size_t n = 0;
+        while(!(v & 1)) { v >>= 1; ++n; }
+        return n;
+#endif
+    }
+    struct word_t {
+        std::atomic<uint64_t> bits{0};
+        char padding[CACHE_LINE_SIZE-sizeof(std::atomic<uint64_t>)];
+    };
+public:
+    ff_doorbell(size_t nchannels):W((nchannels+63)/64), n(nchannels) {}
+
+    ff_doorbell(const ff_doorbell&) = delete;
+    ff_doorbell& operator=(const ff_doorbell&) = delete;
+
+    // producer: channel \p id is not empty. The RMW is ordered with the
+    // one of clear, so a push followed by a ring is seen by the probe
+    // after the clear
+    inline void ring(size_t id) {
+        W[id>>6].bits.fetch_or(1ULL << (id & 63), std::memory_order_release);
+    }
+
+    // gatherer: channel \p id has been found empty, it has to be probed
+    // again after the clear
+    inline void clear(size_t id) {
+        W[id>>6].bits.fetch_and(~(1ULL << (id & 63)), std::memory_order_seq_cst);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+
+    // all the channels have to be probed (e.g. before the first gather)
+    inline void ring_all() {
+        for(size_t i=0;i<n;++i) ring(i);
+    }
+
+    /*
+     * The first channel with the bit set among the first \p nch channels,
+     * starting from \p start and going round, -1 if there are none.
+     */
+    inline ssize_t next(size_t start, size_t nch) const {
+        if (nch > n) nch = n;
+        if (nch == 0) return -1;
+        if (start >= nch) start = 0;
+        const size_t nw = (nch+63)/64;
+        const uint64_t last = (nch & 63) ? ((1ULL << (nch & 63)) - 1) : ~0ULL;
+        size_t   w    = start>>6;
+        uint64_t bits = W[w].bits.load(std::memory_order_acquire) & (~0ULL << (start & 63));
+        for(size_t k=0;k<=nw;++k) {
+            if (w == nw-1) bits &= last;
+            if (bits) return (ssize_t)((w<<6) + ctz(bits));
+            w = (w+1) % nw;
+            bits = W[w].bits.load(std::memory_order_acquire);
+        }
+        return -1;
+    }
+
+    inline bool any(size_t nch) const { return next(0, nch) >= 0; }
+    inline size_t size() const { return n; }
+
+private:
+    std::vector<word_t> W;
+    const size_t        n;
+};
+
+/*
+ * It sets the doorbell of the channel \p b (bit \p id), if the channel
+ * supports it (see uSWSR_Ptr_Buffer::set_doorbell).
+ */
+template<typename B>
+static inline auto ff_set_doorbell(B* b, ff_doorbell* d, size_t id, int) -> decltype(b->set_doorbell(d, id), bool()) {
+    b->set_doorbell(d, id);
+    return true;
+}
+template<typename B>
+static inline bool ff_set_doorbell(B*, ff_doorbell*, size_t, long) { return false; }
+template<typename B>
+static inline bool ff_set_doorbell(B* b, ff_doorbell* d, size_t id) {
+    return b && ff_set_doorbell(b, d, id, 0);
+}
+
+} // namespace ff
+
+#endif /* FF_DOORBELL_HPP */
@@ -0,0 +1,276 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+
+/*!
+ *  \link
+ *  \file elastic.hpp
+ *  \ingroup shared_memory_fastflow
+ *
+ *  \brief This file contains a run-time controller of the number of active
+ *  workers of a farm.
+ */
+
+#ifndef FF_ELASTIC_HPP
+#define FF_ELASTIC_HPP
+
+/* ***************************************************************************
+ *
+ *  FastFlow is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License version 3 as
+ *  published by the Free Software Foundation.
+ *  Starting from version 3.0.1 FastFlow is dual licensed under the GNU LGPLv3
+ *  or MIT License (https://github.com/ParaGroup/WindFlow/blob/vers3.x/LICENSE.MIT)
+ *
+ *  This program is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ ****************************************************************************
+ */
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <chrono>
+#include <atomic>
+#include <ostream>
+#include <ff/node.hpp>
+#include <ff/farm.hpp>
+
+namespace ff {
+
+/*!
+ *  \ingroup shared_memory_fastflow
+ *
+ *  @{
+ */
+
+/*!
+ * \class ff_elastic_manager
+ * \ingroup shared_memory_fastflow
+ *
+ * \brief Autonomic control of the number of active workers of a farm.
+ *
+ * A helper thread samples, every \p period_ms milliseconds, the
+ * utilization of the active workers (time spent in svc over the period),
+ * their backlog (tasks queued in their input channels) and the arrival
+ * rate of the tasks (completed tasks plus the backlog increase), that
+ * times the mean service time gives the number of workers needed
+ * (demand). Then:
+ *  - if the utilization is above FF_ELASTIC_HIGH percent, or the backlog
+ *    is above FF_ELASTIC_BACKLOG tasks per worker and growing, workers are
+ *    added so that the utilization (or the demand) goes back to
+ *    FF_ELASTIC_TARGET percent (at least one);
+ *  - if the utilization has been below FF_ELASTIC_LOW percent with almost
+ *    no backlog for FF_ELASTIC_QUIET samples in a row, workers are removed
+ *    in the same way;
+ * always within [\p minw, \p maxw].
+ *
+ * The Emitter applies the new number of workers when it schedules the
+ * next task: the workers with the highest ids are removed first, each one
+ * completes the tasks already in its input channel and then sleeps on its
+ * condition variable (its svc_end is called, and svc_init when it is added
+ * back). At the end of the stream all the workers are woken up to receive
+ * the EOS. Each decision is logged (see decisions and report).
+ *
+ * \code
+ *   ff_elastic_manager mgr(farm, 2, 16);
+ *   farm.run();
+ *   mgr.start();
+ *   farm.wait();
+ *   mgr.stop();
+ *   mgr.report(std::cout);
+ * \endcode
+ *
+ * The manager has to be created before the farm is run, the workers must
+ * be standard nodes and the farm cannot be ordered. Tasks sent by the
+ * Emitter with ff_send_out_to to a removed worker wait in its channel
+ * until the worker is added back (or the end of the stream).
+ *
+ * This class is defined in \ref elastic.hpp
+ */
+class ff_elastic_manager {
+public:
+    struct decision {
+        double  time_ms;     // since start
+        size_t  oldn;
+        size_t  newn;
+        double  util;        // utilization of the active workers (0..1)
+        size_t  backlog;     // tasks queued to the active workers
+        double  rate;        // arrival rate (tasks/s)
+        double  demand;      // workers needed by the arrival rate
+    };
+
+    ff_elastic_manager(ff_farm& farm, size_t minw, size_t maxw,
+                       double period_ms=FF_ELASTIC_PERIOD_MS):
+        farm(farm), period_ms(period_ms) {
+        const size_t nw = farm.getNWorkers();
+        maxn = (maxw == 0 || maxw > nw) ? nw : maxw;
+        minn = (minw == 0) ? 1 : (minw > maxn ? maxn : minw);
+        farm.set_elastic();
+    }
+    virtual ~ff_elastic_manager() { stop(); }
+
+    ff_elastic_manager(const ff_elastic_manager&) = delete;
+    ff_elastic_manager& operator=(const ff_elastic_manager&) = delete;
+
+    /**
+     * It starts the helper thread, the farm starts with \p maxw workers.
+     *
+     * \return 0 on success, -1 if the manager is already running or the
+     * farm has not been run
+     */
+    int start() {
+        if (running || !farm.getlb() || !farm.getlb()->get_elastic()) return -1;
+        ff_loadbalancer* lb = farm.getlb();
+        const size_t nw = farm.getNWorkers();
+        lastdone.assign(nw, 0); lastbusy.assign(nw, 0);
+        for(size_t i=0;i<nw;++i) {
+            lastdone[i] = lb->get_completed(i);
+            lastbusy[i] = lb->get_busy(i);
+        }
+        lb->set_active_workers(maxn);
+        lastn = maxn; lastbacklog = 0; quiet = 0;
+        lutil = 0.0; lrate = 0.0; lbacklog = 0;
+        t0 = tlast = std::chrono::steady_clock::now();
+        ticklast = getticks();
+        running = true;
+        controller = std::thread([this]() {
+            while(running) {
+                std::this_thread::sleep_for(std::chrono::microseconds((long)(period_ms*1000)));
+                sample();
+            }
+        });
+        return 0;
+    }
+
+    // It stops the helper thread, the active workers are left as they are.
+    void stop() {
+        if (!running) return;
+        running = false;
+        controller.join();
+    }
+
+    // decisions taken so far
+    std::vector<decision> decisions() const {
+        std::lock_guard<std::mutex> lk(mtx);
+        return log;
+    }
+
+    // number of active workers requested by the manager
+    size_t active() const { std::lock_guard<std::mutex> lk(mtx); return lastn; }
+    // measures of the last sample
+    double utilization()  const { std::lock_guard<std::mutex> lk(mtx); return lutil; }
+    double arrival_rate() const { std::lock_guard<std::mutex> lk(mtx); return lrate; }
+    size_t backlog()      const { std::lock_guard<std::mutex> lk(mtx); return lbacklog; }
+
+    void report(std::ostream& out) const {
+        const std::vector<decision> d = decisions();
+        for(size_t i=0;i<d.size();++i)
+            out << "elastic: " << d[i].time_ms << " ms workers "
+                << d[i].oldn << " -> " << d[i].newn
+                << " (utilization " << d[i].util << ", backlog " << d[i].backlog
+                << ", arrival rate " << d[i].rate << " tasks/s, demand "
+                << d[i].demand << " workers)\n";
+    }
+
+protected:
+    /**
+     * It returns the number of workers given the measures of the last
+     * period on \p n active workers (\p demand is the number of workers
+     * busy all the time needed to serve the tasks arrived), it can be
+     * redefined to implement another policy.
+     */
+    virtual size_t decide(size_t n, double util, size_t backlog, double demand) {
+        const double load   = (n*util > demand) ? n*util : demand;
+        const size_t needed = (size_t)(load * 100.0 / FF_ELASTIC_TARGET) + 1;
+        size_t newn = n;
+        if (util*100.0 > FF_ELASTIC_HIGH ||
+            (backlog > n*FF_ELASTIC_BACKLOG && backlog > lastbacklog)) {
+            quiet = 0;
+            newn  = (needed > n) ? needed : n+1;
+        } else if (util*100.0 < FF_ELASTIC_LOW && backlog <= n) {
+            if (++quiet >= FF_ELASTIC_QUIET) {
+                newn  = (needed < n) ? needed : n-1;
+                quiet = 0;
+            }
+        } else quiet = 0;
+        if (newn > maxn) newn = maxn;
+        if (newn < minn) newn = minn;
+        return newn;
+    }
+
+    void sample() {
+        ff_loadbalancer* lb = farm.getlb();
+        const size_t  nw = farm.getNWorkers();
+        const size_t  n  = lb->get_active_workers();
+        const ticks   tnow = getticks();
+        const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        const double  dticks = (double)(tnow - ticklast);
+        const double  dt     = std::chrono::duration<double>(now - tlast).count();
+        if (dticks <= 0 || dt <= 0 || n == 0) return;
+
+        unsigned long completed = 0;
+        double        busy      = 0;
+        for(size_t i=0;i<nw;++i) {
+            const unsigned long d = lb->get_completed(i);
+            const uint64_t      b = lb->get_busy(i);
+            completed += d - lastdone[i];
+            busy      += (double)(b - lastbusy[i]);
+            lastdone[i] = d; lastbusy[i] = b;
+        }
+        size_t backlog = 0;
+        for(size_t i=0;i<n;++i) backlog += lb->get_queue_length(i);
+        const double util    = busy / (dticks * (double)n);
+        const long   arrived = (long)completed + (long)backlog - (long)lastbacklog;
+        const double rate    = (arrived > 0 ? (double)arrived : 0.0) / dt;
+        const double demand  = (completed > 0 && arrived > 0) ?
+            (double)arrived * (busy / (double)completed) / dticks : 0.0;
+
+        // the last decision has not been applied yet by the Emitter
+        const size_t newn = (lastn != n) ? lastn : decide(n, util, backlog, demand);
+
+        std::lock_guard<std::mutex> lk(mtx);
+        if (newn != lastn) {
+            lb->set_active_workers(newn);
+            decision dd;
+            dd.time_ms = std::chrono::duration<double,std::milli>(now - t0).count();
+            dd.oldn = lastn; dd.newn = newn; dd.util = util; dd.backlog = backlog;
+            dd.rate = rate; dd.demand = demand;
+            log.push_back(dd);
+        }
+        lastn = newn; lutil = util; lrate = rate; lbacklog = backlog;
+        lastbacklog = backlog;
+        tlast = now; ticklast = tnow;
+    }
+
+protected:
+    ff_farm&                              farm;
+    const double                          period_ms;
+    size_t                                minn, maxn;
+    std::vector<unsigned long>            lastdone;
+    std::vector<uint64_t>                 lastbusy;
+    std::vector<decision>                 log;
+    mutable std::mutex                    mtx;
+    std::thread                           controller;
+    std::atomic<bool>                     running{false};
+    size_t                                lastn = 0, lastbacklog = 0, lbacklog = 0;
+    size_t                                quiet = 0;
+    double                                lutil = 0.0, lrate = 0.0;
+    std::chrono::steady_clock::time_point t0, tlast;
+    ticks                                 ticklast = 0;
+};
+
+/*!
+ *
+ * @}
+ * \link
+ */
+
+} // namespace ff
+
+#endif /* FF_ELASTIC_HPP */
@@ -0,0 +1,156 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*!
+ *  \file envelope.hpp
+ *  \ingroup building_blocks
+ *
+ *  \brief Reference-counted envelope of the tasks sent in broadcast.
+ */
+
+/* ***************************************************************************
+ *
+ *  FastFlow is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License version 3 as
+ *  published by the Free Software Foundation.
+ *  Starting from version 3.0.1 FastFlow is dual licensed under the GNU LGPLv3
+ *  or MIT License (https://github.com/ParaGroup/WindFlow/blob/vers3.x/LICENSE.MIT)
+ *
+ *  This program is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ ****************************************************************************
+ */
+
+/*
+ * broadcast_task sends the same pointer to all the output channels and
+ * nobody knows when it can be freed. broadcast_shared (ff_loadbalancer,
+ * ff_monode) sends an ff_envelope instead: the payload is allocated once,
+ * the envelope counts the consumers it has been sent to and the last one
+ * that releases it deletes the payload (and the envelope).
+ *
+ * \code
+ *   // multi-output Emitter
+ *   Params* svc(Params* p) {
+ *       broadcast_shared(ff_envelope<Params>::make(p));
+ *       return GO_ON;
+ *   }
+ *   // worker: ff_node_t<ff_envelope<Params>, ...>
+ *   Out* svc(ff_envelope<Params>* e) {
+ *       const Params& p = e->view();   // read-only, not copied
+ *       ...
+ *       e->release();
+ *   }
+ * \endcode
+ *
+ * A consumer that wants to keep the payload after svc (e.g. the parameters
+ * of a model used by the next tasks) keeps an ff_envelope_ref instead of
+ * calling release: the reference releases the envelope when it is reset,
+ * overwritten or destroyed.
+ *
+ * The payload is shared read-only: the consumers must not modify it. An
+ * envelope can be sent with broadcast_shared only once.
+ */
+
+#ifndef FF_ENVELOPE_HPP
+#define FF_ENVELOPE_HPP
+
+#include <atomic>
+#include <utility>
+
+namespace ff {
+
+/*
+ * The untyped part of the envelope, used by the run-time.
+ */
+struct ff_envelope_base {
+    ff_envelope_base(const ff_envelope_base&) = delete;
+    ff_envelope_base& operator=(const ff_envelope_base&) = delete;
+
+    // it sets the number of consumers, before the envelope is sent
+    inline void set_consumers(long n) { refs.store(n, std::memory_order_relaxed); }
+
+    // one more reference, e.g. a consumer that forwards the envelope
+    inline void retain() { refs.fetch_add(1, std::memory_order_relaxed); }
+
+    // the last release deletes the payload and the envelope
+    inline void release() {
+        if (refs.fetch_sub(1, std::memory_order_acq_rel) == 1) destroy(this);
+    }
+
+    inline long consumers() const { return refs.load(std::memory_order_relaxed); }
+
+protected:
+    ff_envelope_base(void (*destroy)(ff_envelope_base*)):destroy(destroy) {
+        refs.store(1, std::memory_order_relaxed);
+    }
+    ~ff_envelope_base() {}
+
+    std::atomic<long> refs;
+    void            (*destroy)(ff_envelope_base*);
+};
+
+template<typename T>
+class ff_envelope: public ff_envelope_base {
+    ff_envelope(T* p):ff_envelope_base(&ff_envelope::destroy_),payload(p) {}
+    ~ff_envelope() { delete payload; }
+    static void destroy_(ff_envelope_base* e) { delete static_cast<ff_envelope*>(e); }
+public:
+    // the envelope takes the ownership of \p p (allocated with new)
+    static ff_envelope* make(T* p) { return new ff_envelope(p); }
+
+    // the payload is built in place
+    template<typename... Args>
+    static ff_envelope* emplace(Args&&... args) {
+        return new ff_envelope(new T(std::forward<Args>(args)...));
+    }
+
+    inline const T& view() const { return *payload; }
+    inline const T* get()  const { return payload; }
+    inline const T* operator->() const { return payload; }
+
+private:
+    T* const payload;
+};
+
+/*
+ * A reference to the payload of an envelope received by a consumer, it
+ * owns one of the consumers' references.
+ */
+template<typename T>
+class ff_envelope_ref {
+public:
+    ff_envelope_ref():e(nullptr) {}
+    explicit ff_envelope_ref(ff_envelope<T>* e):e(e) {}
+    ff_envelope_ref(ff_envelope_ref&& r):e(r.e) { r.e = nullptr; }
+    ff_envelope_ref& operator=(ff_envelope_ref&& r) {
+        if (this != &r) { reset(); e = r.e; r.e = nullptr; }
+        return *this;
+    }
+    ff_envelope_ref(const ff_envelope_ref& r):e(r.e) { if (e) e->retain(); }
+    ff_envelope_ref& operator=(const ff_envelope_ref& r) {
+        if (r.e) r.e->retain();
+        reset();
+        e = r.e;
+        return *this;
+    }
+    ~ff_envelope_ref() { reset(); }
+
+    inline void reset() { if (e) { e->release(); e = nullptr; } }
+
+    explicit operator bool() const { return e != nullptr; }
+    inline const T& operator*()  const { return e->view(); }
+    inline const T* operator->() const { return e->get(); }
+    inline const T* get()        const { return e ? e->get() : nullptr; }
+
+private:
+    ff_envelope<T>* e;
+};
+
+} // namespace ff
+
+#endif /* FF_ENVELOPE_HPP */
@@ -173,6 +173,8 @@ protected:
         ofarm_gt(int max_num_workers):
             ff_gatherer(max_num_workers),dead(max_num_workers) {
             dead.resize(max_num_workers);
+            set_multipop(1); // strict round-robin, one task per channel
+            set_doorbell(false);
         }
         inline ssize_t selectworker() { return victim; }
         void updatenextone() {
@@ -236,6 +238,32 @@ protected:
             }
         }
         
+        if (ordered && stealing) {
+            error("FARM: work-stealing cannot be used in an ordered farm\n");
+            return -1;
+        }
+        if (ordered && schedpolicy != FF_SCHED_RR) {
+            error("FARM: an ordered farm can only use the round-robin scheduling\n");
+            return -1;
+        }
+        if (ordered && elastic) {
+            error("FARM: an ordered farm cannot be elastic\n");
+            return -1;
+        }
+        if (keyf && (ordered || stealing || schedpolicy != FF_SCHED_RR)) {
+            error("FARM: the key partitioning cannot be used with ordering, work-stealing or other policies\n");
+            return -1;
+        }
+        if (stealing && (schedpolicy == FF_SCHED_LOW || schedpolicy == FF_SCHED_COST)) {
+            // the tasks stolen would be completed by a worker they were not sent to
+            error("FARM: work-stealing cannot be used with the least outstanding work and cost-aware policies\n");
+            return -1;
+        }
+        if (batchsize && (ordered || stealing || elastic || keyf)) {
+            error("FARM: the batching cannot be used with ordering, work-stealing, elastic farm or key partitioning\n");
+            return -1;
+        }
+
         // ordering
         if (ordered) {
 
@@ -250,11 +278,14 @@ protected:
                 ordered_lb* _lb= new ordered_lb(nworkers);
                 ordered_gt* _gt= new ordered_gt(nworkers);
                 assert(_lb); assert(_gt);
-                ordering_Memory.resize(nworkers * (2*ff_farm::ondemand_buffer()+3)+ordering_memsize);
+                // reorder window, the Emitter waits if it is full
+                ordering_Memory.resize(ff_reorder_window::roundup(nworkers * (2*ff_farm::ondemand_buffer()+3)+ordering_memsize));
                 _lb->init(ordering_Memory.begin(), ordering_Memory.size());
-                _gt->init(ordering_memsize);
+                _gt->init(_lb->window());
                 setlb(_lb, true);
                 setgt(_gt, true);
+                _gt->set_doorbell(true); // it takes the tasks from any channel
+                _gt->set_multipop(FF_MULTIPOP_SIZE);
                 
                 for(size_t i=0;i<nworkers;++i) {
                     workers[i] = new OrderedWorkerWrapper(workers[i], worker_cleanup);
@@ -321,11 +352,14 @@ protected:
                 
                 const svector<ff_node*>& W1 = a2a_first->getFirstSet();
                 for(size_t i=0;i<W1.size();++i) {
+                    // on-demand scheduling: a worker must not hold more tasks than its queue
+                    if (ondemand) W1[i]->set_multipop(1);
                     lb->register_worker(W1[i]);
                 }
             } else {
                 if (workers[i]->create_input_buffer((int) (ondemand ? ondemand: in_buffer_entries), 
                                                     (ondemand ? true: fixedsizeIN))<0) return -1;
+                if (ondemand) workers[i]->set_multipop(1);
 
                 lb->register_worker(workers[i]);
             }
@@ -497,6 +531,30 @@ protected:
             }
         }
         
+        // work-stealing among the workers
+        if (stealing && lb->set_stealing(steal_policy, in_buffer_entries)<0) {
+            error("FARM, work-stealing is supported only for standard workers\n");
+            return -1;
+        }
+        if (schedpolicy != FF_SCHED_RR && lb->set_scheduling_policy(schedpolicy)<0) {
+            error("FARM, the load-aware scheduling policies are supported only for standard workers\n");
+            return -1;
+        }
+        if (keyf && lb->set_scheduling_bykey(keyf, kp_vnodes)<0) {
+            error("FARM, the key partitioning is supported only for standard workers\n");
+            return -1;
+        }
+        if (elastic && lb->set_elastic()<0) {
+            error("FARM, the elastic farm is supported only for standard workers\n");
+            return -1;
+        }
+        if (batchsize && lb->set_batching(batchsize, batchflush)<0) {
+            error("FARM, the batching is supported only for standard workers\n");
+            return -1;
+        }
+        // with many workers the collector probes only the non-empty channels
+        if (collector && !collector_removed) gt->init_doorbell();
+
         // preparing emitter
         if (emitter) {
             if (emitter->isMultiOutput()) {
@@ -818,6 +876,10 @@ public:
         ordered           = f.ordered;
         ordering_memsize  = f.ordering_memsize;
         ondemand = f.ondemand; in_buffer_entries = f.in_buffer_entries;
+        stealing = f.stealing; steal_policy = f.steal_policy;
+        schedpolicy = f.schedpolicy; elastic = f.elastic;
+        keyf = f.keyf; kp_vnodes = f.kp_vnodes;
+        batchsize = f.batchsize; batchflush = f.batchflush;
         out_buffer_entries = f.out_buffer_entries;
         worker_cleanup = f.worker_cleanup; 
         emitter_cleanup = f.emitter_cleanup;
@@ -835,7 +897,7 @@ public:
         //lb = new lb_t(max_nworkers);
         //gt = new gt_t(max_nworkers);
         lb=nullptr;setlb(f.lb); myownlb = f.myownlb;
-        gt=nullptr;setgt(f.gt); myowngt = f.myowngt;
+        gt=f.gt; myowngt = f.myowngt; // the same gatherer, doorbell included
         assert(lb); assert(gt);
         
         add_emitter(f.emitter);
@@ -861,6 +923,10 @@ public:
         ordering_memsize  = f.ordering_memsize;
         ordering_Memory   = std::move(f.ordering_Memory);
         ondemand = f.ondemand; in_buffer_entries = f.in_buffer_entries;
+        stealing = f.stealing; steal_policy = f.steal_policy;
+        schedpolicy = f.schedpolicy; elastic = f.elastic;
+        keyf = f.keyf; kp_vnodes = f.kp_vnodes;
+        batchsize = f.batchsize; batchflush = f.batchflush;
         out_buffer_entries = f.out_buffer_entries;
         worker_cleanup = f.worker_cleanup; 
         emitter_cleanup = f.emitter_cleanup;
@@ -924,6 +990,10 @@ public:
         }
         gt = external_gt;
         myowngt = cleanup;
+        // the doorbell scan and the multipop do not call selectworker, that
+        // the gatherer may redefine (see ff_gatherer::set_doorbell)
+        gt->set_doorbell(false);
+        gt->set_multipop(1);
     }
     void setlb(ff_loadbalancer *external_lb, bool cleanup=false) {
         assert(external_lb);
@@ -1087,6 +1157,146 @@ public:
         }
         if (inbufferentries<=0) ondemand=1;
         else ondemand=inbufferentries;
+        stealing = false;
+    }
+
+    /**
+     * \brief Work-stealing scheduling.
+     *
+     * The Emitter still decides the worker of each task, but the task waits
+     * in a queue that the other workers can steal from: an idle worker
+     * takes the oldest (\p FF_STEAL_FIFO) or the most recent
+     * (\p FF_STEAL_LIFO) task queued to another worker (see stealq.hpp).
+     * It is useful when the service times are very different (a task queued
+     * behind a long one is not stuck there). The copies of a broadcast
+     * task are not stolen, each worker gets its own.
+     * Each queue holds at most the input buffer size tasks (see
+     * setInputQueueLength), the workers must be standard nodes and the
+     * farm cannot be ordered. It replaces the on-demand scheduling.
+     */
+    void set_scheduling_stealing(const ff_steal_t policy=FF_STEAL_FIFO) {
+        if (prepared) {
+            error("FARM, set_scheduling_stealing, farm already prepared\n");
+            return;
+        }
+        stealing     = true;
+        steal_policy = policy;
+        ondemand     = 0;
+    }
+
+    /**
+     * \brief The queues of the workers when work-stealing is used (after
+     * the farm has been prepared), NULL otherwise.
+     */
+    const ff_steal_group* getStealGroup() const { return lb->get_steal_group(); }
+
+    /**
+     * \brief Load-aware scheduling.
+     *
+     * The Emitter sends each task to the worker with the fewest tasks
+     * queued (\p FF_SCHED_JSQ), to the less loaded of two workers taken at
+     * random (\p FF_SCHED_P2C), to the worker with the fewest tasks sent
+     * and not yet completed (\p FF_SCHED_LOW) or to the worker that would
+     * complete it first according to its measured service time
+     * (\p FF_SCHED_COST), see lbpolicy.hpp. The default is round-robin
+     * (\p FF_SCHED_RR). Unlike the on-demand scheduling the channels keep
+     * their capacity. It cannot be used in an ordered farm, the workers
+     * must be standard nodes. With work-stealing the length of the
+     * workers' queues is used, FF_SCHED_LOW and FF_SCHED_COST cannot be
+     * used.
+     */
+    void set_scheduling_policy(const ff_sched_t policy) {
+        if (prepared) {
+            error("FARM, set_scheduling_policy, farm already prepared\n");
+            return;
+        }
+        schedpolicy = policy;
+    }
+
+    /**
+     * \brief Service time of worker \p i (ticks) as estimated by the
+     * FF_SCHED_COST policy, 0 if it is not known yet. It can be called
+     * while the farm is running.
+     */
+    double getWorkerServiceTime(size_t i) const { return lb->get_service_time(i); }
+
+    /**
+     * \brief Tasks completed so far by worker \p i with the FF_SCHED_LOW
+     * and FF_SCHED_COST policies.
+     */
+    unsigned long getWorkerCompleted(size_t i) const { return lb->get_completed(i); }
+
+    /**
+     * \brief Key-partitioned scheduling.
+     *
+     * All the tasks with the same key (\p key returns the key of a task)
+     * go to the same worker, so that each worker can keep the state of its
+     * keys. The keys are mapped onto the workers with consistent hashing
+     * (\p vnodes points per worker), the most frequent ones are moved from
+     * the overloaded workers to the least loaded one and the keys are also
+     * moved when the farm is elastic and the number of workers changes.
+     * The workers implementing ff_keyed_state give away and receive the
+     * state of the keys moved (see kpartition.hpp). The workers must be
+     * standard nodes, it cannot be used with ordering, work-stealing and
+     * the other scheduling policies.
+     */
+    void set_scheduling_bykey(std::function<uint64_t(void*)> key, size_t vnodes=FF_KP_VNODES) {
+        if (prepared) {
+            error("FARM, set_scheduling_bykey, farm already prepared\n");
+            return;
+        }
+        keyf      = key;
+        kp_vnodes = vnodes;
+    }
+
+    /**
+     * \brief The key to worker map when the key partitioning is used
+     * (after the farm has been prepared), NULL otherwise.
+     */
+    const ff_key_partitioner* getKeyPartitioner() const { return lb->get_key_partitioner(); }
+
+    /**
+     * \brief Batch-aware scheduling.
+     *
+     * The Emitter sends the tasks to the workers in bundles of up to
+     * \p size consecutive tasks (by default a bundle is one cache line), a
+     * bundle is sent when it is full or when its first task is older than
+     * \p flush ticks, and before the EOS. The workers call svc on each task
+     * of the bundle, so their code does not change (see batch.hpp). It is
+     * useful with very small tasks. The workers must be standard nodes, it
+     * cannot be used with ordering, work-stealing, the key partitioning and
+     * in an elastic farm. A size of 0 disables it.
+     */
+    void set_batching(size_t size=FF_BATCH_SIZE, ticks flush=FF_BATCH_FLUSH_TICKS) {
+        if (prepared) {
+            error("FARM, set_batching, farm already prepared\n");
+            return;
+        }
+        batchsize  = size;
+        batchflush = flush;
+    }
+
+    /**
+     * \brief The bundles of the Emitter when the batching is used (after
+     * the farm has been prepared), NULL otherwise.
+     */
+    const ff_batcher* getBatcher() const { return lb->get_batcher(); }
+
+    /**
+     * \brief Elastic farm.
+     *
+     * The number of active workers can be changed while the farm is
+     * running (see ff_loadbalancer::set_active_workers), the workers
+     * removed sleep until they are added back. It is used by the
+     * ff_elastic_manager (see elastic.hpp) that sets it. The workers must be
+     * standard nodes and the farm cannot be ordered.
+     */
+    void set_elastic() {
+        if (prepared) {
+            error("FARM, set_elastic, farm already prepared\n");
+            return;
+        }
+        elastic = true;
     }
     /**
      * \brief Force ordering. 
@@ -1095,7 +1305,9 @@ public:
      * input ordering.
      *
      * The \param MemoryElements sets the maximum size of the buffer in the 
-     * collector when the scheduling of elements is on-demand.
+     * collector when the scheduling of elements is on-demand: the tasks are
+     * reordered in a window of sequence numbers (see ff_reorder_window) and
+     * the Emitter waits when the window is full.
      */
     void set_ordered(const size_t MemoryElements=DEF_OFARM_ONDEMAND_MEMORY) {
         if (prepared) {
@@ -1112,6 +1324,8 @@ public:
     ordering_pair_t* ordered_get_memory() { return ordering_Memory.begin(); }
     
     int ondemand_buffer() const { return ondemand; }
+    bool stealing_enabled() const { return stealing; }
+    size_t batching_size() const { return batchsize; }
     ssize_t ordering_memory_size() const { return ordering_memsize; }
     
     /**
@@ -1551,7 +1765,7 @@ public:
             _retry:
                 const bool empty=inbuffer->empty();
                 if (inbuffer->push(task)) {
-                    if (empty) pthread_cond_signal(p_cons_c);
+                    ff_park_notify(p_cons_c, empty);
                     return true;
                 }
                 struct timespec tv;
@@ -1603,11 +1817,7 @@ public:
                 if ((*task != (void *)FF_EOS)) return true;
                 else return false;
             }
-            struct timespec tv;
-            timedwait_timeout(tv);
-            pthread_mutex_lock(cons_m);
-            pthread_cond_timedwait(cons_c, cons_m,&tv);
-            pthread_mutex_unlock(cons_m);
+            ff_park_wait(cons_m, cons_c);
             goto _retry;
         }
         for(unsigned long i=0;i<retry;++i) {
@@ -2111,6 +2321,11 @@ protected:
         return 0;
     }
 
+protected:
+    // the node \p n will be pinned on the core \p cpuId when started
+    // (e.g. a core of the coreBudget, see ff_forall_farm)
+    void set_node_cpu(ff_node* n, int cpuId) { n->setCPUId(cpuId); }
+
 protected:
     bool has_input_channel; // for the accelerator mode
     bool collector_removed;
@@ -2120,6 +2335,14 @@ protected:
     bool worker_cleanup, emitter_cleanup,collector_cleanup;
     
     int ondemand;          // if >0, emulates on-demand scheduling
+    bool       stealing     = false;   // see set_scheduling_stealing
+    ff_steal_t steal_policy = FF_STEAL_FIFO;
+    ff_sched_t schedpolicy  = FF_SCHED_RR;     // see set_scheduling_policy
+    bool       elastic      = false;           // see set_elastic
+    std::function<uint64_t(void*)> keyf;        // see set_scheduling_bykey
+    size_t     kp_vnodes    = FF_KP_VNODES;
+    size_t     batchsize    = 0;               // see set_batching
+    ticks      batchflush   = FF_BATCH_FLUSH_TICKS;
     int in_buffer_entries;
     int out_buffer_entries;
     size_t max_nworkers;
@@ -2278,6 +2501,12 @@ public:
         return ff_farm::load_result_nb((void**)&r);
     }    
 
+    // key is called with the input tasks (IN_t*)
+    template<typename KEY_t>
+    void set_scheduling_bykey(KEY_t key, size_t vnodes=FF_KP_VNODES) {
+        ff_farm::set_scheduling_bykey([key](void* t) -> uint64_t { return key((IN_t*)t); }, vnodes);
+    }
+
     // ------------------- deleted method --------------------------------- 
     int add_workers(std::vector<ff_node *> & w)                   = delete;
     int add_emitter(ff_node * e)                                  = delete;
@@ -81,10 +81,10 @@ protected:
         if (cons_m == nullptr) {
             assert(cons_c==nullptr);
             cons_m = (pthread_mutex_t*)malloc(sizeof(pthread_mutex_t));
-            cons_c = (pthread_cond_t*)malloc(sizeof(pthread_cond_t));
+            cons_c = ff_parking_create();
             assert(cons_m); assert(cons_c);
+            if (!cons_c) return false;
             if (pthread_mutex_init(cons_m, NULL) != 0) return false;
-            if (pthread_cond_init(cons_c, NULL) != 0)  return false;
         } 
         m = cons_m,  c = cons_c;
         return true;
@@ -160,12 +160,7 @@ protected:
      */
     virtual inline void losetime_out(unsigned long ticks=TICKS2WAIT) { 
         FFTRACE(lostpushticks+=ticks;++pushwait);
-#if defined(SPIN_USE_PAUSE)
-        const long n = (long)ticks/2000;
-        for(int i=0;i<=n;++i) PAUSE();
-#else
-        ticks_wait(ticks);
-#endif /* SPIN_USE_PAUSE */
+        backoff_out.wait(ticks);
     }
     
     /**
@@ -176,12 +171,7 @@ protected:
      */
     virtual inline void losetime_in(unsigned long ticks=TICKS2WAIT) { 
         FFTRACE(lostpopticks+=ticks;++popwait);
-#if defined(SPIN_USE_PAUSE)
-        const long n = (long)ticks/2000;
-        for(int i=0;i<=n;++i) PAUSE();
-#else
-        ticks_wait(ticks);
-#endif /* SPIN_USE_PAUSE */
+        backoff_in.wait(ticks);
     }    
 
     /**
@@ -195,28 +185,68 @@ protected:
      * is returned.
      */
     virtual ssize_t gather_task(void ** task) {
+        // first the tasks already taken from the last channel
+        if (mppos < mpsize) {
+            *task = mpbuf[mppos++];
+            return (nextr = mpchannel);
+        }
+        if (bell) return gather_task_bell(task);
         unsigned int cnt;
         do {
             cnt=0;
             do {
                 nextr = selectworker();
                 //assert(offline[nextr]==false);
-                if (workers[nextr]->get(task)) {
-                    return nextr;
-                }
-                else if (++cnt == nattempts()) break;
+                if (take(nextr, task)) return nextr;
+                if (++cnt == nattempts()) break;
             } while(1);
             if (blocking_in) {
-                struct timespec tv;
-                timedwait_timeout(tv);
-                pthread_mutex_lock(cons_m);
-                pthread_cond_timedwait(cons_c, cons_m, &tv);
-                pthread_mutex_unlock(cons_m);
+                ff_park_wait(cons_m, cons_c);
+            } else losetime_in();
+        } while(1);
+        return -1;
+    }
+
+    /*
+     * As gather_task, but only the channels whose bit is set in the
+     * doorbell are probed, round-robin (see doorbell.hpp).
+     */
+    inline ssize_t gather_task_bell(void ** task) {
+        do {
+            ssize_t i;
+            while((i = bell->next((size_t)(nextr+1), (size_t)running)) >= 0) {
+                nextr = i;
+                if (offline[i]) { bell->clear(i); continue; }
+                if (take(i, task)) return i;
+                bell->clear(i);
+                if (take(i, task)) { bell->ring(i); return i; }
+            }
+            if (++bellidle == FF_DOORBELL_SWEEP) {
+                bellidle = 0;
+                if (sweep_doorbell()) continue;
+            }
+            if (blocking_in) {
+                ff_park_wait(cons_m, cons_c, [this]() {
+                        return bell->any((size_t)running) || sweep_doorbell(); });
             } else losetime_in();
         } while(1);
         return -1;
     }
 
+    /*
+     * It probes all the input channels and sets the bit of the non-empty
+     * ones, a push racing with a clear may have not set it (see doorbell.hpp).
+     */
+    inline bool sweep_doorbell() {
+        bool found = false;
+        for(ssize_t i=0;i<running;++i)
+            if (!offline[i] && !workers[i]->get_out_buffer()->empty()) {
+                bell->ring(i);
+                found = true;
+            }
+        return found;
+    }
+
     /**
      * \brief Pushes the task in the tasks queue.
      *
@@ -234,7 +264,7 @@ protected:
                     pthread_cond_timedwait(prod_c,prod_m, &tv);
                     pthread_mutex_unlock(prod_m);  
                 }
-                if (empty) pthread_cond_signal(p_cons_c);
+                ff_park_notify(p_cons_c, empty);
             } else {
                 bool empty=filter->get_out_buffer()->empty();
                 while(!filter->push(task)) {
@@ -245,7 +275,7 @@ protected:
                     pthread_cond_timedwait(prod_c,prod_m,&tv);
                     pthread_mutex_unlock(prod_m);      
                 }
-                if (empty) pthread_cond_signal(p_cons_c);
+                ff_park_notify(p_cons_c, empty);
             }
             return true;
         }
@@ -362,14 +392,14 @@ public:
     }
     
     virtual ~ff_gatherer() {
+        if (bell) delete bell;
         if (cons_m) {
             pthread_mutex_destroy(cons_m);
             free(cons_m);
             cons_m = nullptr;
         }
         if (cons_c) {
-            pthread_cond_destroy(cons_c);
-            free(cons_c);
+            ff_parking_destroy(cons_c);
             cons_c = nullptr;
         }
         if (prod_m) {
@@ -411,7 +441,52 @@ public:
     // Sets where feedback channels end (if any)
     // All channels were registered in input, first feedback ones then the input ones. 
     void set_feedbackid_threshold(size_t id) { feedbackid = id; }
+
+    /**
+     * Sets how many tasks are taken from one input channel at each
+     * selection (between 1 and FF_MULTIPOP_SIZE, see config.hpp).
+     * Gatherers that have to select the channel for each task (e.g. the
+     * ordered ones) set it to 1, ff_farm::setgt sets it to 1 for the
+     * gatherers given by the user.
+     */
+    void set_multipop(size_t k) {
+        multipop_size = (k<1) ? 1 : ((k>FF_MULTIPOP_SIZE) ? FF_MULTIPOP_SIZE : k);
+    }
     
+    /**
+     * It enables (default) or disables the doorbell of the input channels.
+     * Gatherers that have to select the channel for each task (e.g. the
+     * ordered ones) disable it, the scan of the doorbell does not call
+     * selectworker. ff_farm::setgt disables it for the gatherers given by
+     * the user.
+     */
+    void set_doorbell(bool on) { use_doorbell = on; }
+
+    /**
+     * With at least FF_DOORBELL_MIN_CHANNELS input channels, the producers
+     * flag the non-empty channels in a doorbell and gather_task probes only
+     * the flagged ones (see doorbell.hpp). It is called when the channels
+     * have been created and before the producers are started.
+     *
+     * \return true if the doorbell is used
+     */
+    bool init_doorbell() {
+        if (bell) return true;
+        if (!use_doorbell || workers.size() < FF_DOORBELL_MIN_CHANNELS) return false;
+        ff_doorbell* d = new ff_doorbell(workers.size());
+        for(size_t i=0;i<workers.size();++i) {
+            if (!ff_set_doorbell(workers[i]->get_out_buffer(), d, i)) {
+                for(size_t j=0;j<i;++j) ff_set_doorbell(workers[j]->get_out_buffer(), (ff_doorbell*)nullptr, 0);
+                delete d;
+                return false;
+            }
+        }
+        d->ring_all();
+        bell = d;
+        return true;
+    }
+    bool has_doorbell() const { return bell != nullptr; }
+
     ff_node *get_filter() const { return (filter==(ff_node*)this)?NULL:filter; }
     
     void reset_filter() {
@@ -472,6 +547,13 @@ public:
      */
     inline size_t getnworkers() const { return (size_t)(running-neos-neosnofreeze); }
 
+    /**
+     * \brief Statistics of the waits on the input (output) channel(s),
+     * they can be read while the collector is running (see backoff.hpp).
+     */
+    ff_backoff_stats get_backoff_in()  const { return backoff_in.stats(); }
+    ff_backoff_stats get_backoff_out() const { return backoff_out.stats(); }
+
     
     inline size_t getrunning() const { return (size_t)running;}
     
@@ -543,8 +625,15 @@ public:
             if (filter) filter->setCPUId(cpuId);
         }
 #endif        
+#if defined(FF_RING_NUMA)
+        {   // the rings of the input channels go to the NUMA node of the collector
+            const int node = ff_my_numanode();
+            for(ssize_t i=0;i<running;++i) ff_place_ring(workers[i]->get_out_buffer(), node);
+        }
+#endif
         gettimeofday(&tstart,NULL);
         for(ssize_t i=0;i<running;++i)  offline[i]=false;
+        if (bell) bell->ring_all();
         if (filter) {
             if (filter->isComp() && !filter->isMultiInput())
                 filter->set_neos(running);
@@ -617,11 +706,14 @@ public:
                 FFTRACE(++taskcnt);
                 if (filter)  {                    
                     FFTRACE(ticks t0 = getticks());
+                    ff_node_prof* const prof = filter->prof;
+                    const ticks p0 = prof ? getticks() : 0;
 
 #if defined(FF_TASK_CALLBACK)
                     if (filter) callbackIn(this);
 #endif
                     task = filter->svc(task);
+                    if (prof) prof->svcdone(getticks()-p0, (!filter_outpresent && outpresent)?task:nullptr);
 
 #if defined(TRACE_FASTFLOW)
                     ticks diff=(getticks()-t0);
@@ -756,22 +848,18 @@ public:
         for(ssize_t i=0;i<running;++i) {
             if(i != channelid) {
                 if (_workers[i]) {
-                    if (!_workers[i]->get(&V[i])) retry.push_back(i);
+                    if (!getfrom(i, &V[i])) retry.push_back(i);
                 }
             }
         }
         while(retry.size()) {
             channelid = retry.back();
-            if(_workers[channelid]->get(&V[channelid])) {
+            if(getfrom(channelid, &V[channelid])) {
                 retry.pop_back();
             }
             else {
                 if (blocking_in) {
-                    struct timespec tv;
-                    timedwait_timeout(tv);
-                    pthread_mutex_lock(cons_m);
-                    pthread_cond_timedwait(cons_c, cons_m, &tv);
-                    pthread_mutex_unlock(cons_m);
+                    ff_park_wait(cons_m, cons_c);
                 } else losetime_in();
             }
         }
@@ -919,6 +1007,47 @@ protected:
     bool               blocking_in;
     bool               blocking_out;
 
+    // adaptive backoff of the input and output channel(s)
+    ff_backoff         backoff_in;
+    ff_backoff         backoff_out;
+
+    // tasks taken from channel mpchannel and not yet returned by gather_task
+    void *             mpbuf[FF_MULTIPOP_SIZE];
+    size_t             mppos  = 0;
+    size_t             mpsize = 0;
+    ssize_t            mpchannel = -1;
+    size_t             multipop_size = FF_MULTIPOP_SIZE;
+
+    // non-empty input channels, see set_doorbell
+    ff_doorbell       *bell = nullptr;
+    size_t             bellidle = 0;  // rounds without data, see sweep_doorbell
+    bool               use_doorbell = true;
+
+    // non-blocking get of the next task(s) from channel i
+    inline bool take(ssize_t i, void ** task) {
+        if (multipop_size > 1) {
+            // drains up to multipop_size tasks from the selected channel
+            if ((mpsize = workers[i]->multiget(mpbuf, multipop_size)) > 0) {
+                mppos     = 1;
+                mpchannel = i;
+                *task     = mpbuf[0];
+                return true;
+            }
+            return false;
+        }
+        return workers[i]->get(task);
+    }
+
+    // non-blocking get from channel i, taking into account the tasks
+    // already drained by gather_task
+    inline bool getfrom(ssize_t i, void ** task) {
+        if (mppos < mpsize && mpchannel == i) {
+            *task = mpbuf[mppos++];
+            return true;
+        }
+        return workers[i]->get(task);
+    }
+
 #if defined(TRACE_FASTFLOW)
     unsigned long taskcnt;
     ticks         lostpushticks;
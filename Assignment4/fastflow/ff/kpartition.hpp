@@ -0,0 +1,410 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*!
+ *  \file kpartition.hpp
+ *  \ingroup building_blocks
+ *
+ *  \brief Key partitioning of the farm's tasks: consistent hashing, hot
+ *  keys and migration of the keys' state between workers.
+ */
+
+/* ***************************************************************************
+ *
+ *  FastFlow is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License version 3 as
+ *  published by the Free Software Foundation.
+ *  Starting from version 3.0.1 FastFlow is dual licensed under the GNU LGPLv3
+ *  or MIT License (https://github.com/ParaGroup/WindFlow/blob/vers3.x/LICENSE.MIT)
+ *
+ *  This program is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ ****************************************************************************
+ */
+
+/*
+ * With key partitioning (see ff_farm::set_scheduling_bykey) all the tasks
+ * with the same key go to the same worker, so that a stateful worker owns
+ * the state of its keys. The Emitter maps the keys onto the workers with
+ * consistent hashing: each active worker has FF_KP_VNODES points on a ring
+ * of 64-bit hashes and a key belongs to the first point after its hash.
+ * When the number of active workers changes (elastic farm) only the keys
+ * of the points added or removed move.
+ *
+ * The Emitter does not keep the keys seen: the state of a key is where the
+ * ring of all the workers (the base ring) puts it, unless the key has been
+ * moved, and only the moved keys are kept (with their owner). So the map
+ * has the keys moved by rebalance that are still among the most frequent
+ * ones and, while the active workers are not all the workers, the keys
+ * seen since then whose owner in the current ring differs from the base
+ * one. A key moved by rebalance that is no longer among the most frequent
+ * keys of the window goes back to its owner in the ring. A key is moved when it is seen, after a
+ * change of the active workers, not when the change happens: the keys
+ * never seen again stay where they are.
+ *
+ * Every FF_KP_WINDOW tasks the Emitter looks at the load of the workers in
+ * the window and at the most frequent keys (space-saving counters, the
+ * FF_KP_TOPK most frequent keys). If a worker has received more than
+ * FF_KP_IMBALANCE percent of the mean, up to FF_KP_MAX_MOVES of its keys
+ * are moved to the least loaded worker, the biggest ones that reduce the
+ * imbalance. A key that alone is worth more than a worker is reported as
+ * hot (it cannot be split without losing the per-key ordering).
+ *
+ * Moving a key: if the workers implement ff_keyed_state, the state of the
+ * key is taken from the old worker (extract_key_state) after the tasks of
+ * the key already sent to it and given to the new worker
+ * (install_key_state) before the new tasks of the key. The Emitter queues
+ * a message in the control queue of each worker and sends the FF_KEY_CTL
+ * mark in its input channel, where it keeps the order with the tasks. The
+ * new worker waits for the old one when it finds the mark. If the old
+ * worker is no longer active (it sleeps) the Emitter takes the state from
+ * it, after it has stopped, and posts only the message of the new worker.
+ */
+
+#ifndef FF_KPARTITION_HPP
+#define FF_KPARTITION_HPP
+
+#include <cstdint>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <algorithm>
+#include <functional>
+#include <unordered_map>
+#include <ff/config.hpp>
+
+namespace ff {
+
+/*!
+ * \class ff_keyed_state
+ *  \ingroup building_blocks
+ *
+ * \brief The interface of the workers of a key-partitioned farm that keep
+ * a per-key state, it is used to move the keys between the workers.
+ *
+ * This class is defined in \ref kpartition.hpp
+ */
+struct ff_keyed_state {
+    virtual ~ff_keyed_state() {}
+    // it gives away the state of \p key, nullptr if there is none
+    virtual void* extract_key_state(uint64_t key) = 0;
+    // it receives the state of \p key given away by another worker
+    virtual void  install_key_state(uint64_t key, void* state) = 0;
+};
+
+/*
+ * Control queue of a worker: the messages are consumed, one per
+ * FF_KEY_CTL mark, by the worker.
+ */
+class ff_key_ctlq {
+    struct mailbox {
+        std::atomic<bool> ready{false};
+        void*             state = nullptr;
+    };
+    struct msg {
+        bool      extract;
+        uint64_t  key;
+        mailbox*  mb;
+    };
+public:
+    // Emitter: key moved from the owner of \p from to the owner of \p to
+    static void post_move(ff_key_ctlq& from, ff_key_ctlq& to, uint64_t key) {
+        mailbox* mb = new mailbox;
+        from.post(msg{true,  key, mb});
+        to.post(msg{false, key, mb});
+    }
+    // Emitter: the \p state of \p key, already taken from its old owner,
+    // goes to the owner of \p to
+    static void post_install(ff_key_ctlq& to, uint64_t key, void* state) {
+        mailbox* mb = new mailbox;
+        mb->state = state;
+        mb->ready.store(true, std::memory_order_relaxed);
+        to.post(msg{false, key, mb});
+    }
+
+    // worker: a FF_KEY_CTL mark has been received
+    void dispatch(ff_keyed_state* ks) {
+        msg m;
+        {
+            std::lock_guard<std::mutex> lk(mtx);
+            if (q.empty()) return;
+            m = q.front(); q.pop_front();
+        }
+        if (m.extract) {
+            m.mb->state = ks ? ks->extract_key_state(m.key) : nullptr;
+            m.mb->ready.store(true, std::memory_order_release);
+            return;
+        }
+        // the old owner has not yet reached the tasks sent before the move
+        while(!m.mb->ready.load(std::memory_order_acquire)) std::this_thread::yield();
+        if (ks && m.mb->state) ks->install_key_state(m.key, m.mb->state);
+        delete m.mb;
+    }
+
+    ~ff_key_ctlq() {
+        // moves never completed (e.g. the farm was stopped), the extract
+        // message is dropped first, the install one deletes the mailbox
+        for(size_t i=0;i<q.size();++i) if (!q[i].extract) delete q[i].mb;
+    }
+
+private:
+    void post(const msg& m) {
+        std::lock_guard<std::mutex> lk(mtx);
+        q.push_back(m);
+    }
+
+    std::mutex      mtx;
+    std::deque<msg> q;
+};
+
+/*!
+ * \class ff_key_partitioner
+ *  \ingroup building_blocks
+ *
+ * \brief Key to worker map of a key-partitioned farm.
+ *
+ * It is used by the Emitter only, the statistics (hot_keys, moves,
+ * resize_moves, nkeys) can be read by any thread.
+ *
+ * This class is defined in \ref kpartition.hpp
+ */
+class ff_key_partitioner {
+    struct counter_t {
+        uint64_t      key;
+        unsigned long count;
+    };
+    // owner of a key moved by rebalance, it does not follow the ring
+    static const uint32_t PINNED = 1U<<31;
+public:
+    struct move_t {
+        uint64_t key;
+        size_t   from, to;
+    };
+
+    ff_key_partitioner(std::function<uint64_t(void*)> keyf, size_t nworkers,
+                       size_t vnodes=FF_KP_VNODES):
+        keyf(keyf), vnodes(vnodes ? vnodes : 1), load(nworkers, 0) {
+        build(base, nworkers);
+        build(ring, nworkers);
+        nactive = nworkers;
+    }
+
+    ff_key_partitioner(const ff_key_partitioner&) = delete;
+    ff_key_partitioner& operator=(const ff_key_partitioner&) = delete;
+
+    inline uint64_t key(void* task) const { return keyf(task); }
+
+    // worker of the key \p k, the window statistics are updated. If the
+    // key has to be moved (the active workers have changed) \p from is its
+    // old owner, otherwise it is the worker returned.
+    inline size_t route(uint64_t k, size_t& from) {
+        std::unordered_map<uint64_t,uint32_t>::iterator it = owner.find(k);
+        size_t w;
+        if (it == owner.end()) {
+            w = from = ring_owner(ring, k);
+            // all the workers active: the current ring is the base one
+            if (nactive != load.size() && (from = ring_owner(base, k)) != w) {
+                owner.emplace(k, (uint32_t)w);
+                nkeys_.store(owner.size(), std::memory_order_relaxed);
+            }
+        } else {
+            w = from = it->second & ~PINNED;
+            // a key moved by rebalance stays where it is, if active
+            if (!(it->second & PINNED) || w >= nactive) {
+                w = ring_owner(ring, k);
+                if (w == ring_owner(base, k)) {
+                    owner.erase(it);
+                    nkeys_.store(owner.size(), std::memory_order_relaxed);
+                } else it->second = (uint32_t)w;
+            }
+        }
+        if (from != w) {
+            std::lock_guard<std::mutex> lk(mtx);
+            ++nmoves; ++nrszmoves;
+        }
+        ++load[w];
+        count(k);
+        ++ntasks;
+        return w;
+    }
+
+    // end of a window: it returns the keys to move to even the load (the
+    // new owners are already set)
+    inline bool window_done() const { return ntasks >= FF_KP_WINDOW; }
+    std::vector<move_t> rebalance() {
+        std::vector<move_t> moves;
+        expire(moves);
+        const size_t n = nactive;
+        std::vector<std::pair<uint64_t,unsigned long> > hot;
+        const unsigned long fair = ntasks / n;
+        for(size_t i=0;i<top.size();++i)
+            if (top[i].count > fair) hot.push_back(std::make_pair(top[i].key, top[i].count));
+        for(size_t m=0; m<FF_KP_MAX_MOVES && n>1; ++m) {
+            size_t hi = 0, lo = 0;
+            for(size_t i=1;i<n;++i) {
+                if (load[i] > load[hi]) hi = i;
+                if (load[i] < load[lo]) lo = i;
+            }
+            if (load[hi]*100 <= fair*FF_KP_IMBALANCE) break;
+            // the biggest key of hi that reduces the imbalance
+            ssize_t best = -1;
+            for(size_t i=0;i<top.size();++i) {
+                if (owner_of(top[i].key) != hi) continue;
+                if (top[i].count >= load[hi]-load[lo]) continue;
+                if (best < 0 || top[i].count > top[best].count) best = (ssize_t)i;
+            }
+            if (best < 0) break;
+            const uint64_t k = top[best].key;
+            set_owner(k, lo, true);
+            load[hi] -= top[best].count;
+            load[lo] += top[best].count;
+            moves.push_back(move_t{k, hi, lo});
+        }
+        {
+            std::lock_guard<std::mutex> lk(mtx);
+            hotkeys.swap(hot);
+            nmoves += moves.size();
+        }
+        std::fill(load.begin(), load.end(), 0);
+        top.clear(); topidx.clear();
+        ntasks = 0;
+        return moves;
+    }
+
+    // the active workers become [0,n), the keys are moved by route when
+    // they are seen (see above)
+    void resize(size_t n) {
+        if (n == 0 || n == nactive || n > load.size()) return;
+        build(ring, n);
+        nactive = n;
+    }
+
+    // worker that has the state of \p k
+    size_t owner_of(uint64_t k) const {
+        std::unordered_map<uint64_t,uint32_t>::const_iterator it = owner.find(k);
+        return (it != owner.end()) ? (it->second & ~PINNED) : ring_owner(base, k);
+    }
+    size_t nactive_workers() const { return nactive; }
+
+    // statistics
+    std::vector<std::pair<uint64_t,unsigned long> > hot_keys() const {
+        std::lock_guard<std::mutex> lk(mtx);
+        return hotkeys;
+    }
+    // keys moved, by rebalance and after the active workers have changed
+    unsigned long moves() const {
+        std::lock_guard<std::mutex> lk(mtx);
+        return nmoves;
+    }
+    unsigned long resize_moves() const {
+        std::lock_guard<std::mutex> lk(mtx);
+        return nrszmoves;
+    }
+    // keys whose owner is not the one of the base ring
+    size_t nkeys() const { return nkeys_.load(std::memory_order_relaxed); }
+
+    static inline uint64_t mix(uint64_t x) {   // splitmix64 finalizer
+        x += 0x9E3779B97F4A7C15ULL;
+        x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+        return x ^ (x >> 31);
+    }
+
+protected:
+    typedef std::vector<std::pair<uint64_t,uint32_t> > ring_t;
+
+    void build(ring_t& r, size_t n) {
+        r.clear();
+        for(size_t w=0; w<n; ++w)
+            for(size_t v=0; v<vnodes; ++v)
+                r.push_back(std::make_pair(mix((w << 20) ^ v ^ 0x5bd1e995ULL), (uint32_t)w));
+        std::sort(r.begin(), r.end());
+    }
+    inline size_t ring_owner(const ring_t& r, uint64_t k) const {
+        const std::pair<uint64_t,uint32_t> p(mix(k), 0);
+        ring_t::const_iterator it = std::lower_bound(r.begin(), r.end(), p);
+        if (it == r.end()) it = r.begin();
+        return it->second;
+    }
+
+    // the key \p k is (or is going) in worker \p w, it is kept in the map
+    // only if route would not find it there, \p pin for the keys moved by
+    // rebalance
+    void set_owner(uint64_t k, size_t w, bool pin) {
+        const size_t r = ring_owner(ring, k);
+        if (w == r && r == ring_owner(base, k)) owner.erase(k);
+        else if (w == r || !pin) owner[k] = (uint32_t)w;
+        else {
+            std::unordered_map<uint64_t,uint32_t>::iterator it = owner.find(k);
+            if (it == owner.end() || !(it->second & PINNED)) pinned.push_back(k);
+            owner[k] = (uint32_t)w | PINNED;
+        }
+        nkeys_.store(owner.size(), std::memory_order_relaxed);
+    }
+
+    // the keys moved by rebalance that are no longer among the most
+    // frequent ones go back to their owner in the ring. The keys of a
+    // worker no longer active are moved by route when they are seen.
+    void expire(std::vector<move_t>& moves) {
+        size_t j = 0;
+        for(size_t i=0;i<pinned.size();++i) {
+            const uint64_t k = pinned[i];
+            std::unordered_map<uint64_t,uint32_t>::iterator it = owner.find(k);
+            if (it == owner.end() || !(it->second & PINNED)) continue;
+            const size_t w = it->second & ~PINNED;
+            if (w < nactive && topidx.count(k)) { pinned[j++] = k; continue; }
+            if (w >= nactive) { it->second = (uint32_t)w; continue; }
+            const size_t r = ring_owner(ring, k);
+            set_owner(k, r, false);
+            if (r != w) moves.push_back(move_t{k, w, r});
+        }
+        pinned.resize(j);
+    }
+
+    // space-saving counters of the most frequent keys of the window
+    inline void count(uint64_t k) {
+        std::unordered_map<uint64_t,uint32_t>::iterator it = topidx.find(k);
+        if (it != topidx.end()) { ++top[it->second].count; return; }
+        if (top.size() < FF_KP_TOPK) {
+            topidx.emplace(k, (uint32_t)top.size());
+            top.push_back(counter_t{k, 1});
+            return;
+        }
+        size_t m = 0;
+        for(size_t i=1;i<top.size();++i)
+            if (top[i].count < top[m].count) m = i;
+        topidx.erase(top[m].key);
+        topidx.emplace(k, (uint32_t)m);
+        top[m].key = k;
+        ++top[m].count;
+    }
+
+protected:
+    std::function<uint64_t(void*)>                  keyf;
+    const size_t                                    vnodes;
+    size_t                                          nactive = 0;
+    ring_t                                          base;     // all the workers
+    ring_t                                          ring;     // the active workers
+    std::unordered_map<uint64_t,uint32_t>           owner;    // keys moved (worker|PINNED)
+    std::vector<uint64_t>                           pinned;   // keys PINNED in owner
+    std::vector<unsigned long>                      load;     // tasks per worker in the window
+    std::vector<counter_t>                          top;
+    std::unordered_map<uint64_t,uint32_t>           topidx;
+    unsigned long                                   ntasks = 0;
+    mutable std::mutex                              mtx;
+    std::vector<std::pair<uint64_t,unsigned long> > hotkeys;
+    unsigned long                                   nmoves = 0;
+    unsigned long                                   nrszmoves = 0;
+    std::atomic<size_t>                             nkeys_{0};
+};
+
+} // namespace ff
+
+#endif /* FF_KPARTITION_HPP */
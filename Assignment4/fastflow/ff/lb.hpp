@@ -37,9 +37,11 @@
 
 #include <iosfwd>
 #include <deque>
+#include <vector>
 
 #include <ff/utils.hpp>
 #include <ff/node.hpp>
+#include <ff/envelope.hpp>
 
 namespace ff {
 
@@ -79,21 +81,254 @@ public:
     enum {TICKS2WAIT=1000};
 protected:
 
-    inline void put_done(int id) {
+    inline void put_done(int id, bool empty=true) {
         // here we access the cond variable of the worker, that must be initialized
-        pthread_cond_signal(&workers[id]->get_cons_c());
+        ff_park_notify(&workers[id]->get_cons_c(), empty);
     }
     
+    inline void task_sent(size_t id, void* task) {
+        if (lbfeedback.size() && task < FF_TAG_MIN) lbfeedback[id].add_sent();
+    }
+
+    // each worker gets its entry of lbfeedback, the workers must be
+    // standard nodes
+    int init_feedback(bool timed) {
+        for(size_t i=0;i<workers.size();++i)
+            if (workers[i]->isFarm() || workers[i]->isPipe() || workers[i]->isAll2All() ||
+                workers[i]->isComp()) return -1;
+        if (lbfeedback.size() != workers.size()) {
+            std::vector<ff_lb_feedback> f(workers.size());
+            lbfeedback.swap(f);
+        }
+        for(size_t i=0;i<workers.size();++i) {
+            if (timed) lbfeedback[i].timed = true;
+            workers[i]->lbfeedback = &lbfeedback[i];
+        }
+        return 0;
+    }
+
+    // the Emitter applies the number of active workers set by the elastic
+    // manager: the workers removed go to sleep after their pending tasks
+    inline void elastic_apply() {
+        const ssize_t t = elastic_target.load(std::memory_order_relaxed);
+        if (t < 1 || t == running) return;
+        if (elastic_full < 0) elastic_full = running;
+        if (t < running) {
+            // the keys are moved from the sleeping workers when they are
+            // seen again (see key_move)
+            if (kpart) kpart->resize((size_t)t);
+            for(ssize_t i=t;i<running;++i) {
+                workers[i]->freeze();
+                ff_send_out_to(FF_GO_OUT, (int)i);
+            }
+        } else {
+            for(ssize_t i=running;i<t;++i) workers[i]->thaw(false);
+            if (kpart) kpart->resize((size_t)t);
+        }
+        running = t;
+        elastic_active.store((size_t)t, std::memory_order_relaxed);
+    }
+    // the keys change owner: the old owner gives away the state of the key
+    // after its pending tasks, the new one takes it before the new tasks
+    inline void key_moves(const std::vector<ff_key_partitioner::move_t>& m) {
+        for(size_t i=0;i<m.size();++i) {
+            ff_key_ctlq::post_move(keyctl[m[i].from], keyctl[m[i].to], m[i].key);
+            ff_send_out_to(FF_KEY_CTL, (int)m[i].from);
+            ff_send_out_to(FF_KEY_CTL, (int)m[i].to);
+        }
+    }
+
+    // key moved from worker \p from (active or not) to the active worker \p to
+    inline void key_move(uint64_t key, size_t from, size_t to) {
+        if ((ssize_t)from < running) {
+            const ff_key_partitioner::move_t m = {key, from, to};
+            key_moves(std::vector<ff_key_partitioner::move_t>(1, m));
+            return;
+        }
+        // the old owner goes (or has gone) to sleep after its pending
+        // tasks, then the Emitter takes the state from it
+        workers[from]->wait_freezing();
+        ff_keyed_state* const ks = workers[from]->keystate;
+        void* const state = ks ? ks->extract_key_state(key) : nullptr;
+        if (!state) return;
+        ff_key_ctlq::post_install(keyctl[to], key, state);
+        ff_send_out_to(FF_KEY_CTL, (int)to);
+    }
+
+    inline bool schedule_task_bykey(void * task, unsigned long retry, unsigned long ticks) {
+        const uint64_t k = kpart->key(task);
+        size_t from;
+        const size_t id = kpart->route(k, from);
+        if (from != id) key_move(k, from, id);
+        if (!ff_send_out_to(task, (int)id, retry, ticks)) return false;
+        nextw = id;
+        if (kpart->window_done()) key_moves(kpart->rebalance());
+        return true;
+    }
+
+    // batch-aware farm (see batch.hpp) ------------------------------------
+
+    inline ff_bundle* new_bundle() {
+        ff_bundle* b = batch->get();
+        if (!b) {
+            error("LB, not enough memory for the bundles\n");
+            return nullptr;
+        }
+        b->t0 = getticks();
+        return b;
+    }
+    inline bool bundle_expired(const ff_bundle* b, const ticks now) const {
+        return (now - b->t0) > batch->flush_ticks();
+    }
+    inline bool bundle_expired(const ff_bundle* b) const {
+        return bundle_expired(b, getticks());
+    }
+    // the bundle has been sent to worker \p id, task_sent has counted one task
+    inline void bundle_sent(size_t id, const ff_bundle* b, size_t n) {
+        batch->sent(b);
+        if (lbfeedback.size()) lbfeedback[id].add_sent(n-1);
+    }
+
+    // the bundle filled by schedule_task goes to the worker chosen by the policy
+    inline bool send_bundle(unsigned long retry, unsigned long ticks) {
+        ff_bundle* const b = bpending;
+        const size_t n = b->n;
+        if (!schedule_task_one(b, retry, ticks)) return false;
+        bundle_sent(nextw, b, n);
+        bpending = nullptr;
+        return true;
+    }
+    inline bool send_bundle_to(size_t id, unsigned long retry, unsigned long ticks) {
+        ff_bundle* const b = bto[id];
+        const size_t n = b->n;
+        if (!ff_send_out_to_one(b, (int)id, retry, ticks)) return false;
+        bundle_sent(id, b, n);
+        bto[id] = nullptr;
+        --nbto;
+        return true;
+    }
+
+    inline bool schedule_task_batch(void * task, unsigned long retry, unsigned long ticks) {
+        // the bundle is full and it could not be sent the last time
+        if (bpending && bpending->n == batch->size() && !send_bundle(retry, ticks)) return false;
+        batch_expire(retry, ticks);
+        if (!bpending && !(bpending = new_bundle())) return false;
+        bpending->task[bpending->n++] = task;
+        if (bpending->n == batch->size()) send_bundle(retry, ticks);
+        return true;
+    }
+    inline bool ff_send_out_to_batch(void * task, int id, unsigned long retry, unsigned long ticks) {
+        ff_bundle*& b = bto[id];
+        if (b && b->n == batch->size() && !send_bundle_to(id, retry, ticks)) return false;
+        batch_expire(retry, ticks);
+        if (!b) {
+            if (!(b = new_bundle())) return false;
+            ++nbto;
+        }
+        b->task[b->n++] = task;
+        if (b->n == batch->size()) send_bundle_to(id, retry, ticks);
+        return true;
+    }
+
+    // all the bundles older than the flush period are sent, it is called
+    // before adding each task so that a bundle does not wait for the next
+    // task going to the same worker (e.g. a source Emitter sending to one
+    // worker at a time)
+    inline void batch_expire(unsigned long retry, unsigned long ticks) {
+        const auto now = getticks();
+        if (bpending && bundle_expired(bpending, now)) send_bundle(retry, ticks);
+        for(size_t i=0;nbto && i<bto.size();++i)
+            if (bto[i] && bundle_expired(bto[i], now)) send_bundle_to(i, retry, ticks);
+    }
+
+    // it sends all the bundles not yet sent
+    inline bool batch_flush(unsigned long retry=((unsigned long)-1),
+                            unsigned long ticks=TICKS2WAIT) {
+        if (bpending && !send_bundle(retry, ticks)) return false;
+        for(size_t i=0;nbto && i<bto.size();++i)
+            if (bto[i] && !send_bundle_to(i, retry, ticks)) return false;
+        return true;
+    }
+
+    // the Emitter is waiting for its input: the old bundles are sent, all of
+    // them if the Emitter is going to sleep
+    inline void batch_idle() {
+        if (blocking_in) batch_flush();
+        else batch_expire(((unsigned long)-1), TICKS2WAIT);
+    }
+
+    // all the workers are woken up, e.g. to receive the EOS
+    inline void elastic_resume() {
+        if (elastic_full < 0) return;
+        for(ssize_t i=running;i<elastic_full;++i) workers[i]->thaw(false);
+        running = elastic_full;
+        elastic_full = -1;
+        elastic_target.store(-1, std::memory_order_relaxed);
+        elastic_active.store((size_t)running, std::memory_order_relaxed);
+    }
+
+    // the worker that would complete a new task first, see FF_SCHED_COST
+    inline size_t selectworker_cost() {
+        const size_t n = (size_t)running;
+        uint64_t fastest = 0;
+        for(size_t i=0;i<n;++i) {
+            const uint64_t e = lbfeedback[i].ewma.load(std::memory_order_relaxed);
+            if (e && (!fastest || e < fastest)) fastest = e;
+        }
+        if (!fastest) fastest = 1;
+        const size_t first = (size_t)(nextw+1) % n;
+        size_t best = first;
+        double bc   = -1.0;
+        for(size_t k=0; k<n; ++k) {
+            const size_t i = (first+k) % n;
+            const uint64_t e = lbfeedback[i].ewma.load(std::memory_order_relaxed);
+            const double   c = (double)(lbfeedback[i].outstanding()+1) * (double)(e ? e : fastest);
+            if (bc < 0 || c < bc) { best = i; bc = c; }
+        }
+        return best;
+    }
+
+    // load of worker id as seen by the current policy
+    inline size_t worker_load(size_t id) const {
+        if (schedpolicy == FF_SCHED_LOW) return lbfeedback[id].outstanding();
+        return get_queue_length(id);
+    }
+
+    inline size_t selectworker_load() {
+        const size_t n = (size_t)running;
+        if (n < 2) return 0;
+        if (schedpolicy == FF_SCHED_COST) return selectworker_cost();
+        if (schedpolicy == FF_SCHED_P2C) {
+            // xorshift64
+            rnd ^= rnd << 13; rnd ^= rnd >> 7; rnd ^= rnd << 17;
+            const size_t a = (size_t)(rnd % n);
+            size_t b = (size_t)((rnd >> 32) % (n-1));
+            if (b >= a) ++b;
+            return (worker_load(b) < worker_load(a)) ? b : a;
+        }
+        // JSQ and LOW: the first minimum starting after the last worker
+        // selected, so that ties are broken round-robin
+        const size_t first = (size_t)(nextw+1) % n;
+        size_t best = first;
+        size_t bl   = worker_load(best);
+        for(size_t k=1; k<n && bl>0; ++k) {
+            const size_t i = (first+k) % n;
+            const size_t l = worker_load(i);
+            if (l < bl) { best = i; bl = l; }
+        }
+        return best;
+    }
+
     inline bool init_input_blocking(pthread_mutex_t   *&m,
                                     pthread_cond_t    *&c,
                                     bool /*feedback*/=true) {
         if (cons_m == nullptr) {
             assert(cons_c == nullptr);
             cons_m = (pthread_mutex_t*)malloc(sizeof(pthread_mutex_t));
-            cons_c = (pthread_cond_t*)malloc(sizeof(pthread_cond_t));
+            cons_c = ff_parking_create();
             assert(cons_m); assert(cons_c);
+            if (!cons_c) return false;
             if (pthread_mutex_init(cons_m, NULL) != 0) return false;
-            if (pthread_cond_init(cons_c, NULL) != 0)  return false;
         } 
         m = cons_m,  c = cons_c;
         return true;
@@ -136,6 +371,7 @@ protected:
         //register int cnt=0;
 
         if (!task) task = FF_EOS;
+        if (elastic) elastic_resume();
         broadcast_task(task);
         if (feedbackid > 0) {
             for(size_t i=feedbackid; i<workers.size();++i)
@@ -158,7 +394,10 @@ protected:
      *
      * \return The number of worker to be selected.
      */
-    virtual inline size_t selectworker() { return (++nextw % running); }
+    virtual inline size_t selectworker() {
+        if (schedpolicy == FF_SCHED_RR) return (++nextw % running);
+        return selectworker_load();
+    }
 
 #if defined(LB_CALLBACK)
 
@@ -201,12 +440,7 @@ protected:
      */
     virtual inline void losetime_out(unsigned long ticks=TICKS2WAIT) {
         FFTRACE(lostpushticks+=ticks; ++pushwait);
-#if defined(SPIN_USE_PAUSE)
-        const long n = (long)ticks/2000;
-        for(int i=0;i<=n;++i) PAUSE();
-#else
-        ticks_wait(ticks);
-#endif /* SPIN_USE_PAUSE */
+        backoff_out.wait(ticks);
     }
 
     /**
@@ -216,12 +450,7 @@ protected:
      */
     virtual inline void losetime_in(unsigned long ticks=TICKS2WAIT) {
         FFTRACE(lostpopticks+=ticks; ++popwait);
-#if defined(SPIN_USE_PAUSE)
-        const long n = (long)ticks/2000;
-        for(int i=0;i<=n;++i) PAUSE();
-#else
-        ticks_wait(ticks);
-#endif /* SPIN_USE_PAUSE */
+        backoff_in.wait(ticks);
     }
 
     /** 
@@ -240,7 +469,18 @@ protected:
     virtual inline bool schedule_task(void * task, 
                                       unsigned long retry=((unsigned long)-1), 
                                       unsigned long ticks=TICKS2WAIT) {
+        if (batch) {
+            if (task < FF_TAG_MIN) return schedule_task_batch(task, retry, ticks);
+            if (!batch_flush(retry, ticks)) return false;
+        }
+        return schedule_task_one(task, retry, ticks);
+    }
+
+    // it sends \p task to the worker chosen by the scheduling policy
+    inline bool schedule_task_one(void * task, unsigned long retry, unsigned long ticks) {
         unsigned long cnt;
+        if (elastic) elastic_apply();
+        if (kpart) return schedule_task_bykey(task, retry, ticks);
         if (blocking_out) {
             unsigned long r = 0;
             do {
@@ -254,7 +494,8 @@ protected:
                     bool empty=workers[nextw]->get_in_buffer()->empty();
                     if(workers[nextw]->put(task)) {
                         FFTRACE(++taskcnt);
-                        if (empty) put_done(nextw);
+                        task_sent(nextw, task);
+                        put_done(nextw, empty);
                         return true;
                     } 
                     ++cnt;
@@ -281,6 +522,7 @@ protected:
 #endif
                 if(workers[nextw]->put(task)) {
                     FFTRACE(++taskcnt);
+                    task_sent(nextw, task);
                     return true;
                 }
                 ++cnt;
@@ -306,6 +548,12 @@ protected:
     virtual std::deque<ff_node *>::iterator  collect_task(void ** task, 
                                                            std::deque<ff_node *> & availworkers,
                                                            std::deque<ff_node *>::iterator & start) {
+        // NOTE: the feedback channels are polled, there is no doorbell
+        //       (see doorbell.hpp): their producers are the workers, the
+        //       Emitter's input node and the nodes of a multi-input Emitter,
+        //       a channel's position in availworkers changes when a worker
+        //       terminates, and with no task the Emitter also polls its own
+        //       input channel, so all of them would have to be probed anyway.
         int cnt, nw= (int)(availworkers.end()-availworkers.begin());
         const std::deque<ff_node *>::iterator & ite(availworkers.end());
         do {
@@ -350,12 +598,9 @@ protected:
                     }
                 }
             } while(1);
+            if (batch) batch_idle();
             if (blocking_in) {
-                struct timespec tv;
-                timedwait_timeout(tv);
-                pthread_mutex_lock(cons_m);
-                pthread_cond_timedwait(cons_c, cons_m, &tv);
-                pthread_mutex_unlock(cons_m);
+                ff_park_wait(cons_m, cons_c);
             } else losetime_in();
         } while(1);
         return ite;
@@ -375,20 +620,16 @@ protected:
         if (blocking_in) {
             if (!filter) {
                 while (! buffer->pop(task)) {
-                    struct timespec tv;
-                    timedwait_timeout(tv);
-                    pthread_mutex_lock(cons_m);
-                    pthread_cond_timedwait(cons_c, cons_m, &tv);
-                    pthread_mutex_unlock(cons_m);
+                    if (batch) batch_idle();
+                    ff_park_wait(cons_m, cons_c,
+                                 [this]() { return !buffer->empty(); },
+                                 FF_PARK_TIMEOUT_NS);
                 } // while
             } else  {                
                 if (cons_m) {                
                     while (! filter->pop(task)) {
-                        struct timespec tv;
-                        timedwait_timeout(tv);
-                        pthread_mutex_lock(cons_m);
-                        pthread_cond_timedwait(cons_c, cons_m, &tv);
-                        pthread_mutex_unlock(cons_m);
+                        if (batch) batch_idle();
+                        ff_park_wait(cons_m, cons_c);
                     } //while 
                 } else {
                     // NOTE:
@@ -404,9 +645,9 @@ protected:
             return true;
         }
         if (!filter) 
-            while (! buffer->pop(task)) losetime_in();
+            while (! buffer->pop(task)) { if (batch) batch_idle(); losetime_in(); }
         else 
-            while (! filter->pop(task)) losetime_in();
+            while (! filter->pop(task)) { if (batch) batch_idle(); losetime_in(); }
         return true;
     }
     
@@ -528,16 +769,19 @@ public:
      *  It deallocates dynamic memory spaces previoulsy allocated for workers.
      */
     virtual ~ff_loadbalancer() {
+        if (stealgrp) delete stealgrp;
+        if (kpart) delete kpart;
+        if (keyctl) delete [] keyctl;
+        if (batch) delete batch;
+        if (cons_c && cons_m) {
+            ff_parking_destroy(cons_c);
+            cons_c = nullptr;
+        }
         if (cons_m) {
             pthread_mutex_destroy(cons_m);
             free(cons_m);
             cons_m = nullptr;
         }
-        if (cons_c && cons_m) {
-            pthread_cond_destroy(cons_c);
-            free(cons_c);
-            cons_c = nullptr;
-        }
         if (prod_m) {
             pthread_mutex_destroy(prod_m);
             free(prod_m);
@@ -599,6 +843,185 @@ public:
      * \return The buffer
      */
     FFBUFFER * get_in_buffer() const { return buffer;}
+
+    /**
+     * \brief Work-stealing among the workers
+     *
+     * The tasks sent to the workers go in the queues of a ff_steal_group
+     * (\p capacity entries each) instead of the workers' input channels, so
+     * that an idle worker can take the tasks queued to the others (see
+     * stealq.hpp). The workers must be standard nodes. It is called by the
+     * farm after the workers have been registered.
+     *
+     * \return 0 if successful, -1 otherwise
+     */
+    int set_stealing(ff_steal_t policy, size_t capacity) {
+        if (stealgrp || workers.size()==0) return -1;
+        for(size_t i=0;i<workers.size();++i)
+            if (workers[i]->isFarm() || workers[i]->isPipe() || workers[i]->isAll2All() ||
+                workers[i]->isComp() || workers[i]->isMultiInput()) return -1;
+        stealgrp = new ff_steal_group(workers.size(), policy);
+        if (!stealgrp->init(capacity)) {
+            delete stealgrp; stealgrp = nullptr;
+            return -1;
+        }
+        for(size_t i=0;i<workers.size();++i) {
+            workers[i]->stealgrp = stealgrp;
+            workers[i]->stealid  = i;
+        }
+        return 0;
+    }
+    const ff_steal_group* get_steal_group() const { return stealgrp; }
+
+    /**
+     * \brief Sets the scheduling policy of the tasks (see lbpolicy.hpp)
+     *
+     * The load-aware policies need the feedback of each worker, so the
+     * workers must be standard nodes. It is called by the farm after the
+     * workers have been registered.
+     *
+     * \return 0 if successful, -1 otherwise
+     */
+    int set_scheduling_policy(ff_sched_t policy) {
+        if (workers.size()==0) return -1;
+        if (policy != FF_SCHED_RR && init_feedback(policy == FF_SCHED_COST)<0) return -1;
+        schedpolicy = policy;
+        return 0;
+    }
+    ff_sched_t get_scheduling_policy() const { return schedpolicy; }
+
+    /**
+     * \brief Key partitioning of the tasks (see kpartition.hpp)
+     *
+     * All the tasks with the same key (given by \p key) go to the same
+     * worker, the keys are mapped onto the workers with consistent hashing
+     * (\p vnodes points per worker) and moved between the workers to even
+     * the load. The workers must be standard nodes, those implementing
+     * ff_keyed_state receive the state of the keys moved to them. It is
+     * called by the farm after the workers have been registered.
+     *
+     * \return 0 if successful, -1 otherwise
+     */
+    int set_scheduling_bykey(std::function<uint64_t(void*)> key, size_t vnodes) {
+        if (kpart || workers.size()==0 || !key) return -1;
+        for(size_t i=0;i<workers.size();++i)
+            if (workers[i]->isFarm() || workers[i]->isPipe() || workers[i]->isAll2All() ||
+                workers[i]->isComp() || workers[i]->isMultiInput()) return -1;
+        kpart  = new ff_key_partitioner(key, workers.size(), vnodes);
+        keyctl = new ff_key_ctlq[workers.size()];
+        for(size_t i=0;i<workers.size();++i) {
+            workers[i]->keyctl   = &keyctl[i];
+            workers[i]->keystate = dynamic_cast<ff_keyed_state*>(workers[i]);
+        }
+        return 0;
+    }
+    const ff_key_partitioner* get_key_partitioner() const { return kpart; }
+
+    /**
+     * \brief Batch-aware scheduling (see batch.hpp)
+     *
+     * The tasks are sent to the workers in bundles of up to \p size tasks,
+     * a bundle is sent when it is full or when its first task is older
+     * than \p flush ticks. The workers, that must be standard nodes, call
+     * svc on each task of the bundle.
+     *
+     * \return 0 if successful, -1 otherwise
+     */
+    int set_batching(size_t size, ticks flush) {
+        if (batch || workers.size()==0 || size==0) return -1;
+        for(size_t i=0;i<workers.size();++i)
+            if (workers[i]->isFarm() || workers[i]->isPipe() || workers[i]->isAll2All() ||
+                workers[i]->isComp() || workers[i]->isMultiInput()) return -1;
+        batch = new ff_batcher(workers.size(), size, flush);
+        if (!batch->init()) {
+            delete batch; batch = nullptr;
+            return -1;
+        }
+        bto.assign(workers.size(), nullptr);
+        for(size_t i=0;i<workers.size();++i) {
+            workers[i]->batch   = batch;
+            workers[i]->batchid = i;
+        }
+        return 0;
+    }
+    const ff_batcher* get_batcher() const { return batch; }
+
+    /**
+     * \brief Estimated service time (ticks) of worker \p id with the
+     * FF_SCHED_COST policy, 0 if it is not known.
+     */
+    double get_service_time(size_t id) const {
+        if (id >= lbfeedback.size()) return 0.0;
+        return (double)lbfeedback[id].ewma.load(std::memory_order_relaxed);
+    }
+    /**
+     * \brief Tasks completed by worker \p id with the FF_SCHED_LOW and
+     * FF_SCHED_COST policies and in the elastic farm.
+     */
+    unsigned long get_completed(size_t id) const {
+        if (id >= lbfeedback.size()) return 0;
+        return lbfeedback[id].done.load(std::memory_order_relaxed);
+    }
+    /**
+     * \brief Time (ticks) spent in svc by worker \p id when the workers
+     * are timed (FF_SCHED_COST and elastic farm).
+     */
+    uint64_t get_busy(size_t id) const {
+        if (id >= lbfeedback.size()) return 0;
+        return lbfeedback[id].busy.load(std::memory_order_relaxed);
+    }
+    /**
+     * \brief Tasks queued to worker \p id with the load-aware policies,
+     * work-stealing and in the elastic farm (0 otherwise). It can be
+     * called by any thread.
+     */
+    size_t get_queue_length(size_t id) const {
+        if (stealgrp) return stealgrp->length(id);
+        return (id < lbfeedback.size()) ? lbfeedback[id].queued() : 0;
+    }
+
+    /**
+     * \brief Enables the elastic farm (see elastic.hpp)
+     *
+     * The workers are timed and set_active_workers can change the number
+     * of active workers while the farm is running. The workers must be
+     * standard nodes. It is called by the farm after the workers have been
+     * registered.
+     *
+     * \return 0 if successful, -1 otherwise
+     */
+    int set_elastic() {
+        if (workers.size()==0 || init_feedback(true)<0) return -1;
+        elastic = true;
+        elastic_active.store(workers.size(), std::memory_order_release);
+        return 0;
+    }
+    bool get_elastic() const { return elastic; }
+
+    /**
+     * \brief Sets the number of active workers of an elastic farm, it can
+     * be called by any thread. The Emitter applies it when it schedules the
+     * next task: the workers [0,n) are active, the others sleep.
+     *
+     * \return 0 if successful, -1 if \p n is 0 or if the farm is not
+     * elastic or has not been prepared yet (the call has no effect)
+     */
+    int set_active_workers(size_t n) {
+        // elastic_active is set by set_elastic, elastic may not be visible
+        // to the calling thread
+        if (elastic_active.load(std::memory_order_acquire) == 0) {
+            error("LB, set_active_workers: the farm is not elastic or not yet prepared\n");
+            return -1;
+        }
+        if (n == 0) return -1;
+        if (n > workers.size()) n = workers.size();
+        elastic_target.store((ssize_t)n, std::memory_order_relaxed);
+        return 0;
+    }
+    /**
+     * \brief Number of active workers of an elastic farm.
+     */
+    size_t get_active_workers() const { return elastic_active.load(std::memory_order_relaxed); }
     
     /**
      *
@@ -645,6 +1068,13 @@ public:
      */
     inline size_t getnworkers() const { return (size_t)running;} 
 
+    /**
+     * \brief Statistics of the waits on the input (output) channel(s),
+     * they can be read while the emitter is running (see backoff.hpp).
+     */
+    ff_backoff_stats get_backoff_in()  const { return backoff_in.stats(); }
+    ff_backoff_stats get_backoff_out() const { return backoff_out.stats(); }
+
     /**
      * \brief Get the number of workers
      *
@@ -736,13 +1166,23 @@ public:
     virtual inline bool ff_send_out_to(void *task, int id,  
                                unsigned long retry=((unsigned long)-1),
                                unsigned long ticks=(TICKS2WAIT)) {        
+        if (batch) {
+            if (task < FF_TAG_MIN) return ff_send_out_to_batch(task, id, retry, ticks);
+            if (!batch_flush(retry, ticks)) return false;
+        }
+        return ff_send_out_to_one(task, id, retry, ticks);
+    }
+
+    // it sends \p task to worker \p id
+    inline bool ff_send_out_to_one(void *task, int id, unsigned long retry, unsigned long ticks) {
         if (blocking_out) {
             unsigned long r=0;
         _retry:
             bool empty=workers[id]->get_in_buffer()->empty();
             if (workers[id]->put(task)) {
                 FFTRACE(++taskcnt);
-                if (empty) put_done(id);
+                task_sent(id, task);
+                put_done(id, empty);
             } else {
                 if (++r >= retry) return false;
                 struct timespec tv;
@@ -760,6 +1200,7 @@ public:
         for(unsigned long i=0;i<retry;++i) {
             if (workers[id]->put(task)) {
                 FFTRACE(++taskcnt);
+                task_sent(id, task);
 #if defined(FF_TASK_CALLBACK)
                 callbackOut(this);
 #endif
@@ -770,24 +1211,55 @@ public:
         return false;
     }
 
+    /**
+     * \brief Send the same envelope to all workers (see envelope.hpp)
+     *
+     * The envelope counts the workers it is sent to, the last one that
+     * releases it deletes the payload.
+     */
+    inline void broadcast_shared(ff_envelope_base * e) {
+        if (running <= 0) { e->release(); return; }
+        e->set_consumers(running);
+        broadcast_task(e);
+    }
+
     /** 
      * \brief Send the same task to all workers 
      *
      * It sends the same task to all workers.   
      */
     virtual inline void broadcast_task(void * task) {
+       if (batch) {
+           batch_flush();
+           if (task < FF_TAG_MIN) {   // each worker gets a bundle
+               for(ssize_t i=0;i<running;++i) {
+                   ff_bundle* const b = new_bundle();
+                   if (!b) return;
+                   b->task[b->n++] = task;
+                   ff_send_out_to_one(b, (int)i, ((unsigned long)-1), TICKS2WAIT);
+                   bundle_sent(i, b, 1);
+               }
+               return;
+           }
+       }
+       // with work-stealing each copy is pinned to its worker, a thief
+       // would take a second copy (see ff_steal_group::push)
+       auto put = [this, task](size_t i) {
+           if (stealgrp && task < FF_TAG_MIN) return stealgrp->push(i, task, true);
+           return workers[i]->put(task);
+       };
        std::vector<size_t> retry;
        if (blocking_out) {
            for(ssize_t i=0;i<running;++i) {
                bool empty=workers[i]->get_in_buffer()->empty();
-               if(!workers[i]->put(task))
+               if(!put(i))
                    retry.push_back(i);
-               else if (empty) put_done(i);
+               else put_done(i, empty);
            }
            while(retry.size()) {
                bool empty=workers[retry.back()]->get_in_buffer()->empty();
-               if(workers[retry.back()]->put(task)) {
-                   if (empty) put_done(retry.back());
+               if(put(retry.back())) {
+                   put_done(retry.back(), empty);
                    retry.pop_back();
                } else {
                    struct timespec tv;
@@ -803,11 +1275,11 @@ public:
            return;
        }
        for(ssize_t i=0;i<running;++i) {
-           if(!workers[i]->put(task))
+           if(!put(i))
                retry.push_back(i);
        }
        while(retry.size()) {
-           if(workers[retry.back()]->put(task))
+           if(put(retry.back()))
                retry.pop_back();
            else losetime_out();
        }       
@@ -843,11 +1315,7 @@ public:
             }
             else {
                 if (blocking_in) {
-                    struct timespec tv;
-                    timedwait_timeout(tv);
-                    pthread_mutex_lock(cons_m);
-                    pthread_cond_timedwait(cons_c, cons_m, &tv);
-                    pthread_mutex_unlock(cons_m);
+                    ff_park_wait(cons_m, cons_c);
                 } else losetime_in();
             }
         }
@@ -944,11 +1412,14 @@ public:
 
                 if (filter) {
                     FFTRACE(ticks t0 = getticks());
+                    ff_node_prof* const prof = filter->prof;
+                    const ticks p0 = prof ? getticks() : 0;
 
 #if defined(FF_TASK_CALLBACK)
                     callbackIn(this);
 #endif
                     task = filter->svc(task);
+                    if (prof) prof->svcdone(getticks()-p0, task);
 
                     
 #if defined(TRACE_FASTFLOW)
@@ -1062,11 +1533,14 @@ public:
                 } else {
                     if (filter) {
                         FFTRACE(ticks t0 = getticks());
+                        ff_node_prof* const prof = filter->prof;
+                        const ticks p0 = prof ? getticks() : 0;
 
 #if defined(FF_TASK_CALLBACK)
                         callbackIn(this);
 #endif   
                         task = filter->svc(task);
+                        if (prof) prof->svcdone(getticks()-p0, task);
 
 #if defined(TRACE_FASTFLOW)
                         ticks diff=(getticks()-t0);
@@ -1102,6 +1576,7 @@ public:
                 }
             } while(1);
         }
+        if (batch) batch_flush();
         gettimeofday(&wtstop,NULL);
         wttime+=diffmsec(wtstop,wtstart);
 
@@ -1125,6 +1600,16 @@ public:
             if (filter) filter->setCPUId(cpuId);
         }
 #endif        
+#if defined(FF_RING_NUMA)
+        {   // the rings of the input channels go to the NUMA node of the emitter
+            const int node = ff_my_numanode();
+            ff_place_ring(buffer, node);
+            for(size_t i=0;i<multi_input.size();++i)
+                ff_place_ring(multi_input[i]->get_out_buffer(), node);
+            for(size_t i=0;i<inputNodesFeedback.size();++i)
+                ff_place_ring(inputNodesFeedback[i]->get_out_buffer(), node);
+        }
+#endif
         gettimeofday(&tstart,NULL);
         if (filter) {
             if (filter->svc_init() <0) return -1;
@@ -1506,6 +1991,35 @@ private:
     bool               blocking_in;
     bool               blocking_out;
 
+    // adaptive backoff of the input and output channel(s)
+    ff_backoff         backoff_in;
+    ff_backoff         backoff_out;
+
+    // queues of the workers with work-stealing (see set_stealing)
+    ff_steal_group    *stealgrp = nullptr;
+
+    // scheduling policy of the tasks and the workers' counters (see lbpolicy.hpp)
+    ff_sched_t                  schedpolicy = FF_SCHED_RR;
+    std::vector<ff_lb_feedback> lbfeedback;
+    uint64_t                    rnd = 0x9E3779B97F4A7C15ULL;
+
+    // key partitioning (see set_scheduling_bykey)
+    ff_key_partitioner         *kpart  = nullptr;
+    ff_key_ctlq                *keyctl = nullptr;
+
+    // batch-aware farm (see set_batching): the bundle filled by
+    // schedule_task, those filled by ff_send_out_to (nbto not empty)
+    ff_batcher                 *batch    = nullptr;
+    ff_bundle                  *bpending = nullptr;
+    std::vector<ff_bundle*>     bto;
+    size_t                      nbto     = 0;
+
+    // elastic farm (see set_elastic)
+    bool                        elastic = false;
+    std::atomic<ssize_t>        elastic_target{-1};
+    std::atomic<size_t>         elastic_active{0};
+    ssize_t                     elastic_full = -1;   // workers before the first change
+
 #ifdef DFF_ENABLED
     bool               _skipallpop = false;    
 #endif
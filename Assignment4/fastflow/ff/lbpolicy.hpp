@@ -0,0 +1,125 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*!
+ *  \file lbpolicy.hpp
+ *  \ingroup building_blocks
+ *
+ *  \brief Load-aware scheduling policies of the farm's Emitter.
+ */
+
+/* ***************************************************************************
+ *
+ *  FastFlow is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License version 3 as
+ *  published by the Free Software Foundation.
+ *  Starting from version 3.0.1 FastFlow is dual licensed under the GNU LGPLv3
+ *  or MIT License (https://github.com/ParaGroup/WindFlow/blob/vers3.x/LICENSE.MIT)
+ *
+ *  This program is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ ****************************************************************************
+ */
+
+/*
+ * By default the Emitter of a farm sends the tasks round-robin (FF_SCHED_RR)
+ * and, if the selected channel is full, it tries the next one. The other
+ * policies (see ff_farm::set_scheduling_policy) look at the load of the
+ * workers when a task is sent:
+ *
+ *  - FF_SCHED_JSQ (join-shortest-queue): the worker with the fewest tasks
+ *    queued, i.e. sent and not yet started, ties are broken round-robin.
+ *    It scans all the workers at each task, fine for farms of tens of
+ *    workers.
+ *  - FF_SCHED_P2C (power of two choices): the less loaded of two workers
+ *    taken at random, almost as good as JSQ and the cost does not depend
+ *    on the number of workers.
+ *  - FF_SCHED_LOW (least outstanding work): the worker with the fewest
+ *    tasks sent and not yet completed, i.e. queued plus the one in svc.
+ *    Each worker counts the tasks it has completed in its ff_lb_feedback
+ *    entry, so a worker stuck in a long svc is not chosen even if its
+ *    channel is empty.
+ *  - FF_SCHED_COST (cost-aware): each worker also keeps an exponentially
+ *    weighted moving average of its svc times (in ticks, the weight of the
+ *    last sample is 1/2^FF_LB_EWMA_SHIFT), the task goes to the worker that
+ *    would complete it first, i.e. with the smallest (outstanding+1)*ewma.
+ *    In steady state the workers receive tasks in proportion to their
+ *    speed, e.g. on cores with different clocks or on SMT siblings. A
+ *    worker without samples yet is assumed as fast as the fastest one.
+ *    The estimates can be read with ff_farm::getWorkerServiceTime.
+ *
+ * The loads come from counters kept in an ff_lb_feedback entry per worker,
+ * the Emitter does not read the workers' channels (their internal buffers
+ * belong to the Emitter and to the worker only). The channels keep their
+ * capacity, unlike the on-demand scheduling that shrinks them to a few
+ * slots to get a similar effect.
+ */
+
+#ifndef FF_LBPOLICY_HPP
+#define FF_LBPOLICY_HPP
+
+#include <cstdint>
+#include <atomic>
+#include <ff/config.hpp>
+
+namespace ff {
+
+enum ff_sched_t { FF_SCHED_RR=0, FF_SCHED_JSQ, FF_SCHED_P2C, FF_SCHED_LOW, FF_SCHED_COST };
+
+/*
+ * Per worker counters of the load-aware policies, owned by the load
+ * balancer. 'sent' is written by the Emitter only, the other fields by the
+ * worker only, on another cache line. They are also used by the elastic
+ * farm (see elastic.hpp), whose thread reads them.
+ */
+struct ff_lb_feedback {
+    std::atomic<unsigned long> sent{0};
+    char padding1[CACHE_LINE_SIZE-sizeof(std::atomic<unsigned long>)];
+    std::atomic<unsigned long> started{0};
+    std::atomic<unsigned long> done{0};
+    std::atomic<uint64_t>      ewma{0};    // svc time estimate (ticks)
+    std::atomic<uint64_t>      busy{0};    // total svc time (ticks)
+    bool                       timed = false;
+    char padding2[CACHE_LINE_SIZE-2*sizeof(std::atomic<unsigned long>)-2*sizeof(std::atomic<uint64_t>)-sizeof(bool)];
+
+    // called by the Emitter, \p n tasks sent to the worker
+    inline void add_sent(unsigned long n=1) {
+        sent.store(sent.load(std::memory_order_relaxed)+n, std::memory_order_release);
+    }
+    // called by the worker before each svc
+    inline void start() {
+        started.store(started.load(std::memory_order_relaxed)+1, std::memory_order_release);
+    }
+
+    // called by the worker after each svc, \p t is the svc time if timed
+    inline void completed(uint64_t t=0) {
+        if (t) {
+            const int64_t e = (int64_t)ewma.load(std::memory_order_relaxed);
+            ewma.store(e ? (uint64_t)(e + ((int64_t)t - e) / (1<<FF_LB_EWMA_SHIFT)) : t,
+                       std::memory_order_relaxed);
+            busy.store(busy.load(std::memory_order_relaxed)+t, std::memory_order_relaxed);
+        }
+        done.store(done.load(std::memory_order_relaxed)+1, std::memory_order_release);
+    }
+    // tasks sent to the worker and not yet completed
+    inline unsigned long outstanding() const {
+        const unsigned long d = done.load(std::memory_order_acquire);
+        const unsigned long s = sent.load(std::memory_order_acquire);
+        return (s > d) ? s - d : 0;
+    }
+    // tasks sent to the worker and not yet started (i.e. queued)
+    inline unsigned long queued() const {
+        const unsigned long b = started.load(std::memory_order_acquire);
+        const unsigned long s = sent.load(std::memory_order_acquire);
+        return (s > b) ? s - b : 0;
+    }
+};
+
+} // namespace ff
+
+#endif /* FF_LBPOLICY_HPP */
@@ -0,0 +1,355 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+
+/*!
+ *  \file mpdynqueue.hpp
+ *  \ingroup building_blocks
+ *
+ *  \brief Lock-free unbounded Multi-Producer/Multi-Consumer list-based
+ *  queue with epoch-based memory reclamation.
+ */
+
+/* ***************************************************************************
+ *
+ *  FastFlow is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License version 3 as
+ *  published by the Free Software Foundation.
+ *  Starting from version 3.0.1 FastFlow is dual licensed under the GNU LGPLv3
+ *  or MIT License (https://github.com/ParaGroup/WindFlow/blob/vers3.x/LICENSE.MIT)
+ *
+ *  This program is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ ****************************************************************************
+ */
+
+/*
+ * mp_dynqueue has the same interface of dynqueue (see dynqueue.hpp), but its
+ * mp_push and mp_pop are lock-free: it is the Michael and Scott non-blocking
+ * queue instead of the 2-lock one. Any thread can push and pop.
+ *
+ * A popped node can still be read by the other consumers, so it is not
+ * re-used until it is safe (epoch-based reclamation, ff_ebr below):
+ *  - each thread using the queues has a record, while it is inside a push
+ *    or a pop the record is marked active with the current global epoch;
+ *  - a node popped when the global epoch is e is put in the thread's limbo
+ *    list of e (the thread may still be in e-1, the readers of the node may
+ *    be in e), the global epoch advances when all the active threads have
+ *    seen it, so the nodes popped in e can be re-used when the epoch is e+2;
+ *  - the re-usable nodes go in a thread-local freelist, push takes its
+ *    node from there. Since with many producers and one consumer the nodes
+ *    are all re-used by the consumer, the freelist above FF_EBR_FREELIST
+ *    nodes is moved, in batches of FF_EBR_BATCH nodes, to a global pool
+ *    where the threads with an empty freelist take them. The pool is
+ *    accessed with a try-lock once every FF_EBR_BATCH nodes, if it is busy
+ *    the nodes are allocated (or freed), so nobody waits for it.
+ * The nodes have all the same size, so the limbo lists, the freelists and
+ * the pool are shared by all the mp_dynqueue.
+ *
+ * The records of the terminated threads are re-used by new threads.
+ */
+
+#ifndef FF_MPDYNQUEUE_HPP
+#define FF_MPDYNQUEUE_HPP
+
+#include <cstdlib>
+#include <cassert>
+#include <atomic>
+#include <vector>
+#include <ff/config.hpp>
+#include <ff/sysdep.h>
+
+namespace ff {
+
+struct ff_ebr_node {
+    std::atomic<ff_ebr_node*> next;
+    void                    * data;
+};
+
+/*
+ * Epoch-based reclamation of ff_ebr_node, see above.
+ */
+class ff_ebr {
+    enum { ACTIVE = 1 };
+
+    struct list_t {
+        ff_ebr_node * head = nullptr;
+        size_t        n    = 0;
+        void push(ff_ebr_node* p) {
+            p->next.store(head, std::memory_order_relaxed);
+            head = p; ++n;
+        }
+        ff_ebr_node* pop() {
+            ff_ebr_node* p = head;
+            if (p) { head = p->next.load(std::memory_order_relaxed); --n; }
+            return p;
+        }
+        void append(list_t& l) {   // moves l into this list
+            while(l.head) push(l.pop());
+        }
+        void release() { ff_ebr_node* p; while((p=pop())) ::free(p); }
+    };
+
+public:
+    struct record_t {
+        std::atomic<unsigned long> state{0};    // (epoch<<1)|ACTIVE
+        std::atomic<bool>          inuse{true};
+        record_t                 * next = nullptr;
+        unsigned long              epoch = 0;   // last epoch seen
+        unsigned long              nested = 0;
+        unsigned long              retired = 0; // since the last try_advance
+        list_t                     limbo[3];
+        unsigned long              limbo_epoch[3] = {0,0,0};  // newest node
+        list_t                     freelist;
+    };
+
+private:
+    struct domain_t {
+        std::atomic<unsigned long> epoch{0};
+        std::atomic<record_t*>     records{nullptr};
+        std::atomic_flag           poollock = ATOMIC_FLAG_INIT;
+        std::vector<list_t>        pool;     // batches of free nodes
+        ~domain_t() {  // at exit, no thread uses the queues any more
+            for(size_t i=0;i<pool.size();++i) pool[i].release();
+            record_t* r = records.load();
+            while(r) {
+                record_t* n = r->next;
+                for(int i=0;i<3;++i) r->limbo[i].release();
+                r->freelist.release();
+                delete r;
+                r = n;
+            }
+        }
+    };
+    static domain_t& domain() { static domain_t d; return d; }
+
+    // a record is taken by a thread the first time it uses the queues
+    struct handle_t {
+        record_t* rec;
+        handle_t() {
+            domain_t& d = domain();
+            for(rec = d.records.load(std::memory_order_acquire); rec; rec = rec->next) {
+                bool f = false;
+                if (!rec->inuse.load(std::memory_order_relaxed) &&
+                    rec->inuse.compare_exchange_strong(f, true)) return;
+            }
+            rec = new record_t;
+            record_t* h = d.records.load(std::memory_order_relaxed);
+            do rec->next = h;
+            while(!d.records.compare_exchange_weak(h, rec, std::memory_order_release,
+                                                   std::memory_order_relaxed));
+        }
+        ~handle_t() {
+            // the limbo lists go with the record to the next owner
+            rec->freelist.release();
+            rec->state.store(0, std::memory_order_release);
+            rec->inuse.store(false, std::memory_order_release);
+        }
+    };
+
+    // the epoch advances if all the active threads have seen it
+    static void try_advance(record_t& self) {
+        domain_t& d = domain();
+        unsigned long e = d.epoch.load(std::memory_order_acquire);
+        for(record_t* r = d.records.load(std::memory_order_acquire); r; r = r->next) {
+            const unsigned long s = r->state.load(std::memory_order_acquire);
+            if ((s & ACTIVE) && (s>>1) != e) return;
+        }
+        d.epoch.compare_exchange_strong(e, e+1, std::memory_order_acq_rel);
+        self.retired = 0;
+    }
+
+    // the freelist above FF_EBR_FREELIST goes to the pool
+    static void give_back(record_t& r) {
+        domain_t& d = domain();
+        if (d.poollock.test_and_set(std::memory_order_acquire)) {
+            while(r.freelist.n > 2*FF_EBR_FREELIST) ::free(r.freelist.pop());
+            return;
+        }
+        while(r.freelist.n > FF_EBR_FREELIST && d.pool.size() < FF_EBR_POOL) {
+            list_t b;
+            while(b.n < FF_EBR_BATCH) b.push(r.freelist.pop());
+            d.pool.push_back(b);
+        }
+        d.poollock.clear(std::memory_order_release);
+        while(r.freelist.n > FF_EBR_FREELIST) ::free(r.freelist.pop());
+    }
+    static void take_batch(record_t& r) {
+        domain_t& d = domain();
+        if (d.poollock.test_and_set(std::memory_order_acquire)) return;
+        if (d.pool.size()) {
+            r.freelist.append(d.pool.back());
+            d.pool.pop_back();
+        }
+        d.poollock.clear(std::memory_order_release);
+    }
+
+public:
+    static record_t& self() {
+        static thread_local handle_t h;
+        return *h.rec;
+    }
+
+    static inline void enter(record_t& r) {
+        if (r.nested++) return;
+        const unsigned long e = domain().epoch.load(std::memory_order_acquire);
+        r.state.store((e<<1)|ACTIVE, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (e != r.epoch) {
+            // the nodes retired two epochs ago (or before) are safe
+            for(int i=0;i<3;++i)
+                if (r.limbo[i].n && r.limbo_epoch[i]+2 <= e)
+                    r.freelist.append(r.limbo[i]);
+            if (r.freelist.n > FF_EBR_FREELIST) give_back(r);
+            r.epoch = e;
+        }
+    }
+    static inline void exit(record_t& r) {
+        if (--r.nested) return;
+        r.state.store(0, std::memory_order_release);
+    }
+
+    static inline ff_ebr_node* alloc(record_t& r) {
+        if (!r.freelist.n) take_batch(r);
+        ff_ebr_node* p = r.freelist.pop();
+        if (!p) p = (ff_ebr_node*)::malloc(sizeof(ff_ebr_node));
+        return p;
+    }
+    // a node not yet visible to the other threads
+    static inline void free(record_t& r, ff_ebr_node* p) {
+        if (r.freelist.n < FF_EBR_FREELIST) r.freelist.push(p);
+        else ::free(p);
+    }
+    // it must be called inside enter/exit, the node is unlinked
+    static inline void retire(record_t& r, ff_ebr_node* p) {
+        // the global epoch, not r.epoch: it may have advanced since enter
+        // and a thread entered in the new epoch may be reading the node
+        const unsigned long e = domain().epoch.load(std::memory_order_acquire);
+        const int i = e%3;
+        r.limbo[i].push(p);
+        if (e > r.limbo_epoch[i]) r.limbo_epoch[i] = e;
+        if (++r.retired >= FF_EBR_RETIRE_THRESHOLD) try_advance(r);
+    }
+};
+
+/*!
+ * \class mp_dynqueue
+ *  \ingroup building_blocks
+ *
+ * \brief Lock-free unbounded MPMC queue of pointers (see above).
+ *
+ * This class is defined in \ref mpdynqueue.hpp
+ */
+class mp_dynqueue {
+    typedef ff_ebr_node Node;
+public:
+    enum {DEFAULT_CACHE_SIZE=1024};
+
+    // the arguments are there only for compatibility with dynqueue
+    mp_dynqueue(int =DEFAULT_CACHE_SIZE, bool =false) {
+        Node * n = (Node *)::malloc(sizeof(Node));
+        n->data = NULL; n->next.store(nullptr, std::memory_order_relaxed);
+        head.store(n, std::memory_order_relaxed);
+        tail.store(n, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+    }
+
+    bool init() { return true;}
+
+    // no other thread must be using the queue
+    ~mp_dynqueue() {
+        Node* n = head.load(std::memory_order_relaxed);
+        while(n) {
+            Node* next = n->next.load(std::memory_order_relaxed);
+            ::free(n);
+            n = next;
+        }
+    }
+
+    inline bool mp_push(void * const data) {
+        assert(data != NULL);
+        ff_ebr::record_t& r = ff_ebr::self();
+        ff_ebr::enter(r);
+        Node* n = ff_ebr::alloc(r);
+        if (!n) { ff_ebr::exit(r); return false; }
+        n->data = data;
+        n->next.store(nullptr, std::memory_order_relaxed);
+        for(;;) {
+            Node* t    = tail.load(std::memory_order_acquire);
+            Node* next = t->next.load(std::memory_order_acquire);
+            if (t != tail.load(std::memory_order_acquire)) continue;
+            if (next == nullptr) {
+                if (t->next.compare_exchange_weak(next, n, std::memory_order_release,
+                                                  std::memory_order_relaxed)) {
+                    tail.compare_exchange_strong(t, n, std::memory_order_release,
+                                                 std::memory_order_relaxed);
+                    break;
+                }
+            } else   // tail is behind, helps the other producer
+                tail.compare_exchange_strong(t, next, std::memory_order_release,
+                                             std::memory_order_relaxed);
+        }
+        ff_ebr::exit(r);
+        return true;
+    }
+
+    inline bool mp_pop(void ** data) {
+        assert(data != NULL);
+        ff_ebr::record_t& r = ff_ebr::self();
+        ff_ebr::enter(r);
+        for(;;) {
+            Node* h    = head.load(std::memory_order_acquire);
+            Node* t    = tail.load(std::memory_order_acquire);
+            Node* next = h->next.load(std::memory_order_acquire);
+            if (h != head.load(std::memory_order_acquire)) continue;
+            if (next == nullptr) { ff_ebr::exit(r); return false; }
+            if (h == t) {
+                tail.compare_exchange_strong(t, next, std::memory_order_release,
+                                             std::memory_order_relaxed);
+                continue;
+            }
+            void* d = next->data;
+            if (head.compare_exchange_weak(h, next, std::memory_order_acq_rel,
+                                           std::memory_order_relaxed)) {
+                *data = d;
+                ff_ebr::retire(r, h);   // the old dummy node
+                break;
+            }
+        }
+        ff_ebr::exit(r);
+        return true;
+    }
+
+    // the queue has no single-producer/single-consumer fast path
+    inline bool push(void * const data) { return mp_push(data); }
+    inline bool pop(void ** data)       { return mp_pop(data);  }
+
+    inline bool empty() const {
+        ff_ebr::record_t& r = ff_ebr::self();
+        ff_ebr::enter(r);
+        const bool e = head.load(std::memory_order_acquire)->next.load(std::memory_order_acquire) == nullptr;
+        ff_ebr::exit(r);
+        return e;
+    }
+
+    inline unsigned long length() const { return 0;}
+
+private:
+    union {
+        std::atomic<Node*> head;
+        char padding1[CACHE_LINE_SIZE];
+    };
+    union {
+        std::atomic<Node*> tail;
+        char padding2[CACHE_LINE_SIZE];
+    };
+};
+
+} // namespace ff
+
+#endif /* FF_MPDYNQUEUE_HPP */
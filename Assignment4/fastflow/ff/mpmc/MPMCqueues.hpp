@@ -42,6 +42,8 @@
  *   * MPMC_Ptr_Queue   bounded MPMC queue by Dmitry Vyukov 
  *   * uMPMC_Ptr_Queue  unbounded MPMC queue by Massimo Torquati 
  *   * MSqueue          unbounded MPMC queue by Michael & Scott
+ *   * MPMC_Seq_Ptr_Queue bounded MPMC queue using only std::atomic 
+ *                      (see seqMPMCqueue.hpp, it can be included alone)
  *
  *  - Author: 
  *     Massimo Torquati <torquati@di.unipi.it> <massimotor@gmail.com>
@@ -60,6 +62,7 @@
 #include <ff/platforms/platform.h>
 #include <ff/mpmc/asm/abstraction_dcas.h>
 #include <ff/spin-lock.hpp>
+#include <ff/mpmc/seqMPMCqueue.hpp>
 
  
 /*
@@ -0,0 +1,224 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*!
+ *  \file seqMPMCqueue.hpp
+ *  \ingroup aux_classes
+ *
+ *  \brief Portable bounded Multi-Producer/Multi-Consumer queue based on
+ *  per-slot sequence numbers. It uses only std::atomic.
+ */
+
+/* ***************************************************************************
+ *
+ *  FastFlow is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License version 3 as
+ *  published by the Free Software Foundation.
+ *  Starting from version 3.0.1 FastFlow is dual licensed under the GNU LGPLv3
+ *  or MIT License (https://github.com/ParaGroup/WindFlow/blob/vers3.x/LICENSE.MIT)
+ *
+ *  This program is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ ****************************************************************************
+ */
+
+#ifndef FF_SEQMPMCQUEUE_HPP
+#define FF_SEQMPMCQUEUE_HPP
+
+/*
+ * The queue is the bounded MPMC algorithm by Dmitry Vyukov (the same of
+ * MPMC_Ptr_Queue in MPMCqueues.hpp), rewritten with the C++11 memory model
+ * only: no DCAS, no asm atomics and no allocation after init, so it
+ * can be used on any architecture having std::atomic (e.g. aarch64).
+ * With respect to MPMC_Ptr_Queue:
+ *   - the slots array is cache-line aligned;
+ *   - the counters are size_t and the distance between a sequence number
+ *     and an index is computed as a signed value, so it works also after
+ *     the counters wrap around;
+ *   - a failed CAS refreshes the index (no re-load), and it has the
+ *     empty/length/buffersize methods.
+ *
+ * The interface is the one of MPMC_Ptr_Queue:
+ *    init(size), push(void*), pop(void**)
+ * push returns false if the queue is full, pop returns false if the
+ * queue is empty.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <atomic>
+#include <new>
+#include <ff/config.hpp>
+#include <ff/sysdep.h>
+
+namespace ff {
+
+/*!
+ * \class MPMC_Seq_Ptr_Queue
+ *  \ingroup aux_classes
+ *
+ * \brief Portable bounded Multi-Producer/Multi-Consumer queue of pointers.
+ *
+ * This class is defined in \ref seqMPMCqueue.hpp
+ */
+class MPMC_Seq_Ptr_Queue {
+private:
+    struct element_t {
+        std::atomic<size_t> seq;
+        void *              data;
+    };
+
+    static inline void backoff(unsigned long& bk) {
+        // exponential delay with max value
+        for(volatile unsigned long i=0;i<bk;++i) ;
+        bk <<= 1;
+        bk &= BACKOFF_MAX;
+        if (!bk) bk = BACKOFF_MIN;
+    }
+
+public:
+    MPMC_Seq_Ptr_Queue():buf(nullptr),mask(0) {
+        pwrite.store(0,std::memory_order_relaxed);
+        pread.store(0,std::memory_order_relaxed);
+    }
+
+    ~MPMC_Seq_Ptr_Queue() {
+        if (buf) {
+            for(size_t i=0;i<=mask;++i) buf[i].~element_t();
+            freeAlignedMemory(buf);
+            buf=nullptr;
+        }
+    }
+
+    /*    |  data  | seq |        |  data  | seq |        |  data  | seq |
+     *    |  NULL  |  0  | ------ |  NULL  |  1  | ------ |  NULL  | ... |
+     *    ||||||||||||||||        ||||||||||||||||        ||||||||||||||||
+     *                |
+     *                |
+     *                |
+     *          pwrite pread
+     *
+     * slot i is free for the push having index pw if seq==pw,
+     * it is full for the pop having index pr if seq==pr+1.
+     */
+
+    /**
+     * \brief init (the size is rounded up to a power of 2)
+     */
+    inline bool init(size_t size) {
+        if (buf) return false;
+        if (size<2) size=2;
+        size_t s=2;
+        while(s<size) s<<=1;
+        mask = s-1;
+
+        buf = (element_t*)getAlignedMemory(CACHE_LINE_SIZE, s*sizeof(element_t));
+        if (!buf) return false;
+        for(size_t i=0;i<s;++i) {
+            new (&buf[i]) element_t;
+            buf[i].data = nullptr;
+            buf[i].seq.store(i,std::memory_order_relaxed);
+        }
+        pwrite.store(0,std::memory_order_relaxed);
+        pread.store(0,std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * \brief push: enqueue data (non-blocking, one CAS per operation)
+     *
+     * \return false if the queue is full
+     */
+    inline bool push(void *const data) {
+        size_t pw = pwrite.load(std::memory_order_relaxed);
+        unsigned long bk = BACKOFF_MIN;
+        element_t * node;
+        for(;;) {
+            node = &buf[pw & mask];
+            const size_t   seq  = node->seq.load(std::memory_order_acquire);
+            const intptr_t diff = (intptr_t)seq - (intptr_t)pw;
+            if (diff == 0) {
+                // on failure pw is updated with the current value
+                if (pwrite.compare_exchange_weak(pw, pw+1, std::memory_order_relaxed))
+                    break;
+                backoff(bk);
+            } else {
+                if (diff < 0) return false; // queue full
+                pw = pwrite.load(std::memory_order_relaxed);
+            }
+        }
+        node->data = data;
+        node->seq.store(pw+1,std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * \brief pop: dequeue data (non-blocking, one CAS per operation)
+     *
+     * \return false if the queue is empty
+     */
+    inline bool pop(void** data) {
+        size_t pr = pread.load(std::memory_order_relaxed);
+        unsigned long bk = BACKOFF_MIN;
+        element_t * node;
+        for(;;) {
+            node = &buf[pr & mask];
+            const size_t   seq  = node->seq.load(std::memory_order_acquire);
+            const intptr_t diff = (intptr_t)seq - (intptr_t)(pr+1);
+            if (diff == 0) {
+                if (pread.compare_exchange_weak(pr, pr+1, std::memory_order_relaxed))
+                    break;
+                backoff(bk);
+            } else {
+                if (diff < 0) return false; // queue empty
+                pr = pread.load(std::memory_order_relaxed);
+            }
+        }
+        *data = node->data;
+        node->seq.store(pr+mask+1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * \brief returns true if the queue is empty (it may be stale when returned)
+     */
+    inline bool empty() const {
+        const size_t pr = pread.load(std::memory_order_relaxed);
+        const size_t seq= buf[pr & mask].seq.load(std::memory_order_acquire);
+        return ((intptr_t)seq - (intptr_t)(pr+1)) < 0;
+    }
+
+    /**
+     * \brief rough estimation of the number of elements in the queue
+     */
+    inline size_t length() const {
+        const size_t pr = pread.load(std::memory_order_relaxed);
+        const size_t pw = pwrite.load(std::memory_order_relaxed);
+        return (pw>pr) ? (pw-pr) : 0;
+    }
+
+    inline size_t buffersize() const { return mask+1; }
+
+private:
+    union {
+        std::atomic<size_t>  pwrite; /// index of the next push
+        char padding1[CACHE_LINE_SIZE];
+    };
+    union {
+        std::atomic<size_t>  pread;  /// index of the next pop
+        char padding2[CACHE_LINE_SIZE];
+    };
+    element_t *              buf;
+    size_t                   mask;
+};
+
+} // namespace ff
+
+#endif /* FF_SEQMPMCQUEUE_HPP */
@@ -714,6 +714,11 @@ public:
     inline void broadcast_task(void *task) {
         lb->broadcast_task(task);
     }
+    // the payload is shared by the consumers, the last one frees it
+    // (see envelope.hpp)
+    inline void broadcast_shared(ff_envelope_base *e) {
+        lb->broadcast_shared(e);
+    }
 
     
     /**
@@ -43,6 +43,14 @@
 #include <ff/buffer.hpp>
 #include <ff/ubuffer.hpp>
 #include <ff/mapper.hpp>
+#include <ff/corebudget.hpp>
+#include <ff/valuechannel.hpp>
+#include <ff/parking.hpp>
+#include <ff/backoff.hpp>
+#include <ff/stealq.hpp>
+#include <ff/lbpolicy.hpp>
+#include <ff/kpartition.hpp>
+#include <ff/batch.hpp>
 #include <ff/config.hpp>
 #include <ff/svector.hpp>
 #include <ff/barrier.hpp>
@@ -70,6 +78,7 @@ static void* FF_EOS_NOFREEZE  = (void*)(ULLONG_MAX-1);   /// not automatically p
 static void* FF_EOSW          = (void*)(ULLONG_MAX-2);   /// propagated only by farm's stages
 static void* FF_GO_ON         = (void*)(ULLONG_MAX-3);   /// not automatically propagated
 static void* FF_GO_OUT        = (void*)(ULLONG_MAX-4);   /// not automatically propagated
+static void* FF_KEY_CTL       = (void*)(ULLONG_MAX-5);   /// key-partitioned farm control mark, never propagated
 static void* FF_TAG_MIN       = (void*)(ULLONG_MAX-10);  /// just a lower bound mark
 // The FF_GO_OUT is quite similar to the FF_EOS_NOFREEZE. Both of them are not propagated automatically to
 // the next stage, but while the first one is used to exit the main computation loop and, if this is the case, to be frozen,
@@ -112,6 +121,33 @@ struct OptLevel2: OptLevel {
 };
 /* ----------------------------------------------------------------------- */
 
+/*
+ * Per-node counters used by the ff_pipeline_profiler (see profiler.hpp).
+ * They are always compiled in (differently from the TRACE_FASTFLOW ones) but
+ * they are updated only if the profiler attached them to the node, so the
+ * cost for a node not profiled is a pointer test per task.
+ * Each counter is written only by the thread running the node, the profiler
+ * thread just reads them.
+ */
+struct ff_node_prof {
+    std::atomic<unsigned long>      ntasks{0};   // n. of svc calls
+    std::atomic<unsigned long>      nouts{0};    // n. of tasks produced
+    std::atomic<unsigned long long> svcticks{0}; // ticks spent in svc
+
+    // svc call that took t ticks, ret is the task it produced (if any)
+    // when it is not sent through ff_send_out
+    inline void svcdone(unsigned long long t, void* ret=nullptr) {
+        ntasks.store(ntasks.load(std::memory_order_relaxed)+1, std::memory_order_relaxed);
+        svcticks.store(svcticks.load(std::memory_order_relaxed)+t, std::memory_order_relaxed);
+        sent(ret);
+    }
+    inline void sent(void* task) {
+        if (!task || task >= FF_TAG_MIN) return;
+        nouts.store(nouts.load(std::memory_order_relaxed)+1, std::memory_order_relaxed);
+    }
+};
+/* ----------------------------------------------------------------------- */
+
 // This is just a counter, and is used to set the ff_node::tid value.
 // The _noBarrier counter is to use with threads that are not part of a topology,
 // such for example stand-alone nodes or manager node or ...etc...    
@@ -344,8 +380,18 @@ public:
         }
 
         int CPUId = -1;
-        if (default_mapping)
+#if defined(FF_CORE_BUDGET)
+        // the thread takes one free core of the budget (if any), otherwise
+        // it is not pinned so that it does not steal the core of another thread
+        if (default_mapping && cpuId<0) {
+            budgetCPUId = coreBudget::instance()->acquire();
+            if (budgetCPUId>=0) init_thread_affinity(attr, budgetCPUId);
+        } else
+#endif
+        if (default_mapping) {
             init_thread_affinity(attr, cpuId);
+            CPUId = cpuId;  // the core given by the caller (e.g. a ParallelFor team)
+        }
         if (CPUId==-2) return -2;
 
         if (barrier)
@@ -358,6 +404,7 @@ public:
             errno=r;
             perror("pthread_create: pthread creation failed.");
             barrier?--internal_threadCounter:--internal_threadCounter_noBarrier;
+            release_budget();
             return -2;
         }
         spawned = true;
@@ -374,6 +421,7 @@ public:
         if (spawned) {
             pthread_join(th_handle, NULL);
             barrier ? --internal_threadCounter: --internal_threadCounter_noBarrier;
+            release_budget();
         }
         if (attr) {
             if (pthread_attr_destroy(attr)) {
@@ -431,6 +479,14 @@ public:
     inline size_t getOSThreadId() const { return threadid; }
 
 protected:
+    // gives back to the coreBudget the core taken in spawn (if any)
+    inline void release_budget() {
+#if defined(FF_CORE_BUDGET)
+        if (budgetCPUId>=0) coreBudget::instance()->release(budgetCPUId);
+        budgetCPUId = -1;
+#endif
+    }
+
     size_t          tid;                /// unique logical id of the thread
     size_t          threadid;           /// OS specific thread ID
     bool            default_mapping;
@@ -447,6 +503,7 @@ private:
     pthread_cond_t  cond;
     pthread_cond_t  cond_frozen;
     int             old_cancelstate;
+    int             budgetCPUId{-1};    /// core taken from the coreBudget
 };
     
 static void * proxy_thread_routine(void * arg) {
@@ -509,6 +566,7 @@ private:
     friend class ff_monode;
     friend class ff_a2a;
     friend class ff_comb;
+    friend class ff_pipeline_profiler;
     friend struct internal_mo_transformer;
     friend struct internal_mi_transformer;
 
@@ -557,6 +615,7 @@ protected:
     virtual inline bool push(void * ptr) { return out->push(ptr); }
     virtual inline bool pop(void ** ptr) { 
         if (!in_active) return false; // it does not want to receive data
+        if (stealgrp) return stealgrp->pop(stealid, ptr);
         return in->pop(ptr);
     }
     virtual inline bool Push(void *ptr, unsigned long retry=((unsigned long)-1), unsigned long ticks=(TICKS2WAIT)) {
@@ -565,7 +624,7 @@ protected:
             bool empty=out->empty();
             bool r = push(ptr);
             if (r) { // OK
-                if (empty) pthread_cond_signal(p_cons_c);
+                ff_park_notify(p_cons_c, empty);
             } else { // FULL
                 struct timespec tv;
                 timedwait_timeout(tv);
@@ -587,13 +646,14 @@ protected:
         if (blocking_in) {
             if (!in_active) { *ptr=NULL; return false; }
         retry:
-            bool r = in->pop(ptr);
-            if (!r) { // EMPTY                
-                struct timespec tv;
-                timedwait_timeout(tv);
-                pthread_mutex_lock(cons_m);
-                pthread_cond_timedwait(cons_c, cons_m,&tv);
-                pthread_mutex_unlock(cons_m);
+            bool r = stealgrp ? stealgrp->pop(stealid, ptr) : in->pop(ptr);
+            if (!r) { // EMPTY
+                // a thief is not woken up when there is something to steal,
+                // it looks at the other queues at each wake-up
+                ff_park_wait(cons_m, cons_c,
+                             [this]() { return !in_active ||
+                                     (stealgrp ? stealgrp->ready(stealid) : !in->empty()); },
+                             FF_PARK_TIMEOUT_NS);
                 goto retry;
             }
             return true;
@@ -606,6 +666,18 @@ protected:
         return true;
     }
 
+    /**
+     * It gets up to \p max tasks from the input channel: the first one as
+     * in \p Pop (i.e. waiting for it), the others only if they are already
+     * in the channel. It always stores at least one value in \p ptr, the one
+     * set by \p Pop (possibly NULL if the input has been disabled).
+     *
+     * \return the number of values stored in \p ptr
+     */
+    virtual inline size_t MultiPop(void **ptr, size_t max) {
+        if (!Pop(ptr) || max<2 || !in_active || stealgrp) return 1;
+        return 1 + in->multipop(ptr+1, max-1);
+    }
 
     // consumer
     virtual inline bool init_input_blocking(pthread_mutex_t   *&m,
@@ -614,10 +686,10 @@ protected:
         if (cons_m == nullptr) {
             assert(cons_c==nullptr);
             cons_m = (pthread_mutex_t*)malloc(sizeof(pthread_mutex_t));
-            cons_c = (pthread_cond_t*)malloc(sizeof(pthread_cond_t));
+            cons_c = ff_parking_create();
             assert(cons_m); assert(cons_c);
+            if (!cons_c) return false;
             if (pthread_mutex_init(cons_m, NULL) != 0) return false;
-            if (pthread_cond_init(cons_c, NULL) != 0)  return false;
         } 
         m = cons_m,  c = cons_c;
         return true;
@@ -937,8 +1009,7 @@ public:
         if (out && myoutbuffer) delete out;
         if (thread && my_own_thread) delete reinterpret_cast<thWorker*>(thread);
         if (cons_c && cons_m) {
-            pthread_cond_destroy(cons_c);
-            free(cons_c);
+            ff_parking_destroy(cons_c);
             cons_c = nullptr;
         }
         if (cons_m) {
@@ -1107,6 +1178,7 @@ public:
      *
      */
     virtual inline bool  put(void * ptr) { 
+        if (stealgrp) return stealgrp->push(stealid, ptr);
         //return in->push(ptr);
         return (in->*in->pushPMF)(ptr);
     }
@@ -1120,27 +1192,31 @@ public:
      *
      */
     virtual inline bool  get(void **ptr) { return out->pop(ptr);}
+
+    /**
+     * \brief Noblocking multipop from the output channel
+     *
+     * \return the number of tasks stored in \p ptr (at most \p max)
+     */
+    virtual inline size_t multiget(void **ptr, size_t max) { return out->multipop(ptr,max);}
    
     virtual inline void losetime_out(unsigned long ticks=ff_node::TICKS2WAIT) {
         FFTRACE(lostpushticks+=ticks; ++pushwait);
-#if defined(SPIN_USE_PAUSE)
-        const long n = (long)ticks/2000;
-        for(int i=0;i<=n;++i) PAUSE();
-#else
-        ticks_wait(ticks);
-#endif /* SPIN_USE_PAUSE */
+        backoff_out.wait(ticks);
     }
 
     virtual inline void losetime_in(unsigned long ticks=ff_node::TICKS2WAIT) {
         FFTRACE(lostpopticks+=ticks; ++popwait);
-#if defined(SPIN_USE_PAUSE)
-        const long n = (long)ticks/2000;
-        for(int i=0;i<=n;++i) PAUSE();
-#else
-        ticks_wait(ticks);
-#endif /* SPIN_USE_PAUSE */
+        backoff_in.wait(ticks);
     }
 
+    /**
+     * \brief Statistics of the waits on the input (output) channel(s),
+     * they can be read while the node is running (see backoff.hpp).
+     */
+    ff_backoff_stats get_backoff_in()  const { return backoff_in.stats(); }
+    ff_backoff_stats get_backoff_out() const { return backoff_out.stats(); }
+
     /**
      * \brief Gets input channel
      *
@@ -1150,6 +1226,15 @@ public:
      */
     virtual FFBUFFER * get_in_buffer() const { return in;}
 
+    /**
+     * \brief Sets how many tasks the node takes from its input channel at
+     * each wake-up (between 1 and FF_MULTIPOP_SIZE, see config.hpp).
+     * It has to be called before running the node.
+     */
+    void set_multipop(size_t k) {
+        multipop_size = (k<1) ? 1 : ((k>FF_MULTIPOP_SIZE) ? FF_MULTIPOP_SIZE : k);
+    }
+
     /**
      * \brief Gets pointer to the output channel
      *
@@ -1198,11 +1283,16 @@ public:
     virtual bool ff_send_out(void * task, int id=-1,
                              unsigned long retry=((unsigned long)-1),
                              unsigned long ticks=(TICKS2WAIT)) { 
-        if (callback) return  callback(task,id,retry,ticks,callback_arg);
+        if (callback) {
+            bool r = callback(task,id,retry,ticks,callback_arg);
+            if (r && prof) prof->sent(task);
+            return r;
+        }
         bool r =Push(task,retry,ticks);
 #if defined(FF_TASK_CALLBACK)
         if (r) callbackOut();
 #endif
+        if (r && prof) prof->sent(task);
         return r;
     }
 
@@ -1417,6 +1507,71 @@ private:
 
         inline bool get(void **ptr) { return filter->get(ptr);}
 
+        /*
+         * It calls svc on \p task and sends out the result, \p exit is set
+         * if svc returns EOS, it returns false if svc returns GO_OUT.
+         */
+        inline bool svc_task(void* task, void*& ret, bool& exit, const bool outpresent) {
+            FFTRACE(++filter->taskcnt);
+            FFTRACE(ticks t0 = getticks());
+            ff_node_prof* const prof = filter->prof;
+            const ticks p0 = prof ? getticks() : 0;
+            ff_lb_feedback* const lbf = filter->lbfeedback;
+            const ticks l0 = (lbf && lbf->timed) ? getticks() : 0;
+            if (lbf && task < FF_TAG_MIN) lbf->start();
+
+#if defined(FF_TASK_CALLBACK)
+            if (filter) callbackIn();
+#endif                    
+
+            ret = filter->svc(task);
+            if (prof) prof->svcdone(getticks()-p0); // outputs counted in ff_send_out
+            if (lbf && task < FF_TAG_MIN) lbf->completed(l0 ? getticks()-l0 : 0);
+
+#if defined(TRACE_FASTFLOW)
+            ticks diff=(getticks()-t0);
+            filter->tickstot +=diff;
+            filter->ticksmin=(std::min)(filter->ticksmin,diff); // (std::min) for win portability)
+            filter->ticksmax=(std::max)(filter->ticksmax,diff);
+#endif           
+
+            if (ret == FF_GO_OUT) return false;     
+            if (!ret || (ret >= FF_EOSW)) { // EOS or EOS_NOFREEZE or EOSW
+                // NOTE: The EOS is gonna be produced in the output queue
+                // and the thread exits even if there might be some tasks
+                // in the input queue !!!
+                if (!ret) ret = FF_EOS;
+                exit=true;
+            }
+            if ( outpresent && ((ret != FF_GO_ON) && (ret != FF_EOS_NOFREEZE)) ) { 
+                push(ret);
+#if defined(FF_TASK_CALLBACK)
+                if (filter) callbackOut();
+#endif
+            }
+            return true;
+        }
+
+        /*
+         * It calls svc on the tasks of the bundle \p b starting from \p i,
+         * it returns false if svc returns GO_OUT. The tasks not yet served
+         * are kept for the next run (e.g. after a freeze).
+         */
+        inline bool svc_bundle(ff_bundle* b, size_t i, void*& ret, bool& exit, const bool outpresent) {
+            for(;i<b->n && !exit;++i)
+                if (!svc_task(b->task[i], ret, exit, outpresent)) {
+                    if (++i<b->n && !exit) {
+                        btail = b;
+                        bnext = i;
+                        return false;
+                    }
+                    filter->batch->done(filter->batchid, b);
+                    return false;
+                }
+            filter->batch->done(filter->batchid, b);
+            return true;
+        }
+
         inline void* svc(void * ) {
             void * task = NULL;
             void * ret  = FF_EOS;
@@ -1434,13 +1589,26 @@ private:
             }
             gettimeofday(&filter->wtstart,NULL);
             do {
+                // the tasks of a bundle left by a GO_OUT are served first
+                if (btail) {
+                    ff_bundle* const b = btail;
+                    btail = nullptr;
+                    if (!svc_bundle(b, bnext, ret, exit, outpresent)) break;
+                    continue;
+                }
 #ifdef DFF_ENABLED
                 if (!filter->skipallpop() && inpresent){
 #else
                 if (inpresent) {
 #endif
-                    if (!skipfirstpop) pop(&task); 
-                    else skipfirstpop=false;
+                    if (!skipfirstpop) {
+                        // drains up to multipop_size tasks per wake-up
+                        if (mppos == mpsize) {
+                            mpsize = filter->MultiPop(mpbuf, filter->multipop_size);
+                            mppos  = 0;
+                        }
+                        task = mpbuf[mppos++];
+                    } else skipfirstpop=false;
                     if ((task == FF_EOS) || (task == FF_EOSW) ||
                         (task == FF_EOS_NOFREEZE)) {
                         ret = task;
@@ -1456,37 +1624,18 @@ private:
                         break;
                     }
                     if (task == FF_GO_OUT) break;
+                    if (task == FF_KEY_CTL) {
+                        if (filter->keyctl) filter->keyctl->dispatch(filter->keystate);
+                        continue;
+                    }
                 }
-                FFTRACE(++filter->taskcnt);
-                FFTRACE(ticks t0 = getticks());
-
-#if defined(FF_TASK_CALLBACK)
-                if (filter) callbackIn();
-#endif                    
-
-                ret = filter->svc(task);
-
-#if defined(TRACE_FASTFLOW)
-                ticks diff=(getticks()-t0);
-                filter->tickstot +=diff;
-                filter->ticksmin=(std::min)(filter->ticksmin,diff); // (std::min) for win portability)
-                filter->ticksmax=(std::max)(filter->ticksmax,diff);
-#endif           
-
-                if (ret == FF_GO_OUT) break;     
-                if (!ret || (ret >= FF_EOSW)) { // EOS or EOS_NOFREEZE or EOSW
-                    // NOTE: The EOS is gonna be produced in the output queue
-                    // and the thread exits even if there might be some tasks
-                    // in the input queue !!!
-                    if (!ret) ret = FF_EOS;
-                    exit=true;
-                }
-                if ( outpresent && ((ret != FF_GO_ON) && (ret != FF_EOS_NOFREEZE)) ) { 
-                    push(ret);
-#if defined(FF_TASK_CALLBACK)
-                    if (filter) callbackOut();
-#endif
+                // batch-aware farm: the task is a bundle, svc is called on
+                // each of its tasks (see batch.hpp)
+                if (filter->batch && task < FF_TAG_MIN) {
+                    if (!svc_bundle(reinterpret_cast<ff_bundle*>(task), 0, ret, exit, outpresent)) break;
+                    continue;
                 }
+                if (!svc_task(task, ret, exit, outpresent)) break;
             } while(!exit);
             
             gettimeofday(&filter->wtstop,NULL);
@@ -1503,6 +1652,10 @@ private:
                     error("Cannot map thread %d to CPU %d, mask is %u,  size is %u,  going on...\n",tid, (cpuId<0) ? threadMapper::instance()->getCoreId(tid) : cpuId, threadMapper::instance()->getMask(), threadMapper::instance()->getCListSize());            
                 filter->setCPUId(cpuId);
             }
+#endif
+#if defined(FF_RING_NUMA)
+            // the thread is on its core(s), its input ring goes to its NUMA node
+            ff_place_ring(filter->get_in_buffer(), ff_my_numanode());
 #endif
             gettimeofday(&filter->tstart,NULL);
             return filter->svc_init();
@@ -1534,6 +1687,14 @@ private:
     protected:            
         ff_node * const filter;
         const ssize_t input_neos;
+        // tasks taken from the input channel and not yet passed to svc,
+        // they are kept across svc calls (e.g. after a freeze)
+        void *  mpbuf[FF_MULTIPOP_SIZE];
+        size_t  mppos  = 0;
+        size_t  mpsize = 0;
+        // the bundle interrupted by a GO_OUT and its first task not served
+        ff_bundle* btail = nullptr;
+        size_t     bnext = 0;
     };
     /* ------------------------------------------------------------------------------------- */
 
@@ -1546,6 +1707,9 @@ private:
 
 protected:
 
+    ff_node_prof     * prof = nullptr; // set by the ff_pipeline_profiler
+    size_t             multipop_size = FF_MULTIPOP_SIZE; // see MultiPop
+
 #if defined(TRACE_FASTFLOW)
     size_t        taskcnt;
     ticks         lostpushticks;
@@ -1572,6 +1736,29 @@ protected:
     bool               FF_MEM_ALIGN(blocking_in,32); 
     bool               FF_MEM_ALIGN(blocking_out,32);
 
+    // adaptive backoff of the input and output channel(s)
+    ff_backoff         backoff_in;
+    ff_backoff         backoff_out;
+
+    // work-stealing farm: the input queue is stealgrp's queue 'stealid'
+    // (see ff_loadbalancer::set_stealing)
+    ff_steal_group    *stealgrp = nullptr;
+    size_t             stealid  = 0;
+
+    // completion counter of the worker for the Emitter's policy (see
+    // ff_loadbalancer::set_scheduling_policy)
+    ff_lb_feedback    *lbfeedback = nullptr;
+
+    // key-partitioned farm: control queue of the worker and its per-key
+    // state (see ff_loadbalancer::set_scheduling_bykey)
+    ff_key_ctlq       *keyctl   = nullptr;
+    ff_keyed_state    *keystate = nullptr;
+
+    // batch-aware farm: the bundles received are given back to batch
+    // (see ff_loadbalancer::set_batching)
+    ff_batcher        *batch    = nullptr;
+    size_t             batchid  = 0;
+
     bool                  prepared = false;
     bool                  initial_barrier = true;
     bool                  default_mapping = true;
@@ -1682,10 +1869,66 @@ struct ff_node_t: ff_node {
 
 	}
     OUT_t * const GO_ON,  *const EOS, *const EOSW, *const GO_OUT, *const EOS_NOFREEZE;
-    virtual ~ff_node_t()  {}
+    virtual ~ff_node_t()  { if (vout) delete vout; }
     virtual OUT_t* svc(IN_t*)=0;
-    inline  void *svc(void *task) { return svc(reinterpret_cast<IN_t*>(task)); };
+    inline  void *svc(void *task) {
+        if (values_in) {
+            OUT_t* r = svc(reinterpret_cast<IN_t*>(task));
+            // a task returned as it is, is released by the next node
+            if (task && task < FF_TAG_MIN && (void*)r != task)
+                ff_value_release<IN_t>(task);
+            return r;
+        }
+        return svc(reinterpret_cast<IN_t*>(task));
+    }
+
+    /**
+     * \brief sends out a copy of \p v without allocating it 
+     *
+     * The value is copied in the node's ValueChannel (see valuechannel.hpp),
+     * the receiving node must call set_input_values.
+     */
+    bool ff_send_value(const OUT_t& v, int id=-1,
+                       unsigned long retry=((unsigned long)-1),
+                       unsigned long ticks=(ff_node::TICKS2WAIT)) {
+        static_assert(ff_is_value_type<OUT_t>::value,
+                      "ff_send_value: the output type cannot be sent by value");
+        if (!vout) {
+            ValueChannel<OUT_t>* vc = new ValueChannel<OUT_t>(values_nslots);
+            if (vc->init()<0) {
+                error("ff_node_t, ff_send_value, unable to allocate the value channel\n");
+                delete vc;
+                return false;
+            }
+            vout = vc;
+        }
+        OUT_t* p = static_cast<ValueChannel<OUT_t>*>(vout)->put(v);
+        if (ff_send_out(p, id, retry, ticks)) return true;
+        ValueChannel<OUT_t>::release(p);
+        return false;
+    }
+
+    /**
+     * \brief the input tasks are slots of the producers' ValueChannel
+     *
+     * They are released as soon as svc returns.
+     */
+    void set_input_values(bool v=true) {
+        static_assert(ff_is_value_type<IN_t>::value,
+                      "set_input_values: the input type cannot be received by value");
+        values_in = v;
+    }
+
+    /**
+     * \brief number of slots of the output ValueChannel (before the first ff_send_value)
+     */
+    void set_output_values(size_t nslots) { values_nslots = nslots; }
+
 private:
+    ValueChannelBase* vout = nullptr;
+    bool              values_in = false;
+    size_t            values_nslots = FF_VALUE_SLOTS;
+
     // deleting some functions that do not have to be used in the svc
     using ff_node::push;
     using ff_node::pop;
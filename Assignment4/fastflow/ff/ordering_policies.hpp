@@ -36,7 +36,7 @@
 #define FF_ORDERING_POLICY_HPP
 
 #include <vector>
-#include <queue>
+#include <atomic>
 
 #include <ff/lb.hpp>
 #include <ff/gt.hpp>
@@ -50,17 +50,103 @@ namespace ff {
 // second.second is used to store the sender
 using ordering_pair_t = std::pair<size_t, std::pair<void*,ssize_t> >;
 
+/*
+ * Reorder window of the ordered farm with on-demand scheduling, shared by
+ * the Emitter (ordered_lb) and the Collector (ordered_gt or
+ * OrderedCollectorWrapper). The Emitter numbers the tasks and cannot get
+ * more than size() tasks ahead of the last one sent out in order by the
+ * Collector, it waits (backoff) until the window moves. So the task with
+ * sequence number s uses the slot s % size() both of the Emitter's memory
+ * of ordering_pair_t and of the ring of the Collector: insert and release
+ * are O(1) and the memory is bounded by the window. The only shared
+ * variable is the number of tasks released, written by the Collector.
+ */
+class ff_reorder_window {
+    struct slot_t {
+        size_t  seq;      // sequence number + 1, 0 if empty
+        void   *data;
+        ssize_t sender;
+    };
+public:
+    ff_reorder_window() { released.store(0, std::memory_order_relaxed); }
+
+    ff_reorder_window(const ff_reorder_window&) = delete;
+    ff_reorder_window& operator=(const ff_reorder_window&) = delete;
+
+    // the smallest power of 2 not less than n
+    static inline size_t roundup(size_t n) {
+        size_t r = 1;
+        while(r < n) r <<= 1;
+        return r;
+    }
+
+    // the size is rounded down to a power of 2
+    void init(size_t n) {
+        size_t r = 1;
+        while(2*r <= n) r <<= 1;
+        ring.assign(r, slot_t{0, nullptr, -1});
+        mask = r-1; cnt = 0; nstalls = 0;
+        released.store(0, std::memory_order_relaxed);
+    }
+    inline size_t size() const { return mask+1; }
+
+    // Emitter: it waits until the task \p seq enters the window
+    inline void acquire(size_t seq, unsigned long ticks) {
+        if ((seq - released.load(std::memory_order_acquire)) <= mask) return;
+        ++nstalls;
+        do backoff.wait(ticks);
+        while((seq - released.load(std::memory_order_acquire)) > mask);
+    }
+
+    // Collector: a task received, false if it is not in the window (e.g.
+    // the copies of a task sent in broadcast)
+    inline bool put(const ordering_pair_t* in, ssize_t sender) {
+        if ((in->first - cnt) > mask) return false;
+        slot_t& e = ring[in->first & mask];
+        e.seq = in->first+1; e.data = in->second.first; e.sender = sender;
+        return true;
+    }
+    // Collector: the next task in order, if it has been received. The slot
+    // of the Emitter is given back when the task has been read.
+    inline bool next(void** data, ssize_t& sender) {
+        slot_t& e = ring[cnt & mask];
+        if (e.seq != cnt+1) return false;
+        *data = e.data; sender = e.sender;
+        e.seq = 0;
+        released.store(++cnt, std::memory_order_release);
+        return true;
+    }
+
+    // times the Emitter has found the window full
+    inline unsigned long stalls() const { return nstalls; }
+
+private:
+    ALIGN_TO_PRE(CACHE_LINE_SIZE)
+    std::atomic<size_t> released;
+    ALIGN_TO_POST(CACHE_LINE_SIZE)
+    // Collector only
+    std::vector<slot_t> ring;
+    size_t              mask = 0;
+    size_t              cnt  = 0;
+    // Emitter only
+    unsigned long       nstalls = 0;
+    ff_backoff          backoff;
+};
+
 struct ordered_lb:ff_loadbalancer {
     ordered_lb(int max_num_workers):ff_loadbalancer(max_num_workers) {}
+    // \p size is the size of the reorder window, at most the size of \p v
     void init(ordering_pair_t* v, const size_t size) {
-        _M=v; _M_size=size; cnt=0; idx=0;
+        W.init(size);
+        _M=v; _M_size=W.size(); cnt=0; idx=0;
     }
     inline bool schedule_task(void * task, unsigned long retry, unsigned long ticks) {
+        W.acquire(cnt, ticks);
         _M[idx].first  = cnt;
         _M[idx].second.first = task;
         auto r = ff_loadbalancer::schedule_task(&_M[idx], retry, ticks);
         assert(r);
-        ++cnt; ++idx %= _M_size;
+        ++cnt; idx = cnt & (_M_size-1);
         return r;
     }
     inline void broadcast_task(void * task) {
@@ -68,55 +154,38 @@ struct ordered_lb:ff_loadbalancer {
             ff_loadbalancer::broadcast_task(task);
             return;
         }
+        W.acquire(cnt, TICKS2WAIT);
         _M[idx].first  = cnt;
         _M[idx].second.first = task;
         ff_loadbalancer::broadcast_task(&_M[idx]);
-        ++cnt; ++idx %= _M_size;
+        ++cnt; idx = cnt & (_M_size-1);
     }
     inline bool ff_send_out_to(void *task, int id, unsigned long retry, unsigned long ticks) {
         assert(task<FF_TAG_MIN);
+        W.acquire(cnt, ticks);
         _M[idx].first  = cnt;
         _M[idx].second.first = task;
         auto r = ff_loadbalancer::ff_send_out_to(&_M[idx], id, retry, ticks);
-        if (r) {++cnt; ++idx %= _M_size;}
+        if (r) {++cnt; idx = cnt & (_M_size-1);}
         return r;
-    }        
+    }
+    ff_reorder_window* window() { return &W; }
+
     size_t idx,cnt,_M_size=0;
-    ordering_pair_t* _M=nullptr;    
+    ordering_pair_t* _M=nullptr;
+    ff_reorder_window W;
 };
 
 struct ordered_gt: ff_gatherer {
-    struct PairCmp {
-        bool operator()(const ordering_pair_t* lhs, const ordering_pair_t* rhs) const { 
-            return lhs->first > rhs->first;
-        }
-    };
     ordered_gt(int max_num_workers): ff_gatherer(max_num_workers) {}
-    void init(const size_t size) { MemSize=size; cnt =0; }
+    void init(ff_reorder_window* w) { W=w; }
     inline ssize_t gather_task(void ** task) {
-        if (!Q.empty()) {
-	    auto next = Q.top();
-	    if (cnt == next->first) {
-            ++cnt;
-            *task = next->second.first;
-            Q.pop();
-            return next->second.second;
-	    }
-        }
+        ssize_t sender;
+        if (W->next(task, sender)) return sender;
         ssize_t nextr=  ff_gatherer::gather_task(task);
         if (*task < FF_TAG_MIN) {
-            ordering_pair_t *in =  reinterpret_cast<ordering_pair_t*>(*task);
-            if (cnt == in->first) { // it's the next to send out
-                cnt++;
-                *task = in->second.first;
-                return nextr;
-            }
-            in->second.second = nextr;
-            Q.push(in);
-            if (Q.size()>MemSize) {
-                error("FATAL ERROR: OFARM, ondemand, not enough memory, increase MemoryElements\n");
-            }
-            *task = FF_GO_ON;
+            W->put(reinterpret_cast<ordering_pair_t*>(*task), nextr);
+            if (!W->next(task, sender)) *task = FF_GO_ON;
         }
         return nextr;                            
     }
@@ -133,9 +202,7 @@ struct ordered_gt: ff_gatherer {
         return r;
     }
     
-    size_t cnt;
-    std::priority_queue<ordering_pair_t*,std::vector<ordering_pair_t*>, PairCmp> Q;
-    size_t MemSize;       
+    ff_reorder_window* W=nullptr;
 };
 // Worker wrapper to be used when ordering_pair_t is added to the data elements
 class OrderedWorkerWrapper: public ff_node {
@@ -187,42 +254,16 @@ public:
 // A node that removes the ordering_pair_t around the data element
 class OrderedCollectorWrapper: public ff_node {
 public:
-    struct PairCmp {
-        bool operator()(const ordering_pair_t* lhs, const ordering_pair_t* rhs) const { 
-            return lhs->first > rhs->first;
-        }
-    };
-    OrderedCollectorWrapper(const size_t size):cnt(0),MemSize(size) {}
-    int svc_init() {
-        cnt=0;
-        return 0;
-    } 
+    OrderedCollectorWrapper(ff_reorder_window* w):W(w) {}
     inline void* svc(void *t) {
-        ordering_pair_t *in = reinterpret_cast<ordering_pair_t*>(t);
-        if (cnt == in->first) { // it's the next to send out
-            ff_send_out(in->second.first);
-            cnt++;
-            while(!Q.empty()) {
-                auto next = Q.top();
-                if (cnt == next->first) {
-                    ff_send_out(next->second.first);
-                    ++cnt;
-                    Q.pop();
-                } else break;
-            }
-            return GO_ON;
-        }
-        Q.push(in);
-        if (Q.size()>MemSize) {
-            error("FATAL ERROR: OFARM, ondemand, not enough memory, increase MemoryElements\n");
-        }
+        W->put(reinterpret_cast<ordering_pair_t*>(t), get_channel_id());
+        void*   out;
+        ssize_t sender;
+        while(W->next(&out, sender)) ff_send_out(out);
         return GO_ON;
     }
-    size_t cnt;
-    std::priority_queue<ordering_pair_t*,std::vector<ordering_pair_t*>, PairCmp> Q;
-    size_t MemSize;       
+    ff_reorder_window* W;
 };
-
     
 // --------------------------------------------------------------
 
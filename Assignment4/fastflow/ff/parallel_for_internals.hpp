@@ -987,6 +987,7 @@ private:
     Tres_t t; // not used
     size_t numCores;
     ffBarrier *loopbar;
+    std::vector<int> teamcores;   // cores taken from the coreBudget
 public:
 
     ff_forall_farm(ssize_t maxnw, const bool spinwait=false, const bool skipwarmup=false, const bool spinbarrier=false):
@@ -1003,12 +1004,23 @@ public:
         
         numCores = ((foralllb_t*const)getlb())->getNCores();
         if (maxnw<=0) maxnw=numCores;
+#if defined(FF_CORE_BUDGET)
+        // the team takes its cores (one per worker plus one for the
+        // scheduler thread) from the budget now, so nested teams built at
+        // the same time never share a core; they are given back in the
+        // destructor
+        maxnw = coreBudget::instance()->reserveTeam(maxnw, 1, teamcores);
+#endif
         std::vector<ff_node *> forall_w;
         auto donothing=[](const long,const long,const int,const Tres_t&) -> void { };
         forall_Scheduler *sched = new forall_Scheduler(getlb(),maxnw);
         ff_farm::add_emitter(sched);
         for(size_t i=0;i<(size_t)maxnw;++i)
             forall_w.push_back(new Worker_t(sched, loopbar, donothing));
+#if defined(FF_CORE_BUDGET)
+        for(size_t i=0;i<teamcores.size();++i)
+            set_node_cpu((i<(size_t)maxnw) ? forall_w[i] : sched, teamcores[i]);
+#endif
         ff_farm::add_workers(forall_w);
         ff_farm::wrap_around();
 
@@ -1040,6 +1052,9 @@ public:
     virtual ~ff_forall_farm() {
         if (loopbar) delete loopbar;
         if (ff_farm::getlb()) delete ff_farm::getlb();
+#if defined(FF_CORE_BUDGET)
+        coreBudget::instance()->release(teamcores);
+#endif
     }
 
 
@@ -1207,7 +1222,10 @@ public:
      */
     inline void setloop(long begin,long end,long step,long chunk,long nw) {
         if (nw>(ssize_t)getNWorkers()) {
+#if !defined(FF_CORE_BUDGET)
+            // with the core budget the team may be legitimately smaller than requested
             error("The number of threads specified is greater than the number set in the ParallelFor* constructor, it will be downsized\n");
+#endif
             nw = getNWorkers();
         }
         assert(nw<=(ssize_t)getNWorkers());
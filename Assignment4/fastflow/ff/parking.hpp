@@ -0,0 +1,223 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*!
+ *  \file parking.hpp
+ *  \ingroup building_blocks
+ *
+ *  \brief Hybrid spin-then-park wait used by the blocking mode.
+ */
+
+/* ***************************************************************************
+ *
+ *  FastFlow is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License version 3 as
+ *  published by the Free Software Foundation.
+ *  Starting from version 3.0.1 FastFlow is dual licensed under the GNU LGPLv3
+ *  or MIT License (https://github.com/ParaGroup/WindFlow/blob/vers3.x/LICENSE.MIT)
+ *
+ *  This program is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ ****************************************************************************
+ */
+
+/*
+ * In blocking mode each consumer (node, emitter, collector, accelerator's
+ * main thread) has a condition variable (cons_c) that its producers know
+ * (p_cons_c). Here the condition variable is allocated inside a parking
+ * object and the wait on an empty input becomes:
+ *
+ *   1. spin for a window of ticks learned at run-time: the window doubles
+ *      when the consumer is woken up shortly after having parked (it should
+ *      have spun longer) and it halves when the consumer sleeps until the
+ *      timeout (the spinning was useless). No spinning with one core only;
+ *   2. park on a futex (Linux) or on the condition variable: the consumer
+ *      marks itself parked, re-checks its input channel(s) and sleeps.
+ *
+ * The producer, after a push, wakes up the consumer only if it is marked
+ * parked, so in the common case no system call is done. Since the consumer
+ * re-checks the channels after the mark, a producer that does not see the
+ * mark has its data seen by the consumer: no wake-up is lost and an idle
+ * consumer sleeps for FF_PARK_TIMEOUT_NS. The wait sites that cannot
+ * re-check their channels still use the FF_TIMEDWAIT_NS timeout.
+ *
+ * Define FF_NO_HYBRID_WAIT to go back to the plain timed wait on the
+ * condition variable.
+ *
+ */
+
+#ifndef FF_PARKING_HPP
+#define FF_PARKING_HPP
+
+#include <cstdlib>
+#include <climits>
+#include <atomic>
+#include <new>
+#include <pthread.h>
+#include <ff/config.hpp>
+#include <ff/cycle.h>
+#include <ff/utils.hpp>
+#if defined(__linux__)
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#endif
+
+namespace ff {
+
+struct ff_parking_t {
+    pthread_cond_t     cond;     // must be the first field (see ff_parking_create)
+    std::atomic<int>   seq;      // futex word, incremented at each wake-up
+    std::atomic<int>   parked;   // the consumer is (about to be) parked
+#if !defined(__linux__)
+    pthread_mutex_t    lock;
+#endif
+    // written only by the consumer
+    ticks              spinwin;  // current spin window
+    ticks              spinmax;
+    ticks              spun;     // ticks spun in the current wait
+    ticks              last;     // end of the last call to ff_park_wait
+    unsigned long      nparks;   // how many times the consumer has slept
+};
+
+static inline ticks ff_park_spinmax() {
+    static const long ncores = sysconf(_SC_NPROCESSORS_ONLN);
+    return (ncores > 1) ? FF_SPIN_MAX_TICKS : 0;
+}
+
+/*
+ * It allocates a parking object, the pointer returned is used as the
+ * consumer's pthread_cond_t.
+ */
+static inline pthread_cond_t* ff_parking_create() {
+    ff_parking_t* p = (ff_parking_t*)malloc(sizeof(ff_parking_t));
+    if (!p) return nullptr;
+    if (pthread_cond_init(&p->cond, NULL) != 0) { free(p); return nullptr; }
+#if !defined(__linux__)
+    if (pthread_mutex_init(&p->lock, NULL) != 0) { free(p); return nullptr; }
+#endif
+    new (&p->seq)    std::atomic<int>(0);
+    new (&p->parked) std::atomic<int>(0);
+    p->spinmax = ff_park_spinmax();
+    p->spinwin = (p->spinmax < FF_SPIN_MIN_TICKS) ? p->spinmax : FF_SPIN_MIN_TICKS;
+    p->spun = p->last = 0;
+    p->nparks = 0;
+    return &p->cond;
+}
+
+static inline void ff_parking_destroy(pthread_cond_t* c) {
+    ff_parking_t* p = reinterpret_cast<ff_parking_t*>(c);
+    pthread_cond_destroy(&p->cond);
+#if !defined(__linux__)
+    pthread_mutex_destroy(&p->lock);
+#endif
+    free(p);
+}
+
+static inline unsigned long ff_parking_nparks(pthread_cond_t* c) {
+    return reinterpret_cast<ff_parking_t*>(c)->nparks;
+}
+
+/*
+ * Consumer side, called when the input channel(s) are empty. It returns
+ * after having spun a bit, or after a sleep, in both cases the caller
+ * retries its pop. 'ready' re-checks the channel(s) (true if something
+ * may be there).
+ */
+template<typename READY>
+static inline void ff_park_wait(pthread_mutex_t* m, pthread_cond_t* c,
+                                READY ready, long timeout_ns=FF_TIMEDWAIT_NS) {
+#if defined(FF_NO_HYBRID_WAIT)
+    FF_IGNORE_UNUSED(ready); FF_IGNORE_UNUSED(timeout_ns);
+    struct timespec tv;
+    timedwait_timeout(tv);
+    pthread_mutex_lock(m);
+    pthread_cond_timedwait(c, m, &tv);
+    pthread_mutex_unlock(m);
+#else
+    FF_IGNORE_UNUSED(m);
+    ff_parking_t* p = reinterpret_cast<ff_parking_t*>(c);
+    ticks now = getticks();
+    // a gap since the last call means that the caller has received
+    // something meanwhile, so this is a new wait
+    if ((now - p->last) > 2*FF_SPIN_CHUNK_TICKS) p->spun = 0;
+    if (p->spun < p->spinwin) {
+        p->spun += FF_SPIN_CHUNK_TICKS + ticks_wait(FF_SPIN_CHUNK_TICKS);
+        p->last = getticks();
+        return;
+    }
+    const int s0 = p->seq.load(std::memory_order_acquire);
+    p->parked.store(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!ready()) {
+        now = getticks();
+#if defined(__linux__)
+        struct timespec ts = { timeout_ns / 1000000000L, timeout_ns % 1000000000L };
+        syscall(SYS_futex, reinterpret_cast<int*>(&p->seq), FUTEX_WAIT_PRIVATE, s0, &ts, NULL, 0);
+#else
+        struct timespec tv;
+        clock_gettime(CLOCK_REALTIME, &tv);
+        tv.tv_sec  += (tv.tv_nsec + timeout_ns) / 1000000000L;
+        tv.tv_nsec  = (tv.tv_nsec + timeout_ns) % 1000000000L;
+        pthread_mutex_lock(&p->lock);
+        if (p->seq.load(std::memory_order_relaxed) == s0)
+            pthread_cond_timedwait(&p->cond, &p->lock, &tv);
+        pthread_mutex_unlock(&p->lock);
+#endif
+        const ticks slept = getticks() - now;
+        if (p->seq.load(std::memory_order_relaxed) != s0) {
+            if (slept < p->spinwin) {          // woken up soon, spin more
+                p->spinwin *= 2;
+                if (p->spinwin > p->spinmax) p->spinwin = p->spinmax;
+            }
+        } else {                               // timeout, spin less
+            p->spinwin /= 2;
+            if (p->spinwin < FF_SPIN_MIN_TICKS)
+                p->spinwin = (p->spinmax < FF_SPIN_MIN_TICKS) ? p->spinmax : FF_SPIN_MIN_TICKS;
+        }
+        ++p->nparks;
+    }
+    p->parked.store(0, std::memory_order_relaxed);
+    p->spun = 0;
+    p->last = getticks();
+#endif
+}
+
+static inline void ff_park_wait(pthread_mutex_t* m, pthread_cond_t* c) {
+    ff_park_wait(m, c, []() { return false; });
+}
+
+/*
+ * Producer side, called after a push in the consumer's channel.
+ * 'empty' tells whether the channel was empty before the push, it is
+ * used only by the plain condition variable protocol.
+ */
+static inline void ff_park_notify(pthread_cond_t* c, bool empty=true) {
+#if defined(FF_NO_HYBRID_WAIT)
+    if (empty) pthread_cond_signal(c);
+#else
+    FF_IGNORE_UNUSED(empty);
+    ff_parking_t* p = reinterpret_cast<ff_parking_t*>(c);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (p->parked.load(std::memory_order_relaxed)) {
+#if defined(__linux__)
+        p->seq.fetch_add(1, std::memory_order_release);
+        syscall(SYS_futex, reinterpret_cast<int*>(&p->seq), FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+#else
+        pthread_mutex_lock(&p->lock);
+        p->seq.fetch_add(1, std::memory_order_release);
+        pthread_cond_signal(&p->cond);
+        pthread_mutex_unlock(&p->lock);
+#endif
+    }
+#endif
+}
+
+} // namespace ff
+
+#endif /* FF_PARKING_HPP */
@@ -1411,7 +1411,7 @@ public:
          if (ff_node::blocking_out) {
          _retry:
              if (inbuffer->push(task)) {
-                 pthread_cond_signal(p_cons_c);
+                 ff_park_notify(p_cons_c);
                  return true;
              } 
              struct timespec tv;
@@ -1460,11 +1460,9 @@ public:
                 if ((*task != (void *)FF_EOS)) return true;
                 else return false;
             }
-            struct timespec tv;
-            timedwait_timeout(tv);
-            pthread_mutex_lock(cons_m);
-            pthread_cond_timedwait(cons_c, cons_m, &tv);
-            pthread_mutex_unlock(cons_m);
+            ff_park_wait(cons_m, cons_c,
+                         [outbuffer]() { return !outbuffer->empty(); },
+                         FF_PARK_TIMEOUT_NS);
             goto _retry;
         }
         for(unsigned long i=0;i<retry;++i) {
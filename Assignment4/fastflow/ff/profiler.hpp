@@ -0,0 +1,331 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+
+/*!
+ *  \link
+ *  \file profiler.hpp
+ *  \ingroup shared_memory_fastflow
+ *
+ *  \brief This file contains a low-overhead per-stage profiler for the
+ *  pipeline pattern (service time, throughput and channel occupancy).
+ */
+
+#ifndef FF_PROFILER_HPP
+#define FF_PROFILER_HPP
+
+/* ***************************************************************************
+ *
+ *  FastFlow is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License version 3 as
+ *  published by the Free Software Foundation.
+ *  Starting from version 3.0.1 FastFlow is dual licensed under the GNU LGPLv3
+ *  or MIT License (https://github.com/ParaGroup/WindFlow/blob/vers3.x/LICENSE.MIT)
+ *
+ *  This program is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ ****************************************************************************
+ */
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <chrono>
+#include <ostream>
+#include <iomanip>
+#include <ff/node.hpp>
+#include <ff/pipeline.hpp>
+#include <ff/farm.hpp>
+
+namespace ff {
+
+/*!
+ *  \ingroup shared_memory_fastflow
+ *
+ *  @{
+ */
+
+/*!
+ * \class ff_pipeline_profiler
+ * \ingroup shared_memory_fastflow
+ *
+ * \brief Per-stage profiler of a pipeline.
+ *
+ * Differently from the TRACE_FASTFLOW statistics it does not require to
+ * recompile the program: the counters (\ref ff_node_prof) are attached to
+ * the nodes of the pipeline only while the profiler exists.
+ * For each stage (nested pipelines are flattened) it measures:
+ *  - the number of tasks received and produced;
+ *  - the average svc time and the effective service time Ts, that is the
+ *    svc time divided by the number of workers for farm stages (the svc time
+ *    of the first stage is computed per produced task);
+ *  - the arrival rate (tasks per second produced by the previous stage) and
+ *    the throughput of the stage;
+ *  - the average and maximum occupancy of the input channel, i.e. the tasks
+ *    produced by the previous stage and not yet received by the stage,
+ *    sampled by a helper thread every \p period_ms milliseconds.
+ * The bottleneck is the stage with the highest Ts, the expected throughput
+ * of the pipeline is 1/Ts of the bottleneck.
+ *
+ * Farm stages are measured on their workers (emitter and collector are not
+ * accounted). All-to-all stages and farms whose workers are not sequential
+ * nodes are reported as not profiled.
+ *
+ * \code
+ *   ff_pipeline_profiler prof(pipe);
+ *   prof.start();
+ *   pipe.run_and_wait_end();
+ *   prof.stop();
+ *   prof.report(std::cout);
+ * \endcode
+ *
+ * start() has to be called before running the pipeline and the profiler has
+ * to live until the pipeline threads are terminated.
+ *
+ * This class is defined in \ref profiler.hpp
+ */
+class ff_pipeline_profiler {
+public:
+    struct stage_stats {
+        std::string   name;
+        size_t        nworkers   = 1;
+        bool          profiled   = true;
+        unsigned long ntasks     = 0;   // tasks received (svc calls)
+        unsigned long nouts      = 0;   // tasks produced
+        double        svctime_us = 0.0; // average svc time of one replica
+        double        ts_us      = 0.0; // effective service time
+        double        arrival    = 0.0; // tasks per second in input
+        double        throughput = 0.0; // tasks per second
+        double        qlen_avg   = 0.0; // input channel occupancy
+        unsigned long qlen_max   = 0;
+    };
+
+    ff_pipeline_profiler(ff_pipeline& pipe, double period_ms=10.0):
+        period_ms(period_ms) {
+        flatten(pipe);
+    }
+    ~ff_pipeline_profiler() {
+        stop();
+        for(size_t i=0;i<stages.size();++i)
+            for(size_t j=0;j<stages[i].nodes.size();++j)
+                stages[i].nodes[j]->prof = nullptr;
+    }
+
+    ff_pipeline_profiler(const ff_pipeline_profiler&) = delete;
+    ff_pipeline_profiler& operator=(const ff_pipeline_profiler&) = delete;
+
+    /**
+     * It resets and attaches the counters and starts the sampling thread.
+     *
+     * \return 0 on success, -1 if the profiler is already running
+     */
+    int start() {
+        if (running) return -1;
+        for(size_t i=0;i<stages.size();++i) {
+            stage_t& s = stages[i];
+            s.counters.clear();
+            for(size_t j=0;j<s.nodes.size();++j) {
+                s.counters.push_back(std::unique_ptr<ff_node_prof>(new ff_node_prof));
+                s.nodes[j]->prof = s.counters.back().get();
+            }
+            s.qsum = 0; s.qmax = 0;
+        }
+        nsamples = 0;
+        t0 = std::chrono::steady_clock::now(); tk0 = getticks();
+        running = true;
+        sampler = std::thread([this]() {
+            while(running) {
+                std::this_thread::sleep_for(std::chrono::microseconds((long)(period_ms*1000)));
+                sample();
+            }
+        });
+        return 0;
+    }
+
+    // It stops the sampling thread and freezes the statistics.
+    void stop() {
+        if (!running) return;
+        running = false;
+        sampler.join();
+        t1 = std::chrono::steady_clock::now(); tk1 = getticks();
+        last = compute(t1, tk1);
+    }
+
+    // per-stage statistics, computed on the fly if the profiler is running
+    std::vector<stage_stats> stats() const {
+        if (!running) return last;
+        return compute(std::chrono::steady_clock::now(), getticks());
+    }
+
+    // index of the bottleneck stage, -1 if no stage has been profiled
+    ssize_t bottleneck() const { return bottleneck(stats()); }
+
+    // throughput (tasks/s) the pipeline should reach, i.e. 1/Ts of the bottleneck
+    double expected_throughput() const {
+        const std::vector<stage_stats> s = stats();
+        const ssize_t b = bottleneck(s);
+        return (b<0 || s[b].ts_us<=0.0) ? 0.0 : 1e6/s[b].ts_us;
+    }
+    // throughput (tasks/s) measured at the last stage
+    double achieved_throughput() const {
+        const std::vector<stage_stats> s = stats();
+        return s.size() ? s.back().throughput : 0.0;
+    }
+
+    void report(std::ostream& out) const {
+        const std::vector<stage_stats> s = stats();
+        const ssize_t b = bottleneck(s);
+        // the format of the caller's stream is restored at the end
+        const std::ios_base::fmtflags flags = out.flags();
+        const std::streamsize         prec  = out.precision();
+        out << "stage                      tasks       outs   svc(us)    Ts(us)  arr(t/s)  thr(t/s)  qlen avg/max\n";
+        for(size_t i=0;i<s.size();++i) {
+            out << std::setw(2) << i << (((ssize_t)i==b)?"*":" ")
+                << std::left << std::setw(20) << s[i].name << std::right;
+            if (!s[i].profiled) { out << "  not profiled\n"; continue; }
+            out << std::fixed << std::setprecision(2)
+                << std::setw(10) << s[i].ntasks << std::setw(11) << s[i].nouts
+                << std::setw(10) << s[i].svctime_us << std::setw(10) << s[i].ts_us
+                << std::setw(10) << s[i].arrival << std::setw(10) << s[i].throughput
+                << std::setw(9)  << s[i].qlen_avg << "/" << s[i].qlen_max << "\n";
+        }
+        if (b>=0)
+            out << "bottleneck: stage " << b << " (" << s[b].name << ")"
+                << ", expected throughput " << expected_throughput()
+                << " t/s, achieved " << achieved_throughput() << " t/s\n";
+        out.flags(flags);
+        out.precision(prec);
+    }
+
+protected:
+    struct stage_t {
+        std::string                                name;
+        bool                                       isfarm   = false;
+        bool                                       profiled = true;
+        std::vector<ff_node*>                      nodes;
+        std::vector<std::unique_ptr<ff_node_prof>> counters;
+        double                                     qsum = 0;
+        unsigned long                              qmax = 0;
+    };
+
+    static bool sequential(ff_node* n) {
+        return !(n->isPipe() || n->isFarm() || n->isAll2All());
+    }
+
+    void flatten(ff_pipeline& pipe) {
+        const svector<ff_node*>& list = pipe.getStages();
+        for(size_t i=0;i<list.size();++i) {
+            ff_node* n = list[i];
+            if (n->isPipe()) { flatten(*reinterpret_cast<ff_pipeline*>(n)); continue; }
+            stage_t s;
+            if (n->isFarm()) {
+                const svector<ff_node*>& w = reinterpret_cast<ff_farm*>(n)->getWorkers();
+                s.isfarm = true;
+                s.name   = "farm(" + std::to_string(w.size()) + ")";
+                for(size_t j=0;j<w.size();++j) {
+                    if (!sequential(w[j])) s.profiled = false;
+                    s.nodes.push_back(w[j]);
+                }
+            } else if (n->isAll2All()) {
+                s.name = "a2a";
+                s.profiled = false;
+            } else {
+                s.name = n->isComp() ? "comp" : "node";
+                s.nodes.push_back(n);
+            }
+            if (!s.profiled) s.nodes.clear();
+            stages.push_back(std::move(s));
+        }
+    }
+
+    void totals(const stage_t& s, unsigned long& ntasks, unsigned long& nouts,
+                unsigned long long& svcticks) const {
+        ntasks = nouts = 0; svcticks = 0;
+        for(size_t j=0;j<s.counters.size();++j) {
+            ntasks   += s.counters[j]->ntasks.load(std::memory_order_relaxed);
+            nouts    += s.counters[j]->nouts.load(std::memory_order_relaxed);
+            svcticks += s.counters[j]->svcticks.load(std::memory_order_relaxed);
+        }
+    }
+
+    void sample() {
+        std::lock_guard<std::mutex> lk(mtx);
+        unsigned long prevouts = 0, ntasks, nouts;
+        unsigned long long svcticks;
+        for(size_t i=0;i<stages.size();++i) {
+            totals(stages[i], ntasks, nouts, svcticks);
+            if (i>0 && stages[i].profiled && stages[i-1].profiled) {
+                const unsigned long q = (prevouts>ntasks) ? prevouts-ntasks : 0;
+                stages[i].qsum += q;
+                stages[i].qmax  = (std::max)(stages[i].qmax, q);
+            }
+            prevouts = nouts;
+        }
+        ++nsamples;
+    }
+
+    std::vector<stage_stats> compute(std::chrono::steady_clock::time_point now, ticks tknow) const {
+        std::lock_guard<std::mutex> lk(mtx);
+        const double secs = std::chrono::duration<double>(now-t0).count();
+        const double tps  = (secs>0.0) ? (double)(tknow-tk0)/secs : 0.0;
+        std::vector<stage_stats> r(stages.size());
+        unsigned long prevouts = 0;
+        for(size_t i=0;i<stages.size();++i) {
+            const stage_t& s = stages[i];
+            stage_stats& st  = r[i];
+            st.name     = s.name;
+            st.nworkers = s.isfarm ? s.nodes.size() : 1;
+            st.profiled = s.profiled;
+            if (!s.profiled) { prevouts = 0; continue; }
+            unsigned long long svcticks;
+            totals(s, st.ntasks, st.nouts, svcticks);
+            if (i>0 && secs>0.0) st.arrival = prevouts/secs;
+            prevouts = st.nouts;
+            // the first stage usually produces all its tasks in a few svc calls
+            const unsigned long n = (i==0 && st.nouts>st.ntasks) ? st.nouts : st.ntasks;
+            if (n>0 && tps>0.0) st.svctime_us = ((double)svcticks/n)/tps*1e6;
+            st.ts_us      = st.svctime_us/st.nworkers;
+            st.throughput = (secs>0.0) ? ((i==0 ? st.nouts : st.ntasks)/secs) : 0.0;
+            if (nsamples) st.qlen_avg = s.qsum/nsamples;
+            st.qlen_max = s.qmax;
+        }
+        return r;
+    }
+
+    static ssize_t bottleneck(const std::vector<stage_stats>& s) {
+        ssize_t b = -1;
+        for(size_t i=0;i<s.size();++i) {
+            if (!s[i].profiled || s[i].ts_us<=0.0) continue;
+            if (b<0 || s[i].ts_us > s[b].ts_us) b = i;
+        }
+        return b;
+    }
+
+protected:
+    const double                          period_ms;
+    std::vector<stage_t>                  stages;
+    std::vector<stage_stats>              last;
+    mutable std::mutex                    mtx;
+    std::thread                           sampler;
+    std::atomic<bool>                     running{false};
+    size_t                                nsamples = 0;
+    std::chrono::steady_clock::time_point t0, t1;
+    ticks                                 tk0 = 0, tk1 = 0;
+};
+
+/*!
+ *
+ * @}
+ * \link
+ */
+
+} // namespace ff
+
+#endif /* FF_PROFILER_HPP */
@@ -0,0 +1,316 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+
+/*!
+ *  \link
+ *  \file qtuner.hpp
+ *  \ingroup shared_memory_fastflow
+ *
+ *  \brief This file contains a run-time controller of the capacity of the
+ *  bounded channels of a pipeline.
+ */
+
+#ifndef FF_QTUNER_HPP
+#define FF_QTUNER_HPP
+
+/* ***************************************************************************
+ *
+ *  FastFlow is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License version 3 as
+ *  published by the Free Software Foundation.
+ *  Starting from version 3.0.1 FastFlow is dual licensed under the GNU LGPLv3
+ *  or MIT License (https://github.com/ParaGroup/WindFlow/blob/vers3.x/LICENSE.MIT)
+ *
+ *  This program is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ ****************************************************************************
+ */
+
+#include <vector>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <chrono>
+#include <atomic>
+#include <ostream>
+#include <ff/node.hpp>
+#include <ff/pipeline.hpp>
+#include <ff/farm.hpp>
+
+namespace ff {
+
+/*!
+ *  \ingroup shared_memory_fastflow
+ *
+ *  @{
+ */
+
+/*!
+ * \class ff_queue_tuner
+ * \ingroup shared_memory_fastflow
+ *
+ * \brief Automatic tuning of the capacity of the bounded channels.
+ *
+ * A helper thread samples, every \p period_ms milliseconds, the occupancy
+ * of the channels and the number of pushes failed because the channel was
+ * full (i.e. producer stalls). Every FF_QTUNER_WINDOW samples, for each
+ * channel:
+ *  - if the producer has stalled, the capacity is doubled (up to
+ *    FF_QTUNER_MAX_SIZE);
+ *  - if there have been no stalls for FF_QTUNER_QUIET windows and the
+ *    channel has never been filled above 1/8 of its capacity, the capacity
+ *    is halved (down to FF_QTUNER_MIN_SIZE), this reduces the cache
+ *    footprint of the channel.
+ * The channels are resized with uSWSR_Ptr_Buffer::resize, that can be used
+ * while the channel is in use (change_inputqueuesize/change_outputqueuesize
+ * cannot). Unbounded channels are not touched.
+ *
+ * Each decision is logged (see decisions and report), print_config writes
+ * the last capacity of each channel so that it can be set statically.
+ *
+ * The channels tuned are the input channels of the stages of the pipeline
+ * (nested pipelines are flattened) and, for farm stages, the input and
+ * output channels of the workers. The channels of the workers are not
+ * tuned if the farm uses the on-demand scheduling (their capacity is the
+ * scheduling policy, a full channel is not a stall), the ordering, the
+ * work-stealing or the batching. Other channels can be added with add.
+ *
+ * \code
+ *   ff_queue_tuner tuner(pipe);
+ *   pipe.run();
+ *   tuner.start();
+ *   pipe.wait();
+ *   tuner.stop();
+ *   tuner.report(std::cout);
+ * \endcode
+ *
+ * start() has to be called after the channels have been created (i.e. after
+ * run) and the tuner has to be stopped before the pipeline is deleted.
+ *
+ * This class is defined in \ref qtuner.hpp
+ */
+class ff_queue_tuner {
+public:
+    struct decision {
+        double        time_ms;  // since start
+        std::string   channel;
+        size_t        oldsz;
+        size_t        newsz;
+        unsigned long nfull;    // pushes failed in the last window
+        unsigned long qmax;     // max occupancy in the last window
+    };
+
+    ff_queue_tuner(ff_pipeline& pipe, double period_ms=FF_QTUNER_PERIOD_MS):
+        period_ms(period_ms) {
+        flatten(pipe);
+    }
+    ~ff_queue_tuner() { stop(); }
+
+    ff_queue_tuner(const ff_queue_tuner&) = delete;
+    ff_queue_tuner& operator=(const ff_queue_tuner&) = delete;
+
+    /**
+     * It adds the input (\p input true) or the output channel of \p n.
+     * It cannot be called while the tuner is running.
+     */
+    void add(ff_node* n, bool input, const std::string& name) {
+        if (running) return;
+        channel_t c;
+        c.node = n; c.input = input; c.name = name;
+        channels.push_back(c);
+    }
+
+    /**
+     * It starts the helper thread.
+     *
+     * \return 0 on success, -1 if the tuner is already running
+     */
+    int start() {
+        if (running) return -1;
+        for(size_t i=0;i<channels.size();++i) {
+            channel_t& c = channels[i];
+            c.buffer = c.input ? c.node->get_in_buffer() : c.node->get_out_buffer();
+            c.tunable  = c.buffer && tunable(c.buffer, 0);
+            c.reqsize  = c.tunable ? capacity(c.buffer, 0) : 0;
+            c.lastfull = c.tunable ? full_count(c.buffer, 0) : 0;
+            c.qmax = 0; c.quiet = 0;
+        }
+        nsamples = 0;
+        t0 = std::chrono::steady_clock::now();
+        running = true;
+        controller = std::thread([this]() {
+            while(running) {
+                std::this_thread::sleep_for(std::chrono::microseconds((long)(period_ms*1000)));
+                sample();
+            }
+        });
+        return 0;
+    }
+
+    // It stops the helper thread, the channels keep their current capacity.
+    void stop() {
+        if (!running) return;
+        running = false;
+        controller.join();
+    }
+
+    // decisions taken so far
+    std::vector<decision> decisions() const {
+        std::lock_guard<std::mutex> lk(mtx);
+        return log;
+    }
+
+    // current capacity of each tunable channel
+    std::vector<std::pair<std::string,size_t> > capacities() const {
+        std::lock_guard<std::mutex> lk(mtx);
+        std::vector<std::pair<std::string,size_t> > r;
+        for(size_t i=0;i<channels.size();++i)
+            if (channels[i].tunable)
+                r.push_back(std::make_pair(channels[i].name, channels[i].reqsize));
+        return r;
+    }
+
+    void report(std::ostream& out) const {
+        const std::vector<decision> d = decisions();
+        for(size_t i=0;i<d.size();++i)
+            out << "qtuner: " << d[i].time_ms << " ms " << d[i].channel << " "
+                << d[i].oldsz << " -> " << d[i].newsz
+                << " (full " << d[i].nfull << ", max occupancy " << d[i].qmax << ")\n";
+    }
+
+    // false if the channels (FFBUFFER) cannot be tuned
+    static bool supported() { return resizable((FFBUFFER*)nullptr, 0); }
+
+    // one line per channel: <channel> <capacity>
+    void print_config(std::ostream& out) const {
+        const std::vector<std::pair<std::string,size_t> > c = capacities();
+        for(size_t i=0;i<c.size();++i)
+            out << c[i].first << " " << c[i].second << "\n";
+    }
+
+protected:
+    struct channel_t {
+        ff_node*      node    = nullptr;
+        bool          input   = true;
+        std::string   name;
+        FFBUFFER*     buffer  = nullptr;
+        bool          tunable = false;
+        size_t        reqsize = 0;      // current (or last requested) capacity
+        unsigned long lastfull= 0;
+        unsigned long qmax    = 0;
+        size_t        quiet   = 0;      // windows without stalls
+    };
+
+    // only the bounded uSWSR_Ptr_Buffer can be resized while in use
+    template<typename B>
+    static auto resizable(B* b, int) -> decltype(b->resize(0), b->occupancy(), b->capacity(), bool()) { return true; }
+    template<typename B>
+    static bool resizable(B*, long) { return false; }
+    template<typename B>
+    static bool tunable(B* b, int) { return resizable(b, 0) && b->isFixedSize(); }
+    template<typename B>
+    static auto full_count(B* b, int) -> decltype(b->full_count()) { return b->full_count(); }
+    template<typename B>
+    static unsigned long full_count(B*, long) { return 0; }
+    template<typename B>
+    static auto capacity(B* b, int) -> decltype(b->capacity()) { return b->capacity(); }
+    template<typename B>
+    static size_t capacity(B*, long) { return 0; }
+    template<typename B>
+    static auto occupancy(B* b, int) -> decltype(b->occupancy()) { return b->occupancy(); }
+    template<typename B>
+    static unsigned long occupancy(B*, long) { return 0; }
+    template<typename B>
+    static auto resize(B* b, size_t sz, int) -> decltype(b->resize(sz)) { return b->resize(sz); }
+    template<typename B>
+    static bool resize(B*, size_t, long) { return false; }
+
+    void flatten(ff_pipeline& pipe) {
+        const svector<ff_node*>& list = pipe.getStages();
+        for(size_t i=0;i<list.size();++i) {
+            ff_node* n = list[i];
+            if (n->isPipe()) { flatten(*reinterpret_cast<ff_pipeline*>(n)); continue; }
+            const std::string s = "stage" + std::to_string(nstages++);
+            if (n->isFarm()) {
+                add(n, true, s + ".in");
+                const ff_farm* farm = reinterpret_cast<ff_farm*>(n);
+                if (farm->ondemand_buffer()>0 || farm->isOFarm() ||
+                    farm->stealing_enabled() || farm->batching_size()>0) continue;
+                const svector<ff_node*>& w = farm->getWorkers();
+                for(size_t j=0;j<w.size();++j) {
+                    if (w[j]->isPipe() || w[j]->isFarm() || w[j]->isAll2All()) continue;
+                    add(w[j], true,  s + ".worker" + std::to_string(j) + ".in");
+                    add(w[j], false, s + ".worker" + std::to_string(j) + ".out");
+                }
+            } else if (!n->isAll2All()) {
+                add(n, true, s + ".in");
+            }
+        }
+    }
+
+    void sample() {
+        std::lock_guard<std::mutex> lk(mtx);
+        ++nsamples;
+        for(size_t i=0;i<channels.size();++i) {
+            channel_t& c = channels[i];
+            if (!c.tunable) continue;
+            // not length(): the internal buffers belong to the producer
+            // and to the consumer, the counters can be read by anyone
+            const unsigned long q = occupancy(c.buffer, 0);
+            if (q > c.qmax) c.qmax = q;
+        }
+        if (nsamples % FF_QTUNER_WINDOW) return;
+        const double now = std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now()-t0).count();
+        for(size_t i=0;i<channels.size();++i) {
+            channel_t& c = channels[i];
+            if (!c.tunable) continue;
+            const unsigned long f     = full_count(c.buffer, 0);
+            const unsigned long nfull = f - c.lastfull;
+            const size_t        sz    = c.reqsize;
+            size_t newsz = sz;
+            if (nfull > 0) {
+                c.quiet = 0;
+                if (2*sz <= FF_QTUNER_MAX_SIZE) newsz = 2*sz;
+            } else if (++c.quiet >= FF_QTUNER_QUIET && c.qmax < sz/8) {
+                if (sz/2 >= FF_QTUNER_MIN_SIZE) newsz = sz/2;
+                c.quiet = 0;
+            }
+            if (newsz != sz && resize(c.buffer, newsz, 0)) {
+                decision d;
+                d.time_ms = now; d.channel = c.name;
+                d.oldsz = sz; d.newsz = newsz; d.nfull = nfull; d.qmax = c.qmax;
+                log.push_back(d);
+                c.reqsize = newsz;
+            }
+            c.lastfull = f;
+            c.qmax     = 0;
+        }
+    }
+
+protected:
+    const double                          period_ms;
+    std::vector<channel_t>                channels;
+    std::vector<decision>                 log;
+    mutable std::mutex                    mtx;
+    std::thread                           controller;
+    std::atomic<bool>                     running{false};
+    size_t                                nstages  = 0;
+    size_t                                nsamples = 0;
+    std::chrono::steady_clock::time_point t0;
+};
+
+/*!
+ *
+ * @}
+ * \link
+ */
+
+} // namespace ff
+
+#endif /* FF_QTUNER_HPP */
@@ -0,0 +1,218 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*!
+ *  \file ringmem.hpp
+ *  \ingroup building_blocks
+ *
+ *  \brief Memory of the rings of the SPSC channels: huge pages and NUMA
+ *  placement.
+ */
+
+/* ***************************************************************************
+ *
+ *  FastFlow is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License version 3 as
+ *  published by the Free Software Foundation.
+ *  Starting from version 3.0.1 FastFlow is dual licensed under the GNU LGPLv3
+ *  or MIT License (https://github.com/ParaGroup/WindFlow/blob/vers3.x/LICENSE.MIT)
+ *
+ *  This program is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ ****************************************************************************
+ */
+
+/*
+ * The rings of the channels are allocated by the thread that builds the
+ * graph, before the threads are mapped onto the cores, so by default they
+ * all end up on the NUMA node of the main thread and on small pages.
+ *
+ *  - FF_RING_HUGEPAGES: the rings are allocated with mmap on huge pages
+ *    (MAP_HUGETLB if there are huge pages reserved, otherwise transparent
+ *    huge pages). Each ring takes at least FF_HUGEPAGE_SIZE bytes, so it is
+ *    worth only for big rings or few channels.
+ *  - FF_RING_NUMA: the rings are allocated with mmap (on their own pages)
+ *    and, at run() time, each consumer thread, once it has been mapped onto
+ *    its core(s), moves the rings of its input channels to its NUMA node
+ *    (mbind with MPOL_MF_MOVE). The pages are moved without changing their
+ *    address, so it does not matter if the producer is already pushing.
+ *    The rings allocated later (uSWSR_Ptr_Buffer growing) are placed on the
+ *    same node. A thread whose affinity mask spans more than one NUMA node
+ *    leaves its rings where they are.
+ *
+ * Both are Linux only, elsewhere the rings are allocated as usual. No
+ * library is needed (the mbind system call is used directly).
+ *
+ */
+
+#ifndef FF_RINGMEM_HPP
+#define FF_RINGMEM_HPP
+
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+#include <ff/sysdep.h>
+#include <ff/config.hpp>
+#if defined(__linux__)
+#include <sched.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+#if defined(__linux__) && (defined(FF_RING_HUGEPAGES) || defined(FF_RING_NUMA))
+#define FF_RING_MMAP 1
+#endif
+
+namespace ff {
+
+/*
+ * It allocates a ring of \p bytes bytes aligned at least to \p align,
+ * \p mapped is set to the size to give back to ff_ring_free.
+ */
+static inline void* ff_ring_alloc(size_t align, size_t bytes, size_t& mapped) {
+#if defined(FF_RING_MMAP)
+    FF_IGNORE_UNUSED(align);
+#if defined(FF_RING_HUGEPAGES)
+    const size_t pg = FF_HUGEPAGE_SIZE;
+#else
+    const size_t pg = sysconf(_SC_PAGESIZE);
+#endif
+    mapped = (bytes + pg - 1) / pg * pg;
+    void* p;
+#if defined(FF_RING_HUGEPAGES) && defined(MAP_HUGETLB)
+    p = mmap(NULL, mapped, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB, -1, 0);
+    if (p != MAP_FAILED) return p;
+#endif
+#if defined(FF_RING_HUGEPAGES)
+    // no huge pages reserved: transparent huge pages, the area has to be
+    // aligned to the huge page size
+    p = mmap(NULL, mapped + pg, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) return NULL;
+    char* q = (char*)p;
+    char* a = (char*)(((uintptr_t)q + pg - 1) & ~(uintptr_t)(pg - 1));
+    if (a > q) munmap(q, a - q);
+    if (q + pg > a) munmap(a + mapped, q + pg - a);
+#if defined(MADV_HUGEPAGE)
+    madvise(a, mapped, MADV_HUGEPAGE);
+#endif
+    return a;
+#else
+    p = mmap(NULL, mapped, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    return (p == MAP_FAILED) ? NULL : p;
+#endif
+#else
+    mapped = bytes;
+    return getAlignedMemory(align, bytes);
+#endif
+}
+
+static inline void ff_ring_free(void* p, size_t mapped) {
+    if (!p) return;
+#if defined(FF_RING_MMAP)
+    munmap(p, mapped);
+#else
+    FF_IGNORE_UNUSED(mapped);
+    freeAlignedMemory(p);
+#endif
+}
+
+/*
+ * It moves the pages of a ring allocated by ff_ring_alloc to the NUMA node
+ * \p node. It returns false if the pages cannot be moved (or the rings are
+ * not allocated on their own pages).
+ */
+static inline bool ff_ring_bind(void* p, size_t mapped, int node) {
+#if defined(FF_RING_MMAP) && defined(SYS_mbind)
+    const int MPOL_PREFERRED_ = 1;
+    const int MPOL_MF_MOVE_   = (1<<1);
+    const size_t bits = 8*sizeof(unsigned long);
+    if (!p || node < 0 || node >= FF_NUMA_MAX_NODES) return false;
+    unsigned long mask[(FF_NUMA_MAX_NODES + bits - 1) / bits] = {0};
+    mask[node / bits] = 1UL << (node % bits);
+    return syscall(SYS_mbind, p, mapped, MPOL_PREFERRED_, mask,
+                   (unsigned long)FF_NUMA_MAX_NODES + 1, MPOL_MF_MOVE_) == 0;
+#else
+    FF_IGNORE_UNUSED(p); FF_IGNORE_UNUSED(mapped); FF_IGNORE_UNUSED(node);
+    return false;
+#endif
+}
+
+/*
+ * NUMA node of the core \p cpu, -1 if it is not known.
+ */
+static inline int ff_cpu_numanode(int cpu) {
+#if defined(__linux__)
+    // read once from sysfs: /sys/devices/system/cpu/cpuN/nodeM
+    static const std::vector<int> table = []() {
+        std::vector<int> t;
+        const long ncpus = sysconf(_SC_NPROCESSORS_CONF);
+        for(long i=0;i<ncpus;++i) {
+            int n = -1;
+            char path[64];
+            snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%ld", i);
+            DIR* d = opendir(path);
+            if (d) {
+                struct dirent* e;
+                while((e = readdir(d)))
+                    if (sscanf(e->d_name, "node%d", &n) == 1) break;
+                closedir(d);
+            }
+            t.push_back(n);
+        }
+        return t;
+    }();
+    return (cpu >= 0 && cpu < (int)table.size()) ? table[cpu] : -1;
+#else
+    FF_IGNORE_UNUSED(cpu);
+    return -1;
+#endif
+}
+
+/*
+ * NUMA node of the calling thread, -1 if its affinity mask spans more than
+ * one node (or it is not known).
+ */
+static inline int ff_my_numanode() {
+#if defined(__linux__) && defined(CPU_SET)
+    cpu_set_t mask;
+    CPU_ZERO(&mask);
+    if (sched_getaffinity(0, sizeof(mask), &mask) != 0) return -1;
+    int node = -1;
+    for(int i=0;i<CPU_SETSIZE;++i) {
+        if (!CPU_ISSET(i, &mask)) continue;
+        const int n = ff_cpu_numanode(i);
+        if (n < 0 || (node >= 0 && n != node)) return -1;
+        node = n;
+    }
+    return node;
+#else
+    return -1;
+#endif
+}
+
+/*
+ * It places the ring(s) of the channel \p b on the NUMA node \p node, if
+ * the channel supports it (see SWSR_Ptr_Buffer::place).
+ */
+template<typename B>
+static inline auto ff_place_ring(B* b, int node, int) -> decltype(b->place(node), bool()) {
+    return b->place(node);
+}
+template<typename B>
+static inline bool ff_place_ring(B*, int, long) { return false; }
+template<typename B>
+static inline bool ff_place_ring(B* b, int node) {
+    return b && node >= 0 && ff_place_ring(b, node, 0);
+}
+
+} // namespace ff
+
+#endif /* FF_RINGMEM_HPP */
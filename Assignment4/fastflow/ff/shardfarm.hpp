@@ -0,0 +1,254 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+
+/*!
+ *  \link
+ *  \file shardfarm.hpp
+ *  \ingroup building_blocks
+ *
+ *  \brief This file contains a farm whose Emitter and Collector are split
+ *  in shards, each one serving a subset of the workers.
+ */
+
+#ifndef FF_SHARDFARM_HPP
+#define FF_SHARDFARM_HPP
+
+/* ***************************************************************************
+ *
+ *  FastFlow is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License version 3 as
+ *  published by the Free Software Foundation.
+ *  Starting from version 3.0.1 FastFlow is dual licensed under the GNU LGPLv3
+ *  or MIT License (https://github.com/ParaGroup/WindFlow/blob/vers3.x/LICENSE.MIT)
+ *
+ *  This program is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ ****************************************************************************
+ */
+
+#include <vector>
+#include <ff/node.hpp>
+#include <ff/farm.hpp>
+
+namespace ff {
+
+/*!
+ *  \ingroup building_blocks
+ *
+ *  @{
+ */
+
+/*!
+ * \class ff_sharded_farm
+ * \ingroup building_blocks
+ *
+ * \brief A farm with S Emitters and S Collectors.
+ *
+ * In a farm every task goes through the Emitter thread and every result
+ * through the Collector thread, with cheap workers they limit the
+ * throughput. The sharded farm has S shards, each one a farm with its own
+ * Emitter, Collector and a subset of the workers (the workers are split
+ * in S contiguous blocks):
+ *
+ * \code
+ *                   | -> E0 -> W0..Wk -> C0 -> |
+ *   input -> split -|          ...             |- merge -> output
+ *                   | -> Es -> ....Wn -> Cs -> |
+ * \endcode
+ *
+ * It is used as a farm: it has one input and one output channel and can
+ * be a stage of a pipeline or be run alone.
+ *
+ *  - If it has an input channel, split sends the tasks round-robin to the
+ *    shards (the next one if the channel is full) and merge gathers the
+ *    results of the shards, a pop and a push per task over S channels.
+ *    Everything else (the user Emitter, the scheduling among the workers,
+ *    the polling of the workers' channels, the user Collector) is done by
+ *    the shards in parallel.
+ *  - If it is the first stage, each shard Emitter is a source: its svc is
+ *    called once with nullptr and it sends its part of the stream with
+ *    ff_send_out. split only sends the EOS.
+ *  - If it is the last stage and the Collectors of the shards return
+ *    GO_ON, merge receives only the EOS.
+ *
+ * So in the first and in the last stage there is no thread that sees all
+ * the tasks. There is no order among the results of different shards.
+ *
+ * \code
+ *   ff_sharded_farm farm(4);
+ *   farm.add_emitters(E);     // 4 Emitters (optional)
+ *   farm.add_workers(W);      // at least 4 workers
+ *   farm.add_collectors(C);   // 4 Collectors (optional)
+ *   farm.run_and_wait_end();
+ * \endcode
+ *
+ * The ids seen by the Emitter of a shard (e.g. in ff_send_out_to) are the
+ * positions of the workers in the shard. Each shard is an ff_farm
+ * (see getShard), e.g. to set its scheduling policy.
+ *
+ * This class is defined in \ref shardfarm.hpp
+ */
+class ff_sharded_farm: public ff_farm {
+protected:
+    /*
+     * A shard, its Emitter skips the first pop if the sharded farm is the
+     * first stage.
+     */
+    struct shard_t: ff_farm {
+        shard_t(ff_sharded_farm* parent):parent(parent) {}
+
+        int run(bool skip_init=false) {
+            if (parent->source && getEmitter()) ff_farm::getlb()->skipfirstpop(true);
+            return ff_farm::run(skip_init);
+        }
+        ff_sharded_farm* const parent;
+    };
+
+    /*
+     * The Emitter of the sharded farm, it forwards the input tasks. It is
+     * called with nullptr only if there is no input, then it sends the EOS.
+     */
+    struct split_t: ff_node {
+        void* svc(void* t) { return t ? t : FF_EOS; }
+    };
+
+public:
+    /**
+     * \p nshards is the number of shards, each one has at least one worker.
+     */
+    ff_sharded_farm(size_t nshards) {
+        if (nshards == 0) nshards = 1;
+        std::vector<ff_node*> S;
+        for(size_t i=0;i<nshards;++i) {
+            shard_t* s = new shard_t(this);
+            s->add_collector(nullptr);
+            shards.push_back(s);
+            S.push_back(s);
+        }
+        ff_farm::add_emitter(&split);
+        ff_farm::add_workers(S);
+        ff_farm::add_collector(nullptr);
+    }
+
+    virtual ~ff_sharded_farm() {
+        for(size_t i=0;i<shards.size();++i) delete shards[i];
+        shards.clear();
+    }
+
+    ff_sharded_farm(const ff_sharded_farm&) = delete;
+    ff_sharded_farm& operator=(const ff_sharded_farm&) = delete;
+
+    /**
+     * It adds the Emitters of the shards, one per shard.
+     *
+     * \return 0 on success, -1 otherwise
+     */
+    int add_emitters(const std::vector<ff_node*>& E) {
+        if (E.size() != shards.size()) {
+            error("SHARDED FARM, add_emitters: %ld Emitters for %ld shards\n", E.size(), shards.size());
+            return -1;
+        }
+        for(size_t i=0;i<shards.size();++i)
+            if (shards[i]->add_emitter(E[i])<0) return -1;
+        return 0;
+    }
+
+    /**
+     * It adds the workers, the first block of workers.size()/S goes to
+     * the first shard and so on (the first workers.size()%S shards have
+     * one more worker).
+     *
+     * \return 0 on success, -1 otherwise
+     */
+    int add_workers(const std::vector<ff_node*>& W) {
+        const size_t ns = shards.size();
+        if (W.size() < ns) {
+            error("SHARDED FARM, add_workers: %ld workers for %ld shards\n", W.size(), ns);
+            return -1;
+        }
+        if (nworkers) {
+            error("SHARDED FARM, add_workers: workers already present\n");
+            return -1;
+        }
+        size_t k = 0;
+        for(size_t i=0;i<ns;++i) {
+            const size_t n = W.size()/ns + (i < W.size()%ns ? 1 : 0);
+            std::vector<ff_node*> w(W.begin()+k, W.begin()+k+n);
+            if (shards[i]->add_workers(w)<0) return -1;
+            k += n;
+        }
+        nworkers = W.size();
+        return 0;
+    }
+
+    /**
+     * It adds the Collectors of the shards, one per shard, by default they
+     * forward the results.
+     *
+     * \return 0 on success, -1 otherwise
+     */
+    int add_collectors(const std::vector<ff_node*>& C) {
+        if (C.size() != shards.size()) {
+            error("SHARDED FARM, add_collectors: %ld Collectors for %ld shards\n", C.size(), shards.size());
+            return -1;
+        }
+        for(size_t i=0;i<shards.size();++i)
+            if (shards[i]->add_collector(C[i])<0) return -1;
+        return 0;
+    }
+
+    // the following ones are applied to all the shards
+
+    void set_scheduling_ondemand(const int inbufferentries=1) {
+        for(size_t i=0;i<shards.size();++i) shards[i]->set_scheduling_ondemand(inbufferentries);
+    }
+    void cleanup_workers(bool onoff=true) {
+        for(size_t i=0;i<shards.size();++i) shards[i]->cleanup_workers(onoff);
+    }
+    void cleanup_emitter(bool onoff=true) {
+        for(size_t i=0;i<shards.size();++i) shards[i]->cleanup_emitter(onoff);
+    }
+    void cleanup_collector(bool onoff=true) {
+        for(size_t i=0;i<shards.size();++i) shards[i]->cleanup_collector(onoff);
+    }
+    void cleanup_all() {
+        for(size_t i=0;i<shards.size();++i) shards[i]->cleanup_all();
+    }
+
+    int run(bool skip_init=false) {
+        if (!skip_init) source = !has_input_channel;
+        return ff_farm::run(skip_init);
+    }
+
+    // called by the pipeline, \p sk is true if it is the first stage
+    inline void skipfirstpop(bool sk) {
+        source = sk;
+        ff_farm::skipfirstpop(sk);
+    }
+
+    size_t getNWorkers() const { return nworkers; }
+    size_t getNShards()  const { return shards.size(); }
+    ff_farm* getShard(size_t i) { return (i < shards.size()) ? shards[i] : nullptr; }
+
+protected:
+    std::vector<shard_t*> shards;
+    split_t               split;
+    size_t                nworkers = 0;
+    bool                  source   = false;
+};
+
+/*!
+ *
+ * @}
+ * \link
+ */
+
+} // namespace ff
+
+#endif /* FF_SHARDFARM_HPP */
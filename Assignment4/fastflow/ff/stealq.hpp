@@ -0,0 +1,279 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*!
+ *  \file stealq.hpp
+ *  \ingroup building_blocks
+ *
+ *  \brief Input queues of the farm's workers when work-stealing is enabled.
+ */
+
+/* ***************************************************************************
+ *
+ *  FastFlow is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License version 3 as
+ *  published by the Free Software Foundation.
+ *  Starting from version 3.0.1 FastFlow is dual licensed under the GNU LGPLv3
+ *  or MIT License (https://github.com/ParaGroup/WindFlow/blob/vers3.x/LICENSE.MIT)
+ *
+ *  This program is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ ****************************************************************************
+ */
+
+/*
+ * With work-stealing (see ff_farm::set_scheduling_stealing) the Emitter
+ * pushes the tasks of each worker in a ff_steal_queue instead of the
+ * worker's SPSC input channel. The owner pops from the head of its queue
+ * (FIFO); when its queue is empty it takes a task from the queue of
+ * another worker, either the oldest one (FF_STEAL_FIFO, from the head) or
+ * the most recent one (FF_STEAL_LIFO, from the tail).
+ *
+ * The queue is a bounded ring with one producer (the Emitter) and many
+ * consumers (the owner and the thieves). Head and tail are packed in one
+ * 64-bit word, so push, pop and steal are a single CAS and the three ends
+ * need no lock (the capacity is at most 2^23). The special values (EOS,
+ * GO_OUT, ...) are never stolen, they stay in the owner's queue after its
+ * tasks, and a worker takes its own special value only when there is
+ * nothing left to steal: at the end of the stream the workers help the
+ * ones that still have a backlog. The pinned tasks (e.g. the copies of a
+ * broadcast, each worker must get its own) are not stolen either, but the
+ * owner takes them in order.
+ */
+
+#ifndef FF_STEALQ_HPP
+#define FF_STEALQ_HPP
+
+#include <cstdint>
+#include <cstdlib>
+#include <climits>
+#include <new>
+#include <atomic>
+#include <vector>
+#include <ff/config.hpp>
+#include <ff/sysdep.h>
+#include <ff/platforms/platform.h>
+
+namespace ff {
+
+enum ff_steal_t { FF_STEAL_FIFO=0, FF_STEAL_LIFO=1 };
+
+class ff_steal_queue {
+    // [tag:16|tail:24|head:24], the indexes are modulo 2^24. The tag changes
+    // at each update, otherwise a LIFO steal followed by a push would give
+    // back the same word (ABA) to a thief that has read the old tail.
+    enum { IBITS=24 };
+    static const uint32_t IMASK = (1U<<IBITS)-1;
+    static inline uint32_t head(uint64_t w) { return (uint32_t)w & IMASK; }
+    static inline uint32_t tail(uint64_t w) { return (uint32_t)(w>>IBITS) & IMASK; }
+    static inline uint64_t word(uint64_t w, uint32_t h, uint32_t t) {
+        return ((((w>>(2*IBITS))+1) & 0xFFFF) << (2*IBITS)) |
+               ((uint64_t)(t & IMASK) << IBITS) | (h & IMASK);
+    }
+    static inline uint32_t count(uint32_t h, uint32_t t) { return (t - h) & IMASK; }
+    // special values of the run-time (FF_TAG_MIN and above, see node.hpp)
+    static inline bool special(void* v) { return (uintptr_t)v >= (uintptr_t)(ULLONG_MAX-10); }
+    struct slot_t {
+        std::atomic<void*> v;
+        std::atomic<bool>  pinned;   // not to be stolen
+    };
+    // the slot a thief takes from, the oldest (FIFO) or the most recent
+    // (LIFO) one, or the oldest one if the most recent one is a special
+    // value or is pinned. Null if there is nothing to steal.
+    inline slot_t* victim_slot(const uint64_t w, bool& fromtail) const {
+        const uint32_t h = head(w), t = tail(w);
+        if (h == t) return nullptr;
+        slot_t* sl = &ring[(fromtail ? t-1 : h) & mask];
+        if (fromtail && !stealable(sl)) {
+            fromtail = false;
+            sl = &ring[h & mask];
+        }
+        return stealable(sl) ? sl : nullptr;
+    }
+    static inline bool stealable(const slot_t* sl) {
+        return !special(sl->v.load(std::memory_order_relaxed)) &&
+               !sl->pinned.load(std::memory_order_relaxed);
+    }
+
+public:
+    ff_steal_queue():ring(nullptr),mask(0) { state.store(0, std::memory_order_relaxed); }
+    ~ff_steal_queue() { if (ring) freeAlignedMemory(ring); }
+
+    ff_steal_queue(const ff_steal_queue&) = delete;
+    ff_steal_queue& operator=(const ff_steal_queue&) = delete;
+
+    // the capacity is rounded up to a power of 2
+    bool init(size_t capacity) {
+        if (ring || capacity == 0 || capacity > (1UL<<(IBITS-1))) return false;
+        size_t n = 1;
+        while(n < capacity) n <<= 1;
+        ring = (slot_t*)getAlignedMemory(CACHE_LINE_SIZE, n*sizeof(slot_t));
+        if (!ring) return false;
+        for(size_t i=0;i<n;++i) {
+            new (&ring[i].v) std::atomic<void*>(nullptr);
+            new (&ring[i].pinned) std::atomic<bool>(false);
+        }
+        mask = (uint32_t)(n-1);
+        return true;
+    }
+
+    // producer only, a \p pinned task is taken only by the owner
+    inline bool push(void* const data, const bool pinned=false) {
+        uint64_t w = state.load(std::memory_order_acquire);
+        for(;;) {
+            const uint32_t t = tail(w);
+            if (count(head(w), t) > mask) return false;   // full
+            ring[t & mask].v.store(data, std::memory_order_relaxed);
+            ring[t & mask].pinned.store(pinned, std::memory_order_relaxed);
+            if (state.compare_exchange_weak(w, word(w, head(w), t+1), std::memory_order_release,
+                                            std::memory_order_acquire))
+                return true;
+        }
+    }
+
+    // owner: the oldest element, if \p tasks only if it is not a special value
+    inline bool pop(void** data, const bool tasks=false) {
+        uint64_t w = state.load(std::memory_order_acquire);
+        for(;;) {
+            const uint32_t h = head(w);
+            if (h == tail(w)) return false;
+            void* v = ring[h & mask].v.load(std::memory_order_relaxed);
+            if (tasks && special(v)) return false;
+            if (state.compare_exchange_weak(w, word(w, h+1, tail(w)), std::memory_order_acq_rel,
+                                            std::memory_order_acquire)) {
+                *data = v;
+                return true;
+            }
+        }
+    }
+
+    // thieves: the oldest (FIFO) or the most recent (LIFO) task (see
+    // victim_slot)
+    inline bool steal(void** data, const bool lifo) {
+        uint64_t w = state.load(std::memory_order_acquire);
+        for(;;) {
+            const uint32_t h = head(w), t = tail(w);
+            bool fromtail = lifo;
+            const slot_t* sl = victim_slot(w, fromtail);
+            if (!sl) return false;
+            void* v = sl->v.load(std::memory_order_relaxed);
+            const uint64_t nw = fromtail ? word(w, h, t-1) : word(w, h+1, t);
+            if (state.compare_exchange_weak(w, nw, std::memory_order_acq_rel,
+                                            std::memory_order_acquire)) {
+                *data = v;
+                return true;
+            }
+        }
+    }
+
+    // there is something that a thief can take
+    inline bool stealable(const bool lifo) const {
+        bool fromtail = lifo;
+        return victim_slot(state.load(std::memory_order_acquire), fromtail) != nullptr;
+    }
+
+    inline bool empty() const {
+        const uint64_t w = state.load(std::memory_order_acquire);
+        return head(w) == tail(w);
+    }
+    inline size_t length() const {
+        const uint64_t w = state.load(std::memory_order_acquire);
+        return count(head(w), tail(w));
+    }
+    inline size_t buffersize() const { return ring ? (size_t)mask+1 : 0; }
+
+private:
+    ALIGN_TO_PRE(CACHE_LINE_SIZE)
+    std::atomic<uint64_t> state;
+    ALIGN_TO_POST(CACHE_LINE_SIZE)
+    slot_t*             ring;
+    uint32_t            mask;
+};
+
+/*!
+ * \class ff_steal_group
+ *  \ingroup building_blocks
+ *
+ * \brief The queues of the workers of one farm.
+ *
+ * It is created by the farm's load balancer when the farm is prepared,
+ * worker \p id uses push (called by the Emitter), pop and ready.
+ *
+ * This class is defined in \ref stealq.hpp
+ */
+class ff_steal_group {
+    struct worker_t {
+        ff_steal_queue             q;
+        std::atomic<unsigned long> steals{0};
+        std::atomic<unsigned long> stolen{0};  // tasks taken by the others
+        size_t                     victim=0;   // next victim, owner only
+        char padding[CACHE_LINE_SIZE];
+    };
+public:
+    ff_steal_group(size_t nworkers, ff_steal_t policy):
+        W(nworkers), policy(policy) {}
+
+    ff_steal_group(const ff_steal_group&) = delete;
+    ff_steal_group& operator=(const ff_steal_group&) = delete;
+
+    bool init(size_t capacity) {
+        for(size_t i=0;i<W.size();++i) {
+            if (!W[i].q.init(capacity)) return false;
+            W[i].victim = (i+1) % W.size();
+        }
+        return true;
+    }
+
+    inline bool push(size_t id, void* const data, const bool pinned=false) {
+        return W[id].q.push(data, pinned);
+    }
+
+    // own queue first, then the other queues starting from the last victim.
+    // A special value (e.g. EOS) in the own queue is taken only when there
+    // is nothing to steal, so the workers help the others before leaving.
+    inline bool pop(size_t id, void** data) {
+        if (W[id].q.pop(data, true)) return true;
+        const size_t n = W.size();
+        size_t v = W[id].victim;
+        for(size_t k=0;k<n;++k, v=(v+1)%n) {
+            if (v == id) continue;
+            if (W[v].q.steal(data, policy == FF_STEAL_LIFO)) {
+                W[id].victim = v;
+                W[id].steals.store(W[id].steals.load(std::memory_order_relaxed)+1,
+                                   std::memory_order_relaxed);
+                W[v].stolen.fetch_add(1, std::memory_order_relaxed);
+                return true;
+            }
+        }
+        return W[id].q.pop(data);
+    }
+
+    // there may be something for worker id: in its queue or to steal
+    inline bool ready(size_t id) const {
+        if (!W[id].q.empty()) return true;
+        for(size_t i=0;i<W.size();++i)
+            if (i != id && W[i].q.stealable(policy == FF_STEAL_LIFO)) return true;
+        return false;
+    }
+
+    inline size_t length(size_t id) const { return W[id].q.length(); }
+    // tasks taken by worker id from the other queues
+    inline unsigned long steals(size_t id) const { return W[id].steals.load(std::memory_order_relaxed); }
+    // tasks of worker id taken by the others
+    inline unsigned long stolen(size_t id) const { return W[id].stolen.load(std::memory_order_relaxed); }
+    inline size_t     size() const { return W.size(); }
+    inline ff_steal_t get_policy() const { return policy; }
+
+private:
+    std::vector<worker_t> W;
+    const ff_steal_t      policy;
+};
+
+} // namespace ff
+
+#endif /* FF_STEALQ_HPP */
@@ -75,6 +75,9 @@
 #include <ff/dynqueue.hpp>
 #include <ff/buffer.hpp>
 #include <ff/spin-lock.hpp>
+#include <ff/utils.hpp>
+#include <ff/doorbell.hpp>
+#include <atomic>
 // #if defined(HAVE_ATOMIC_H)
 // #include <asm/atomic.h>
 // #else
@@ -83,13 +86,28 @@
 namespace ff {
 
 /* Do not change the following define unless you know what you're doing */
+#if !defined(INTERNAL_BUFFER_T)
 #define INTERNAL_BUFFER_T SWSR_Ptr_Buffer  /* bounded SPSC buffer */
+#endif
 
+/*
+ * The pool keeps at most 'cachesize' released buffers (high-water mark),
+ * the ones beyond that are freed. After a quiet period (no buffers released
+ * for quiet_us microseconds and the queue empty) the consumer frees the
+ * cached buffers down to 'lowwater', so a channel does not keep its peak
+ * memory forever after a burst (see set_shrink_policy).
+ * The cache is popped both by the producer (next_w) and by the consumer
+ * (shrink), the two pops are serialized by cache_lock, they are not in the
+ * fast path of push and pop.
+ */
 class BufferPool {
 public:
     BufferPool(int cachesize, const bool fillcache=false, unsigned long size=-1)
-        :inuse(cachesize),bufcache(cachesize) {
+        :inuse(cachesize),bufcache(cachesize),
+         ncached(0),nbytes(0),maxbytes(0),lastrelease(0),
+         lowwater(FF_UBUFFER_LOWWATER),quiet_us(FF_UBUFFER_QUIET_US),numanode(-1) {
         bufcache.init(); // initialise the internal buffer and allocates memory
+        init_unlocked(cache_lock);
 
         if (fillcache) {
             assert(size>0);
@@ -103,7 +121,9 @@ public:
                 p.buf->init();
 #endif
                 bufcache.push(p.buf);
+                allocated(p.buf);
             }
+            ncached.store(cachesize, std::memory_order_relaxed);
         }
 
 #if defined(UBUFFER_STATS)
@@ -127,7 +147,18 @@ public:
     
     inline INTERNAL_BUFFER_T * next_w(unsigned long size)  { 
         union { INTERNAL_BUFFER_T * buf; void * buf2;} p;
-        if (!bufcache.pop(&p.buf2)) {
+        spin_lock(cache_lock);
+        const bool cached = bufcache.pop(&p.buf2);
+        spin_unlock(cache_lock);
+        if (cached && p.buf->buffersize() != size) {
+            // the channel has been resized (see uSWSR_Ptr_Buffer::resize)
+            ncached.fetch_sub(1, std::memory_order_relaxed);
+            freed(p.buf);
+            p.buf->~INTERNAL_BUFFER_T();
+            free(p.buf2);
+            return next_w(size);
+        }
+        if (!cached) {
 #if defined(UBUFFER_STATS)
             ++miss;
 #endif
@@ -138,10 +169,15 @@ public:
 #else
             if (!p.buf->init()) return NULL;
 #endif
-        }
+            const int node = numanode.load(std::memory_order_relaxed);
+            if (node >= 0) ff_place_ring(p.buf, node);
+            allocated(p.buf);
+        } else {
+            ncached.fetch_sub(1, std::memory_order_relaxed);
 #if defined(UBUFFER_STATS)
-        else  ++hit;
+            ++hit;
 #endif  
+        }
         inuse.push(p.buf);
         return p.buf;
     }
@@ -155,11 +191,71 @@ public:
 
     inline void release(INTERNAL_BUFFER_T * const buf) {
         buf->reset();
-        if (!bufcache.push(buf)) {
+        if (quiet_us) lastrelease = getusec();
+        if (!bufcache.push(buf)) {   // above the high-water mark
+            freed(buf);
             buf->~INTERNAL_BUFFER_T();	    
             free(buf);
+            return;
+        }
+        ncached.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    /*
+     * Called by the consumer when the queue is empty: if there has been
+     * no activity for quiet_us microseconds, the cached buffers above
+     * the low-water mark are freed.
+     */
+    inline void shrink() {
+        if (ncached.load(std::memory_order_relaxed) <= (long)lowwater) return;
+        if (!quiet_us || (getusec() - lastrelease) < quiet_us) return;
+        union { INTERNAL_BUFFER_T * b1; void * b2;} p;
+        spin_lock(cache_lock);
+        while(ncached.load(std::memory_order_relaxed) > (long)lowwater && bufcache.pop(&p.b2)) {
+            ncached.fetch_sub(1, std::memory_order_relaxed);
+            freed(p.b1);
+            p.b1->~INTERNAL_BUFFER_T();
+            free(p.b2);
         }
+        spin_unlock(cache_lock);
+    }
+
+    void set_shrink_policy(size_t lw, unsigned long us) { lowwater=lw; quiet_us=us; }
+
+    // the buffers allocated from now on are placed on the NUMA node 'node'
+    // and the cached ones are moved there. Called by the consumer, that is
+    // the only one pushing into bufcache (see release).
+    void set_numanode(int node) {
+        numanode.store(node, std::memory_order_relaxed);
+        union { INTERNAL_BUFFER_T * b1; void * b2;} p;
+        dynqueue tmp;
+        spin_lock(cache_lock);
+        while(bufcache.pop(&p.b2)) {
+            ff_place_ring(p.b1, node);
+            tmp.push(p.b2);
+        }
+        while(tmp.pop(&p.b2)) bufcache.push(p.b2);
+        spin_unlock(cache_lock);
+    }
+
+    // memory of an internal buffer, its ring keeps the size it has been
+    // allocated with (see changesize)
+    static inline size_t bytes(const INTERNAL_BUFFER_T* buf) {
+        return sizeof(INTERNAL_BUFFER_T)+buf->ringbytes();
+    }
+    // accounts a buffer allocated by the producer (also outside the pool,
+    // the first one)
+    inline void allocated(const INTERNAL_BUFFER_T* buf) {
+        const size_t n = nbytes.fetch_add(bytes(buf), std::memory_order_relaxed)+bytes(buf);
+        if (n > maxbytes.load(std::memory_order_relaxed))
+            maxbytes.store(n, std::memory_order_relaxed);
     }
+    inline void freed(const INTERNAL_BUFFER_T* buf) {
+        nbytes.fetch_sub(bytes(buf), std::memory_order_relaxed);
+    }
+    // bytes currently allocated (in use and cached buffers) and the peak
+    inline size_t footprint() const      { return nbytes.load(std::memory_order_relaxed); }
+    inline size_t peak_footprint() const { return maxbytes.load(std::memory_order_relaxed); }
 
 #if defined(UBUFFER_STATS)
 
@@ -212,6 +308,14 @@ private:
                                  // SWSR unbounded queue.
                                  // No lock is needed around pop and push methods.
     INTERNAL_BUFFER_T  bufcache; // This is a bounded buffer
+    lock_t             cache_lock;
+    std::atomic<long>  ncached;  // buffers in bufcache
+    std::atomic<size_t> nbytes;  // memory of the buffers (in use and cached)
+    std::atomic<size_t> maxbytes;// peak of nbytes (written only by the producer)
+    unsigned long      lastrelease; // consumer side
+    size_t             lowwater;
+    unsigned long      quiet_us;
+    std::atomic<int>   numanode; // see uSWSR_Ptr_Buffer::place
 };
     
 // --------------------------------------------------------------------------------------
@@ -232,7 +336,7 @@ private:
   */ 
 class uSWSR_Ptr_Buffer {
 private:
-    enum {CACHE_SIZE=32};
+    enum {CACHE_SIZE=FF_UBUFFER_HIGHWATER};
 
 #if defined(uSWSR_MULTIPUSH)
     enum { MULTIPUSH_BUFFER_SIZE=16};
@@ -269,7 +373,8 @@ public:
                      const bool fixedsize=false,
                      const bool fillcache=false):
         buf_r(0),buf_w(0),in_use_buffers(1),size(n),fixedsize(fixedsize),
-        pool(CACHE_SIZE,fillcache,size) {
+        pool(CACHE_SIZE,fillcache,size),reqsize(0),nfull(0),rszcheck(FF_UBUFFER_RESIZE_CHECK),
+        cap(n),npushed(0),npopped(0) {
         init_unlocked(P_lock); init_unlocked(C_lock);
         pushPMF=&uSWSR_Ptr_Buffer::push;
         popPMF =&uSWSR_Ptr_Buffer::pop;
@@ -308,6 +413,7 @@ public:
         if (!buf_r->init()) return false;
 #endif
         buf_w = buf_r;
+        pool.allocated(buf_r);
 
         return true;
     }
@@ -345,11 +451,26 @@ public:
         /* NULL values cannot be pushed in the queue */
         assert(data != NULL);
 
+        // a bounded queue checks from time to time if it has been resized
+        if (fixedsize && --rszcheck == 0) {
+            rszcheck = FF_UBUFFER_RESIZE_CHECK;
+            if (reqsize.load(std::memory_order_relaxed)) switch_buffer();
+        }
+
         // If fixedsize has been set to \p true, this method may
         // return false. This means EWOULDBLOCK 
         if (!available()) {
 
-            if (fixedsize) return false;
+            if (fixedsize) {
+                if (!reqsize.load(std::memory_order_relaxed) || !switch_buffer()) {
+                    nfull.store(nfull.load(std::memory_order_relaxed)+1, std::memory_order_relaxed);
+                    return false;
+                }
+                if (!buf_w->push(data)) return false;
+                npushed.store(npushed.load(std::memory_order_relaxed)+1, std::memory_order_release);
+                if (bell && buf_w->pushed_into_empty()) bell->ring(bellid);
+                return true;
+            }
 
             // try to get a new buffer             
             INTERNAL_BUFFER_T * t = pool.next_w(size);
@@ -363,6 +484,8 @@ public:
         }
         //DBG(assert(buf_w->push(data)); return true;);
         buf_w->push(data);
+        if (fixedsize) npushed.store(npushed.load(std::memory_order_relaxed)+1, std::memory_order_release);
+        if (bell && buf_w->pushed_into_empty()) bell->ring(bellid);
         return true;
     }
 
@@ -412,7 +535,7 @@ public:
         assert(data != NULL);
 
         if (buf_r->empty()) { // current buffer is empty
-            if (buf_r == buf_w) return false; 
+            if (buf_r == buf_w) { pool.shrink(); return false; }
             if (buf_r->empty()) { // we have to check again
                 INTERNAL_BUFFER_T * tmp = pool.next_r();
                 if (tmp) {
@@ -429,8 +552,44 @@ public:
             }
         }
         //DBG(assert(buf_r->pop(data)); return true;);
-        return buf_r->pop(data);
-    }    
+        if (!buf_r->pop(data)) return false;
+        if (fixedsize) npopped.store(npopped.load(std::memory_order_relaxed)+1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     *  \brief Multipop
+     *
+     *  It pops up to \p max elements, possibly crossing the boundary of
+     *  the internal buffers.
+     *
+     *  \param[out] data array of at least \p max elements
+     *
+     *  \return the number of elements popped (0 if the queue is empty)
+     */
+    inline size_t multipop(void ** data, size_t max) {
+        assert(data != NULL);
+
+        size_t n = buf_r->multipop(data, max);
+        while(n<max) {
+            if (buf_r == buf_w) { if (!n) pool.shrink(); break; }
+            if (buf_r->empty()) { // we have to check again (see pop)
+                INTERNAL_BUFFER_T * tmp = pool.next_r();
+                if (!tmp) break;
+                pool.release(buf_r);
+                in_use_buffers--;
+                buf_r = tmp;
+#if defined(UBUFFER_STATS)
+                --numBuffers;
+#endif
+            }
+            const size_t m = buf_r->multipop(data+n, max-n);
+            if (!m) break;
+            n += m;
+        }
+        if (fixedsize && n) npopped.store(npopped.load(std::memory_order_relaxed)+n, std::memory_order_release);
+        return n;
+    }
 
 
 #if defined(UBUFFER_STATS)
@@ -485,6 +644,7 @@ public:
         size_t tmp=buf_w->changesize(newsz);
         assert(size == tmp);
         size = newsz;
+        cap.store(newsz, std::memory_order_relaxed);
         pool.changesize(newsz); 
         fixedsize=true;
         return tmp;
@@ -506,6 +666,86 @@ public:
 
     inline bool isFixedSize() const { return fixedsize; }
 
+    /**
+     * \brief It changes the capacity of a bounded queue while it is being used.
+     *
+     * Differently from \p changesize it can be called by any thread at any
+     * time. The producer moves to a new internal buffer of \p newsz
+     * entries at its next push that finds the current one full, or within
+     * FF_UBUFFER_RESIZE_CHECK pushes; the consumer drains the old buffer
+     * first. In the meantime the queue may hold up to the old plus the new
+     * capacity.
+     *
+     * \return false if the queue is unbounded or \p newsz is 0
+     */
+    bool resize(size_t newsz) {
+        if (!fixedsize || newsz == 0) return false;
+        reqsize.store(newsz, std::memory_order_relaxed);
+        return true;
+    }
+    /**
+     * \brief number of pushes failed because the queue was full
+     */
+    inline unsigned long full_count() const { return nfull.load(std::memory_order_relaxed); }
+
+    /**
+     * \brief capacity and number of elements of a bounded queue
+     *
+     * Differently from \p buffersize and \p length they can be read by any
+     * thread (e.g. a monitor): they do not touch the internal buffers,
+     * which may be released in the meantime, but two counters updated by
+     * the producer and by the consumer. The occupancy is an estimate.
+     */
+    inline size_t capacity() const { return cap.load(std::memory_order_relaxed); }
+    inline unsigned long occupancy() const {
+        const unsigned long o = npopped.load(std::memory_order_acquire);
+        const unsigned long i = npushed.load(std::memory_order_acquire);
+        return (i > o) ? i-o : 0;
+    }
+
+    /**
+     * \brief memory policy of the internal buffers
+     *
+     * When the consumer finds the queue empty and no internal buffer has
+     * been released for \p quiet_us microseconds, the cached buffers are
+     * freed down to \p lowwater (0 frees all of them). \p quiet_us equal
+     * to 0 disables the shrinking. The high-water mark is
+     * FF_UBUFFER_HIGHWATER. It must be called before using the queue.
+     */
+    void set_shrink_policy(size_t lowwater, unsigned long quiet_us) {
+        pool.set_shrink_policy(lowwater, quiet_us);
+    }
+
+    /**
+     * \brief It moves the ring being read and the cached rings to the NUMA
+     * node \p node, the rings allocated from now on are placed there too
+     * (see ringmem.hpp). The rings already filled by the producer and not
+     * yet read stay where they are until they are released.
+     * It is called by the consumer, also while the queue is being used.
+     *
+     * \return false if the ring being read cannot be moved
+     */
+    bool place(int node) {
+        pool.set_numanode(node);
+        return buf_r && ff_place_ring(buf_r, node);
+    }
+
+    /**
+     * \brief the producer sets the bit \p id of \p d after a push that has
+     * found the queue empty (see doorbell.hpp). It must be called before
+     * using the queue.
+     */
+    void set_doorbell(ff_doorbell* d, size_t id) { bell = d; bellid = id; }
+
+    /**
+     * \brief bytes currently allocated by the queue (in use and cached buffers)
+     */
+    inline size_t footprint() const { return pool.footprint(); }
+    /**
+     * \brief max value of footprint since the queue has been created
+     */
+    inline size_t peak_footprint() const { return pool.peak_footprint(); }
+
     inline void reset() {
         if (buf_r) buf_r->reset();
         if (buf_w) buf_w->reset();
@@ -557,6 +797,42 @@ private:
     unsigned long	    size;
     bool			    fixedsize;
     BufferPool			pool;
+
+    // see resize, written by the producer only (but reqsize)
+    std::atomic<unsigned long> reqsize;
+    std::atomic<unsigned long> nfull;
+    unsigned long              rszcheck;
+
+    // see capacity and occupancy, pushes and pops counted in bounded queues
+    std::atomic<unsigned long> cap;
+    union {
+        std::atomic<unsigned long> npushed;
+        char padding_push[CACHE_LINE_SIZE];
+    };
+    union {
+        std::atomic<unsigned long> npopped;
+        char padding_pop[CACHE_LINE_SIZE];
+    };
+
+    // see set_doorbell
+    ff_doorbell               *bell   = nullptr;
+    size_t                     bellid = 0;
+
+    // producer side: moves to a new internal buffer having the requested size
+    bool switch_buffer() {
+        const unsigned long newsz = reqsize.exchange(0, std::memory_order_relaxed);
+        if (newsz == 0 || newsz == size) return false;
+        INTERNAL_BUFFER_T * t = pool.next_w(newsz);
+        if (!t) return false;
+        buf_w = t;
+        size  = newsz;
+        cap.store(newsz, std::memory_order_relaxed);
+        in_use_buffers++;
+#if defined(UBUFFER_STATS)
+        ++numBuffers;
+#endif
+        return true;
+    }
 };
 
 
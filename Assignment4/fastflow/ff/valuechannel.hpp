@@ -0,0 +1,161 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/* ***************************************************************************
+ *
+ *  FastFlow is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License version 3 as
+ *  published by the Free Software Foundation.
+ *  Starting from version 3.0.1 FastFlow is dual licensed under the GNU LGPLv3
+ *  or MIT License (https://github.com/ParaGroup/WindFlow/blob/vers3.x/LICENSE.MIT)
+ *
+ *  This program is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ *  more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc., 59
+ *  Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * **************************************************************************/
+
+/*
+ * Typed by-value channel for small trivially-copyable messages.
+ *
+ * The ValueChannel<T> is a ring of T slots owned by the producer node. The
+ * value is copied inline into the next free slot and the slot address is
+ * sent through the node's (void*) output channel as usual, so nothing in the
+ * run-time changes and special tags (EOS, GO_ON, ...) work as before. The
+ * consumer gives the slot back as soon as its svc returns. In the common
+ * case of small message streams no new/delete is done at all.
+ *
+ * It is used through ff_node_t<IN,OUT>:
+ *
+ *   struct Producer: ff_node_t<long, tuple_t> {
+ *       tuple_t* svc(long*) {
+ *           ...
+ *           ff_send_value(tuple_t{...});   // instead of ff_send_out(new tuple_t{...})
+ *           ...
+ *       }
+ *   };
+ *   struct Consumer: ff_node_t<tuple_t, result_t> {
+ *       Consumer() { set_input_values(); } // slots are released after svc
+ *       result_t* svc(tuple_t* t) { ... no delete t ... }
+ *   };
+ *
+ * NOTE: the data pointed to by the svc argument is only valid inside svc.
+ *       To forward the message, return it as it is (then the slot is
+ *       released by the next node, that must have set_input_values too) or
+ *       copy it with ff_send_value(*t).
+ *       All the producers of a node that calls set_input_values must send
+ *       values (i.e. they must not mix ff_send_value and heap pointers).
+ *
+ */
+
+#ifndef FF_VALUECHANNEL_HPP
+#define FF_VALUECHANNEL_HPP
+
+#include <cstddef>
+#include <cstdlib>
+#include <atomic>
+#include <new>
+#include <type_traits>
+#include <ff/config.hpp>
+#include <ff/sysdep.h>
+#include <ff/utils.hpp>
+
+namespace ff {
+
+/*
+ * true if T can be sent through a ValueChannel.
+ */
+template<typename T, typename=void>
+struct ff_is_value_type: std::false_type {};
+template<typename T>
+struct ff_is_value_type<T, typename std::enable_if<!std::is_void<T>::value>::type>:
+    std::integral_constant<bool, std::is_trivially_copyable<T>::value &&
+                                 sizeof(T) <= FF_VALUE_MAX_SIZE> {};
+
+struct ValueChannelBase {
+    virtual ~ValueChannelBase() {}
+};
+
+template<typename T>
+class ValueChannel: public ValueChannelBase {
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "ValueChannel: the message type must be trivially copyable");
+    static_assert(sizeof(T) <= FF_VALUE_MAX_SIZE,
+                  "ValueChannel: message too big, send it by pointer");
+
+    struct slot_t {
+        std::atomic<long> busy;
+        T                 value;
+    };
+public:
+    ValueChannel(size_t nslots=FF_VALUE_SLOTS):
+        nslots(nslots?nslots:1), next(0), slots(nullptr) {}
+
+    ~ValueChannel() {
+        freeAlignedMemory(slots);
+    }
+
+    int init() {
+        if (slots) return 0;
+        void* p = getAlignedMemory(CACHE_LINE_SIZE, nslots*sizeof(slot_t));
+        if (!p) return -1;
+        slots = (slot_t*)p;
+        for(size_t i=0;i<nslots;++i)
+            new (&slots[i].busy) std::atomic<long>(0);
+        return 0;
+    }
+
+    /*
+     * Producer side: copies v in a free slot and returns its address,
+     * waits if all slots are still held by the consumers.
+     */
+    inline T* put(const T& v) {
+        size_t spins=0;
+        for(;;) {
+            slot_t& s = slots[next];
+            if (++next == nslots) next = 0;
+            if (s.busy.load(std::memory_order_acquire) == 0) {
+                s.busy.store(1, std::memory_order_relaxed);
+                s.value = v;
+                return &s.value;
+            }
+            // the slots are not released in order when there are
+            // many consumers (farm), so all of them are tried once before
+            // backing off
+            if (++spins >= nslots) { spins=0; ff_relax(1); }
+        }
+    }
+
+    /*
+     * Consumer side: the slot can be re-used by the producer.
+     */
+    static inline void release(T* p) {
+        slot_t* s = (slot_t*)((char*)p - offsetof(slot_t, value));
+        s->busy.store(0, std::memory_order_release);
+    }
+
+    size_t size() const { return nslots; }
+
+private:
+    const size_t nslots;
+    size_t       next;
+    slot_t      *slots;
+};
+
+/*
+ * Gives back a slot received by a node (see ff_node_t::set_input_values),
+ * no-op for the types that cannot be sent by value.
+ */
+template<typename T>
+static inline typename std::enable_if<ff_is_value_type<T>::value>::type
+ff_value_release(void* p) { ValueChannel<T>::release(reinterpret_cast<T*>(p)); }
+template<typename T>
+static inline typename std::enable_if<!ff_is_value_type<T>::value>::type
+ff_value_release(void*) {}
+
+} // namespace ff
+
+#endif /* FF_VALUECHANNEL_HPP */
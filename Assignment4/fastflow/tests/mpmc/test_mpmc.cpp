@@ -32,6 +32,11 @@
  *  April    2011  (major rework for the MSqueue)
  *  April    2012  added the bounded/unbounded MPMC queues 
  *
+ *  The queue is selected at compile time: BOUNDED_MPMC (MPMC_Ptr_Queue),
+ *  SEQ_MPMC (MPMC_Seq_Ptr_Queue), UNBOUNDED_MPMC (uMPMC_Ptr_Queue),
+ *  SCALABLE_QUEUE (multiMSqueue), none of them (MSqueue). 
+ *  See the bench target in the Makefile.
+ *
  */
 #include <iostream>
 #include <ff/node.hpp>   // for Barrier
@@ -68,6 +73,8 @@ cds::container::MSQueue< cds::gc::HP, void*> * msq;  // which allocator ?
  #else // !SCALABLE_QUEUE
   #if defined(BOUNDED_MPMC)
    MPMC_Ptr_Queue  * msq;
+  #elif defined(SEQ_MPMC)
+   MPMC_Seq_Ptr_Queue * msq;
   #else
    #if defined(UNBOUNDED_MPMC)
     uMPMC_Ptr_Queue * msq;
@@ -188,7 +195,7 @@ void * C(void * arg) {
         ++taskC[myid];
     }
 
-    ffTime(STOP_TIME,true);
+    ffTime(STOP_TIME);
     
 #if defined(HAVE_CDSLIB)
     cds::threading::pthread::Manager::detachThread();
@@ -250,6 +257,9 @@ int main(int argc, char * argv[]) {
    #if defined(BOUNDED_MPMC)
     msq = new MPMC_Ptr_Queue;
     if (!msq->init(ntasks/2)) abort(); // we set the size to half ntasks
+   #elif defined(SEQ_MPMC)
+    msq = new MPMC_Seq_Ptr_Queue;
+    if (!msq->init(ntasks/2)) abort(); // as for the BOUNDED_MPMC
    #else
     #if defined(UNBOUNDED_MPMC)
      msq = new uMPMC_Ptr_Queue;
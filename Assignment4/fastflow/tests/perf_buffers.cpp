@@ -0,0 +1,142 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/* ***************************************************************************
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ *  As a special exception, you may use this file as part of a free software
+ *  library without restriction.  Specifically, if other files instantiate
+ *  templates or use macros or inline functions from this file, or you compile
+ *  this file and link it with other files to produce an executable, this
+ *  file does not by itself cause the resulting executable to be covered by
+ *  the GNU General Public License.  This exception does not however
+ *  invalidate any other reasons why the executable file might be covered by
+ *  the GNU General Public License.
+ *
+ ****************************************************************************
+ */
+/*
+ * Latency/throughput comparison of the SPSC channels:
+ *   - SWSR_Ptr_Buffer    (bounded, one slot probe per operation)
+ *   - SWSR_Cached_Buffer (bounded, cached slot probing)
+ *   - uSWSR_Ptr_Buffer   (unbounded, on top of SWSR_Ptr_Buffer)
+ *   - Lamport_Buffer     (bounded, shared indexes)
+ *
+ * throughput: one producer pushes ntasks pointers, one consumer pops them
+ *             (checking the FIFO order).
+ * latency   : two threads exchange one pointer back and forth through two
+ *             channels, the half round-trip time is reported.
+ *
+ * usage: perf_buffers [ntasks [size [cpu_P cpu_C]]]
+ *
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <sched.h>
+#include <ff/buffer.hpp>
+#include <ff/ubuffer.hpp>
+#include <ff/mapping_utils.hpp>
+#include <ff/utils.hpp>
+
+using namespace ff;
+
+static long ntasks = 1000000;
+static long size   = 1024;
+static int  cpu_P  = -1, cpu_C = -1;
+
+// spins a while and then leaves the core (needed if the two threads share it)
+struct backoff {
+    inline void operator()() { if (++cnt == 1024) { cnt=0; sched_yield(); } }
+    int cnt=0;
+};
+
+static void pin(int cpu) {
+    if (cpu != -1 && ff_mapThreadToCpu(cpu)!=0)
+        printf("Cannot map thread to cpu %d, going on...\n", cpu);
+}
+
+template<typename Q>
+static double throughput(Q &q) {
+    std::thread producer([&q]() {
+        pin(cpu_P);
+        backoff wait;
+        for(long i=1;i<=ntasks;++i)
+            while(!q.push((void*)i)) wait();
+    });
+    pin(cpu_C);
+    backoff wait;
+    ffTime(START_TIME);
+    for(long i=1;i<=ntasks;++i) {
+        void *t;
+        while(!q.pop(&t)) wait();
+        if ((long)t != i) {
+            error("wrong order %ld != %ld\n", (long)t, i);
+            abort();
+        }
+    }
+    ffTime(STOP_TIME);
+    producer.join();
+    return ntasks / (ffTime(GET_TIME)/1000.0) / 1e6;
+}
+
+template<typename Q>
+static double latency(Q &ping, Q &pong, long rounds) {
+    std::thread echo([&]() {
+        pin(cpu_P);
+        backoff wait;
+        for(long i=0;i<rounds;++i) {
+            void *t;
+            while(!ping.pop(&t)) wait();
+            while(!pong.push(t)) wait();
+        }
+    });
+    pin(cpu_C);
+    backoff wait;
+    ffTime(START_TIME);
+    for(long i=1;i<=rounds;++i) {
+        void *t;
+        while(!ping.push((void*)i)) wait();
+        while(!pong.pop(&t)) wait();
+        if ((long)t != i) abort();
+    }
+    ffTime(STOP_TIME);
+    echo.join();
+    return ffTime(GET_TIME)*1e6 / rounds / 2;   // ns
+}
+
+template<typename Q>
+static void run(const char *name, bool fixedsize=true) {
+    Q q(size, fixedsize), ping(size, fixedsize), pong(size, fixedsize);
+    if (!q.init() || !ping.init() || !pong.init()) {
+        error("%s, init failed\n", name);
+        abort();
+    }
+    const double thr = throughput(q);
+    const double lat = latency(ping, pong, ntasks/100);
+    printf("%-20s %10.2f Mops/s %10.1f ns\n", name, thr, lat);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc>1) ntasks = atol(argv[1]);
+    if (argc>2) size   = atol(argv[2]);
+    if (argc>4) { cpu_P = atoi(argv[3]); cpu_C = atoi(argv[4]); }
+    printf("ntasks=%ld size=%ld\n", ntasks, size);
+    printf("%-20s %17s %13s\n", "buffer", "throughput", "latency");
+
+    run<SWSR_Ptr_Buffer>("SWSR_Ptr_Buffer");
+    run<SWSR_Cached_Buffer>("SWSR_Cached_Buffer");
+    run<uSWSR_Ptr_Buffer>("uSWSR_Ptr_Buffer", false);
+    run<Lamport_Buffer>("Lamport_Buffer");
+    return 0;
+}
@@ -0,0 +1,108 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/* ***************************************************************************
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ *  As a special exception, you may use this file as part of a free software
+ *  library without restriction.  Specifically, if other files instantiate
+ *  templates or use macros or inline functions from this file, or you compile
+ *  this file and link it with other files to produce an executable, this
+ *  file does not by itself cause the resulting executable to be covered by
+ *  the GNU General Public License.  This exception does not however
+ *  invalidate any other reasons why the executable file might be covered by
+ *  the GNU General Public License.
+ *
+ ****************************************************************************
+ */
+/*
+ * Throughput of the multi-producer queues: P producers push ntasks/P
+ * pointers each, one consumer pops all of them (checking that the sum is
+ * correct), for P = 1, 2, 4, ..., maxP.
+ *   - dynqueue     (2-lock Michael and Scott queue, mp_push/mp_pop)
+ *   - mp_dynqueue  (lock-free Michael and Scott queue with epoch-based
+ *                   reclamation)
+ *
+ * usage: perf_dynqueue [ntasks [maxP]]
+ *
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+#include <sched.h>
+#include <ff/dynqueue.hpp>
+#include <ff/mpdynqueue.hpp>
+#include <ff/utils.hpp>
+
+using namespace ff;
+
+static long ntasks = 200000;
+static long maxP   = 64;
+
+// spins a while and then leaves the core (needed if the threads share it)
+struct backoff {
+    inline void operator()() { if (++cnt == 1024) { cnt=0; sched_yield(); } }
+    int cnt=0;
+};
+
+template<typename Q>
+static double throughput(Q &q, long nprod) {
+    const long n = ntasks/nprod;
+    std::vector<std::thread> producers;
+    ffTime(START_TIME);
+    for(long p=0;p<nprod;++p)
+        producers.push_back(std::thread([&q,n,p]() {
+            for(long i=1;i<=n;++i)
+                q.mp_push((void*)(p*n+i));
+        }));
+    backoff wait;
+    long sum = 0;
+    for(long i=0;i<n*nprod;++i) {
+        void *t;
+        while(!q.mp_pop(&t)) wait();
+        sum += (long)t;
+    }
+    ffTime(STOP_TIME);
+    for(long p=0;p<nprod;++p) producers[p].join();
+    const long N = n*nprod;
+    void *t;
+    if (sum != N*(N+1)/2 || q.mp_pop(&t)) {
+        error("wrong sum %ld != %ld\n", sum, N*(N+1)/2);
+        abort();
+    }
+    return N / (ffTime(GET_TIME)/1000.0) / 1e6;
+}
+
+template<typename Q>
+static double run(long nprod) {
+    Q q;
+    if (!q.init()) {
+        error("init failed\n");
+        abort();
+    }
+    return throughput(q, nprod);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc>1) ntasks = atol(argv[1]);
+    if (argc>2) maxP   = atol(argv[2]);
+    printf("ntasks=%ld\n", ntasks);
+    printf("%5s %20s %20s\n", "P", "dynqueue", "mp_dynqueue");
+    for(long p=1;p<=maxP;p*=2) {
+        const double d  = run<dynqueue>(p);
+        const double md = run<mp_dynqueue>(p);
+        printf("%5ld %13.2f Mops/s %13.2f Mops/s\n", p, d, md);
+    }
+    return 0;
+}
@@ -0,0 +1,158 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/* ***************************************************************************
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ *  As a special exception, you may use this file as part of a free software
+ *  library without restriction.  Specifically, if other files instantiate
+ *  templates or use macros or inline functions from this file, or you compile
+ *  this file and link it with other files to produce an executable, this
+ *  file does not by itself cause the resulting executable to be covered by
+ *  the GNU General Public License.  This exception does not however
+ *  invalidate any other reasons why the executable file might be covered by
+ *  the GNU General Public License.
+ *
+ ****************************************************************************
+ */
+/*
+ * Message rate of a farm with empty workers, where the Emitter and the
+ * Collector are the bottleneck, and of the sharded farm with S = 1, 2, 4,
+ * ..., maxS shards:
+ *
+ *   farm:          E -> nw workers -> C
+ *   sharded farm:  S x (E -> nw/S workers -> C)
+ *
+ * The Emitters generate ntasks tasks in total, the Collectors count them
+ * and check their sum. Then the sharded farm is used as the middle stage
+ * of a pipeline (Gen -> sharded farm -> Sink) to check that the stream is
+ * received correctly.
+ *
+ * usage: perf_shardfarm [ntasks [nworkers [maxS]]]
+ *
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <ff/ff.hpp>
+#include <ff/shardfarm.hpp>
+
+using namespace ff;
+
+static long ntasks = 1000000;
+static long nw     = 8;
+static long maxS   = 4;
+
+// sends the tasks first, first+1, ..., first+n-1
+struct Emitter: ff_node_t<long> {
+    Emitter(long first, long n):first(first), n(n) {}
+    long* svc(long*) {
+        for(long i=first;i<first+n;++i) ff_send_out((long*)i);
+        return EOS;
+    }
+    const long first, n;
+};
+struct Worker: ff_node_t<long> {
+    long* svc(long* t) { return t; }
+};
+struct Collector: ff_node_t<long> {
+    long* svc(long* t) {
+        ++cnt; sum += (long)t;
+        return GO_ON;
+    }
+    long cnt=0, sum=0;
+};
+
+static void check(long cnt, long sum) {
+    if (cnt != ntasks || sum != ntasks*(ntasks+1)/2) {
+        error("wrong result: %ld tasks (%ld expected), sum %ld (%ld expected)\n",
+              cnt, ntasks, sum, ntasks*(ntasks+1)/2);
+        abort();
+    }
+}
+
+static double farm() {
+    Emitter   E(1, ntasks);
+    Collector C;
+    std::vector<std::unique_ptr<ff_node> > W;
+    for(long i=0;i<nw;++i) W.push_back(make_unique<Worker>());
+    ff_Farm<long> farm(std::move(W), E, C);
+    if (farm.run_and_wait_end()<0) {
+        error("running farm\n");
+        abort();
+    }
+    check(C.cnt, C.sum);
+    return ntasks / farm.ffTime() / 1000.0;
+}
+
+static double sharded(long S) {
+    std::vector<ff_node*> E, W, C;
+    long first = 1;
+    for(long s=0;s<S;++s) {
+        const long n = ntasks/S + (s < ntasks%S ? 1 : 0);
+        E.push_back(new Emitter(first, n));
+        C.push_back(new Collector);
+        first += n;
+    }
+    for(long i=0;i<nw;++i) W.push_back(new Worker);
+    ff_sharded_farm farm(S);
+    farm.add_emitters(E);
+    farm.add_workers(W);
+    farm.add_collectors(C);
+    farm.cleanup_all();
+    if (farm.run_and_wait_end()<0) {
+        error("running sharded farm\n");
+        abort();
+    }
+    long cnt=0, sum=0;
+    for(long s=0;s<S;++s) {
+        cnt += ((Collector*)C[s])->cnt;
+        sum += ((Collector*)C[s])->sum;
+    }
+    check(cnt, sum);
+    return ntasks / farm.ffTime() / 1000.0;
+}
+
+// the sharded farm as the middle stage of a pipeline
+static double pipeline(long S) {
+    Emitter   Gen(1, ntasks);
+    Collector Sink;
+    std::vector<ff_node*> W;
+    for(long i=0;i<nw;++i) W.push_back(new Worker);
+    ff_sharded_farm farm(S);
+    farm.add_workers(W);
+    farm.cleanup_workers();
+    ff_Pipe<> pipe(Gen, farm, Sink);
+    if (pipe.run_and_wait_end()<0) {
+        error("running pipeline\n");
+        abort();
+    }
+    check(Sink.cnt, Sink.sum);
+    return ntasks / pipe.ffTime() / 1000.0;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc>1) ntasks = atol(argv[1]);
+    if (argc>2) nw     = atol(argv[2]);
+    if (argc>3) maxS   = atol(argv[3]);
+    if (maxS > nw) maxS = nw;
+    printf("ntasks=%ld nworkers=%ld\n", ntasks, nw);
+    printf("%-14s %10.2f Mtasks/s\n", "farm", farm());
+    for(long s=1;s<=maxS;s*=2) {
+        char name[32];
+        snprintf(name, sizeof(name), "sharded S=%ld", s);
+        printf("%-14s %10.2f Mtasks/s\n", name, sharded(s));
+    }
+    printf("%-14s %10.2f Mtasks/s\n", "pipeline", pipeline(maxS));
+    return 0;
+}
@@ -0,0 +1,119 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/* ***************************************************************************
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ *  As a special exception, you may use this file as part of a free software
+ *  library without restriction.  Specifically, if other files instantiate
+ *  templates or use macros or inline functions from this file, or you compile
+ *  this file and link it with other files to produce an executable, this
+ *  file does not by itself cause the resulting executable to be covered by
+ *  the GNU General Public License.  This exception does not however
+ *  invalidate any other reasons why the executable file might be covered by
+ *  the GNU General Public License.
+ *
+ ****************************************************************************
+ */
+/*
+ * Tests the adaptive backoff of the non-blocking mode (see backoff.hpp).
+ *
+ *   Gen ---> Sink
+ *
+ * Gen sends bursts separated by idle periods. The statistics of the Sink
+ * input channel are read by the main thread while the pipeline is running,
+ * at the end the Sink must have slept between the bursts, so the process
+ * CPU time must be a fraction of the elapsed time even if the nodes do
+ * not use the blocking mode. In the blocking mode the backoff is not used,
+ * only the result is checked.
+ *
+ */
+
+#include <cstdio>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <ff/ff.hpp>
+
+using namespace ff;
+
+const long NBURSTS = 10;
+const long BURST   = 1000;
+const long IDLE_US = 50000;
+
+struct Gen: ff_node_t<long> {
+    long* svc(long*) {
+        for(long i=0;i<NBURSTS;++i) {
+            for(long j=1;j<=BURST;++j) ff_send_out((long*)j);
+            usleep(IDLE_US);
+        }
+        return EOS;
+    }
+};
+struct Sink: ff_node_t<long> {
+    long* svc(long*) { ++cnt; return GO_ON; }
+    long cnt=0;
+};
+
+static double cputime() {
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_utime.tv_sec*1000.0 + ru.ru_utime.tv_usec/1000.0 +
+           ru.ru_stime.tv_sec*1000.0 + ru.ru_stime.tv_usec/1000.0;
+}
+
+static void print(const char* what, const ff_backoff_stats& s) {
+    printf("%s: waits %lu, retries %lu, sleeps %lu, lost %llu ticks, avg wait %llu ticks, spin limit %llu ticks\n",
+           what, s.waits, s.retries, s.sleeps, (unsigned long long)s.lostticks,
+           (unsigned long long)s.avgwait, (unsigned long long)s.spinlimit);
+}
+
+int main() {
+    Gen  gen;
+    Sink sink;
+    ff_Pipe<> pipe(gen, sink);
+
+    const double cpu0 = cputime();
+    if (pipe.run()<0) {
+        error("running pipe\n");
+        return -1;
+    }
+    usleep(IDLE_US*NBURSTS/2);
+    print("sink in (running)", sink.get_backoff_in());
+    if (pipe.wait()<0) {
+        error("waiting pipe\n");
+        return -1;
+    }
+    const double cpu  = cputime()-cpu0;
+    const double wall = pipe.ffTime();
+    const ff_backoff_stats s = sink.get_backoff_in();
+    print("sink in", s);
+    printf("tasks %ld, elapsed %.2f (ms), cpu %.2f (ms)\n", sink.cnt, wall, cpu);
+
+    if (sink.cnt != NBURSTS*BURST) {
+        error("wrong result\n");
+        return -1;
+    }
+#if !defined(BLOCKING_MODE)
+    if (s.waits == 0 || s.lostticks == 0) {
+        error("wrong backoff statistics\n");
+        return -1;
+    }
+#if !defined(FF_NO_ADAPTIVE_BACKOFF)
+    if (s.sleeps == 0 || cpu > 0.5*wall) {
+        error("too much CPU time while idle\n");
+        return -1;
+    }
+#endif
+#endif
+    return 0;
+}
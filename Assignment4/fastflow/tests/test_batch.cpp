@@ -0,0 +1,264 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/* ***************************************************************************
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ *  As a special exception, you may use this file as part of a free software
+ *  library without restriction.  Specifically, if other files instantiate
+ *  templates or use macros or inline functions from this file, or you compile
+ *  this file and link it with other files to produce an executable, this
+ *  file does not by itself cause the resulting executable to be covered by
+ *  the GNU General Public License.  This exception does not however
+ *  invalidate any other reasons why the executable file might be covered by
+ *  the GNU General Public License.
+ *
+ ****************************************************************************
+ */
+/*
+ * Tests the batch-aware farm (see batch.hpp).
+ *
+ *               | -> Worker -> |
+ *   Emitter --> | -> Worker -> | --> Collector
+ *               | -> Worker -> |
+ *
+ *  1. The Emitter sends NTASKS tasks with ff_send_out, they reach the
+ *     workers in bundles: each task must be received exactly once and the
+ *     bundles must be fewer than the tasks (also with the FF_SCHED_LOW
+ *     policy, whose counters are per task).
+ *  2. The farm is the second stage of a pipeline whose first stage sends a
+ *     task every SLOWUS microseconds: the bundles are sent before they are
+ *     full (time-based flush), all the tasks must arrive.
+ *  3. A multi-output Emitter sends each task to a given worker with
+ *     ff_send_out_to and one task in broadcast: each worker must receive
+ *     only its tasks, and the broadcast once.
+ *  4. As 2. but the slow source is the Emitter of the farm.
+ *  5. A slow multi-output Emitter sends the first task to worker 0 and all
+ *     the others to worker 1: the bundle of worker 0 must be sent when it
+ *     is old, not at the end of the stream.
+ *  6. A worker of a run_then_freeze farm returns GO_OUT in the middle of a
+ *     bundle: the rest of the bundle must be served on the next run.
+ */
+
+#include <cstdio>
+#include <vector>
+#include <atomic>
+#include <ff/ff.hpp>
+
+using namespace ff;
+
+const long NWORKERS = 3;
+const long NTASKS   = 100000;
+const long NSLOW    = 100;
+const long SLOWUS   = 500;
+const long BCAST    = NTASKS+1;
+
+static long errors = 0;
+static std::atomic<long> nsent{0};
+
+struct Emitter: ff_node_t<long> {
+    long* svc(long*) {
+        for(long i=1;i<=NTASKS;++i) ff_send_out((long*)i);
+        return EOS;
+    }
+};
+struct SlowSource: ff_node_t<long> {
+    long* svc(long*) {
+        for(long i=1;i<=NSLOW;++i) {
+            ff_send_out((long*)i);
+            usleep(SLOWUS);
+        }
+        return EOS;
+    }
+};
+struct SlowToEmitter: ff_monode_t<long> {
+    long* svc(long*) {
+        for(long i=1;i<=NSLOW;++i) {
+            ff_send_out_to((long*)i, (i==1) ? 0 : 1);
+            nsent.fetch_add(1);
+            usleep(SLOWUS);
+        }
+        return EOS;
+    }
+};
+struct ToEmitter: ff_monode_t<long> {
+    long* svc(long*) {
+        for(long i=1;i<=NTASKS;++i) {
+            ff_send_out_to((long*)i, (int)(i % NWORKERS));
+            if (i == NTASKS/2) broadcast_task((long*)BCAST);
+        }
+        return EOS;
+    }
+};
+struct Worker: ff_node_t<long> {
+    Worker(bool checkid=false):checkid(checkid) {}
+    long* svc(long* t) {
+        // the first task of test5 must not wait for the end of the stream
+        if ((long)t == 1 && nsent.load() > NSLOW/2) {
+            printf("task 1 received after %ld tasks sent\n", nsent.load());
+            ++errors;
+        }
+        if ((long)t == BCAST) { ++bcast; return GO_ON; }
+        if (checkid && ((long)t % NWORKERS) != get_my_id()) ++errors;
+        return t;
+    }
+    void svc_end() { if (checkid && bcast != 1) ++errors; }
+    const bool checkid;
+    long       bcast = 0;
+};
+struct OnceEmitter: ff_node_t<long> {
+    long* svc(long*) {
+        if (first) for(long i=1;i<=NSLOW;++i) ff_send_out((long*)i);
+        first = false;
+        return EOS;
+    }
+    bool first = true;
+};
+struct OutWorker: ff_node_t<long> {
+    long* svc(long* t) {
+        ++cnt; sum += (long)t;
+        return ((long)t == FF_BATCH_SIZE/2) ? GO_OUT : GO_ON;
+    }
+    long cnt = 0, sum = 0;
+};
+struct Collector: ff_node_t<long> {
+    long* svc(long* t) {
+        ++cnt; sum += (long)t;
+        return GO_ON;
+    }
+    long cnt = 0, sum = 0;
+};
+
+static bool check(const char* name, ff_farm& farm, const Collector& C, long n, bool partial) {
+    const ff_batcher* b = farm.getBatcher();
+    if (!b) { printf("%s: no batching\n", name); return false; }
+    printf("%s: %lu tasks in %lu bundles (%zu allocated)\n", name, b->tasks(), b->bundles(), b->allocated());
+    bool ok = (C.cnt == n) && (C.sum == n*(n+1)/2) && (b->tasks() >= (unsigned long)n);
+    if (partial) ok = ok && b->bundles() > (unsigned long)(n / FF_BATCH_SIZE);
+    else         ok = ok && b->bundles() < (unsigned long)n;
+    if (!ok) printf("%s: wrong result, %ld tasks received (sum %ld)\n", name, C.cnt, C.sum);
+    return ok;
+}
+
+static bool test1(ff_sched_t policy, const char* name) {
+    Emitter   E;
+    Collector C;
+    std::vector<std::unique_ptr<ff_node> > W;
+    for(long i=0;i<NWORKERS;++i) W.push_back(make_unique<Worker>());
+    ff_Farm<long> farm(std::move(W), E, C);
+    farm.set_batching();
+    farm.set_scheduling_policy(policy);
+    if (farm.run_and_wait_end()<0) {
+        error("running farm\n");
+        return false;
+    }
+    bool ok = check(name, farm, C, NTASKS, false);
+    if (policy == FF_SCHED_LOW) {
+        unsigned long done = 0;
+        for(long i=0;i<NWORKERS;++i) done += farm.getWorkerCompleted(i);
+        if (done != (unsigned long)NTASKS) { printf("%s: %lu tasks completed\n", name, done); ok = false; }
+    }
+    return ok;
+}
+
+static bool test2() {
+    SlowSource S;
+    Collector  C;
+    std::vector<std::unique_ptr<ff_node> > W;
+    for(long i=0;i<NWORKERS;++i) W.push_back(make_unique<Worker>());
+    ff_Farm<long> farm(std::move(W));
+    farm.set_batching();
+    ff_Pipe<> pipe(S, farm, C);
+    if (pipe.run_and_wait_end()<0) {
+        error("running pipeline\n");
+        return false;
+    }
+    return check("flush", farm, C, NSLOW, true);
+}
+
+static bool test3() {
+    ToEmitter E;
+    Collector C;
+    std::vector<std::unique_ptr<ff_node> > W;
+    for(long i=0;i<NWORKERS;++i) W.push_back(make_unique<Worker>(true));
+    ff_Farm<long> farm(std::move(W), E, C);
+    farm.set_batching();
+    if (farm.run_and_wait_end()<0) {
+        error("running farm\n");
+        return false;
+    }
+    return check("send_out_to", farm, C, NTASKS, false);
+}
+
+static bool test4() {
+    SlowSource E;
+    Collector  C;
+    std::vector<std::unique_ptr<ff_node> > W;
+    for(long i=0;i<NWORKERS;++i) W.push_back(make_unique<Worker>());
+    ff_Farm<long> farm(std::move(W), E, C);
+    farm.set_batching();
+    if (farm.run_and_wait_end()<0) {
+        error("running farm\n");
+        return false;
+    }
+    return check("source flush", farm, C, NSLOW, true);
+}
+
+static bool test5() {
+    SlowToEmitter E;
+    Collector     C;
+    std::vector<std::unique_ptr<ff_node> > W;
+    for(long i=0;i<NWORKERS;++i) W.push_back(make_unique<Worker>());
+    ff_Farm<long> farm(std::move(W), E, C);
+    farm.set_batching();
+    nsent.store(0);
+    if (farm.run_and_wait_end()<0) {
+        error("running farm\n");
+        return false;
+    }
+    return check("send_out_to flush", farm, C, NSLOW, true);
+}
+
+static bool test6() {
+    OnceEmitter E;
+    OutWorker   W;
+    std::vector<ff_node*> w(1, &W);
+    ff_farm farm(w, &E);
+    farm.remove_collector();
+    farm.set_batching();
+    for(int i=0;i<2;++i) {
+        if (farm.run_then_freeze()<0) {
+            error("running farm\n");
+            return false;
+        }
+        farm.wait_freezing();
+    }
+    farm.wait();
+    printf("go_out: %ld tasks received\n", W.cnt);
+    return (W.cnt == NSLOW) && (W.sum == NSLOW*(NSLOW+1)/2);
+}
+
+int main() {
+    bool ok = test1(FF_SCHED_RR, "round-robin");
+    ok = test1(FF_SCHED_LOW, "least outstanding") && ok;
+    ok = test2() && ok;
+    ok = test3() && ok;
+    ok = test4() && ok;
+    ok = test5() && ok;
+    ok = test6() && ok;
+    if (!ok || errors) {
+        printf("test_batch: FAILED (%ld errors)\n", errors);
+        return -1;
+    }
+    printf("test_batch: OK\n");
+    return 0;
+}
@@ -0,0 +1,110 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/* ***************************************************************************
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ *  As a special exception, you may use this file as part of a free software
+ *  library without restriction.  Specifically, if other files instantiate
+ *  templates or use macros or inline functions from this file, or you compile
+ *  this file and link it with other files to produce an executable, this
+ *  file does not by itself cause the resulting executable to be covered by
+ *  the GNU General Public License.  This exception does not however
+ *  invalidate any other reasons why the executable file might be covered by
+ *  the GNU General Public License.
+ *
+ ****************************************************************************
+ */
+/*
+ * Tests the broadcast of reference-counted envelopes (see envelope.hpp).
+ *
+ *               | -> Worker -> |
+ *   Emitter --> | -> Worker -> | --> Collector
+ *               | -> Worker -> |
+ *
+ * The Emitter (multi-output) sends NTABLES big tables in broadcast. Each
+ * table is allocated once and never copied, the workers read it and
+ * release it, but they keep the last table received until the end (as
+ * it were the parameters of a model). Each table must be destroyed exactly
+ * once, after all the workers have used it.
+ */
+
+#include <cstdio>
+#include <vector>
+#include <atomic>
+#include <ff/ff.hpp>
+
+using namespace ff;
+
+const long NWORKERS = 4;
+const long NTABLES  = 200;
+const long TSIZE    = 1<<14;
+
+static std::atomic<long> built{0}, copied{0}, destroyed{0};
+
+struct Table {
+    Table(long v):id(v),data(TSIZE, v) { ++built; }
+    Table(const Table& t):id(t.id),data(t.data) { ++copied; }
+    ~Table() { ++destroyed; }
+    long              id;
+    std::vector<long> data;
+};
+
+struct Emitter: ff_monode_t<long, ff_envelope<Table> > {
+    ff_envelope<Table>* svc(long*) {
+        for(long i=1;i<=NTABLES;++i)
+            broadcast_shared(ff_envelope<Table>::emplace(i));
+        return EOS;
+    }
+};
+struct Worker: ff_node_t<ff_envelope<Table>, long> {
+    long* svc(ff_envelope<Table>* e) {
+        const Table& t = e->view();
+        long sum = 0;
+        for(size_t i=0;i<t.data.size();++i) sum += t.data[i];
+        if (sum != t.id*TSIZE || destroyed.load() >= t.id) ++errors;
+        last = ff_envelope_ref<Table>(e);   // the previous one is released
+        return (long*)t.id;
+    }
+    void svc_end() {
+        if (!last || last->id != NTABLES) ++errors;
+        last.reset();
+    }
+    ff_envelope_ref<Table> last;
+    long errors = 0;
+};
+struct Collector: ff_node_t<long> {
+    long* svc(long* t) { sum += (long)t; ++cnt; return GO_ON; }
+    long sum=0, cnt=0;
+};
+
+int main() {
+    Emitter   E;
+    Collector C;
+    std::vector<std::unique_ptr<ff_node> > W;
+    for(long i=0;i<NWORKERS;++i) W.push_back(make_unique<Worker>());
+    ff_Farm<long> farm(std::move(W), E, C);
+    if (farm.run_and_wait_end()<0) {
+        error("running farm\n");
+        return -1;
+    }
+    long errors = 0;
+    for(long i=0;i<NWORKERS;++i) errors += ((Worker*)farm.getWorkers()[i])->errors;
+    printf("elapsed %.2f (ms), tables built %ld, copied %ld, destroyed %ld\n",
+           farm.ffTime(), built.load(), copied.load(), destroyed.load());
+    if (errors || C.cnt != NWORKERS*NTABLES || C.sum != NWORKERS*NTABLES*(NTABLES+1)/2 ||
+        built != NTABLES || copied != 0 || destroyed != NTABLES) {
+        error("wrong result\n");
+        return -1;
+    }
+    return 0;
+}
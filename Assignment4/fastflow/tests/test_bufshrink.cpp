@@ -0,0 +1,102 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/* ***************************************************************************
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ *  As a special exception, you may use this file as part of a free software
+ *  library without restriction.  Specifically, if other files instantiate
+ *  templates or use macros or inline functions from this file, or you compile
+ *  this file and link it with other files to produce an executable, this
+ *  file does not by itself cause the resulting executable to be covered by
+ *  the GNU General Public License.  This exception does not however
+ *  invalidate any other reasons why the executable file might be covered by
+ *  the GNU General Public License.
+ *
+ ****************************************************************************
+ */
+/*
+ * Tests the high-water/low-water memory policy of the unbounded
+ * uSWSR_Ptr_Buffer (see set_shrink_policy in ubuffer.hpp): after a burst
+ * the queue keeps at most FF_UBUFFER_HIGHWATER cached buffers, and once it
+ * has been quiet for a while they are freed down to the low-water mark.
+ * Then a bounded queue is resized while it is full: the footprint counts
+ * both rings and the peak does not change when the old one is drained.
+ *
+ */
+
+#include <cstdio>
+#include <ff/ff.hpp>
+
+using namespace ff;
+
+static void check(bool c, const char *msg) {
+    if (!c) { error("%s\n", msg); abort(); }
+}
+
+int main() {
+    const size_t SIZE  = 64;
+    INTERNAL_BUFFER_T probe(SIZE);
+    check(probe.init(), "init (probe)");
+    const size_t BUFSZ = sizeof(INTERNAL_BUFFER_T)+probe.ringbytes();
+    const long   NBUFS = 2*FF_UBUFFER_HIGHWATER;
+    
+    uSWSR_Ptr_Buffer q(SIZE, false);
+    q.set_shrink_policy(1, 20000);   // 1 cached buffer after 20ms
+    check(q.init(), "init");
+    check(q.footprint() == BUFSZ, "initial footprint");
+
+    // burst: the queue grows up to NBUFS internal buffers
+    for(long i=1;i<=(long)(NBUFS*SIZE);++i) q.push((void*)i);
+    check(q.footprint() >= NBUFS*BUFSZ, "footprint after the burst");
+    const size_t peak = q.peak_footprint();
+    check(peak == q.footprint(), "peak footprint");
+    
+    void* data;
+    long expected=1;
+    while(q.pop(&data)) check((long)data == expected++, "wrong order");
+    check(expected == (long)(NBUFS*SIZE)+1, "wrong count");
+    // the buffers above the high-water mark have been freed
+    check(q.footprint() <= (FF_UBUFFER_HIGHWATER+2)*BUFSZ, "high-water mark");
+    check(q.footprint() > 2*BUFSZ, "buffers should still be cached");
+    
+    usleep(40000);
+    check(!q.pop(&data), "queue not empty");  // here the queue is shrunk
+    check(q.footprint() == 2*BUFSZ, "low-water mark");
+    check(q.peak_footprint() == peak, "peak footprint changed");
+
+    // the cached buffer is re-used, the freed ones re-allocated
+    for(long i=1;i<=(long)(4*SIZE);++i) q.push((void*)i);
+    expected=1;
+    while(q.pop(&data)) check((long)data == expected++, "wrong order (2)");
+    check(expected == (long)(4*SIZE)+1, "wrong count (2)");
+
+    printf("footprint: peak %zu bytes, now %zu bytes\n", peak, q.footprint());
+
+    const size_t BIG = 8192, SMALL = 512;
+    uSWSR_Ptr_Buffer b(BIG, true);
+    check(b.init(), "init (bounded)");
+    const size_t big = b.footprint();
+    for(long i=1;i<=(long)BIG;++i) check(b.push((void*)i), "push (bounded)");
+    check(b.resize(SMALL), "resize");
+    check(b.push((void*)(BIG+1)), "push after the resize");
+    const size_t both = b.footprint();
+    check(both > big, "footprint of the two rings");
+    check(b.peak_footprint() == both, "peak footprint (bounded)");
+    expected=1;
+    while(b.pop(&data)) check((long)data == expected++, "wrong order (3)");
+    check(expected == (long)BIG+2, "wrong count (3)");
+    check(b.peak_footprint() == both, "peak footprint rescaled");
+    printf("resized: peak %zu bytes, ring of %zu entries %zu bytes\n", both, BIG, big);
+    printf("done\n");
+    return 0;
+}
@@ -0,0 +1,134 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/* ***************************************************************************
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ *  As a special exception, you may use this file as part of a free software
+ *  library without restriction.  Specifically, if other files instantiate
+ *  templates or use macros or inline functions from this file, or you compile
+ *  this file and link it with other files to produce an executable, this
+ *  file does not by itself cause the resulting executable to be covered by
+ *  the GNU General Public License.  This exception does not however
+ *  invalidate any other reasons why the executable file might be covered by
+ *  the GNU General Public License.
+ *
+ ****************************************************************************
+ */
+/*
+ *
+ *   Gen --> Square (ParallelFor) --> Sink
+ *
+ * This program tests the coreBudget: the ParallelFor team created inside the
+ * second stage must fit in the cores left free by the pipeline threads, the
+ * cores handed out by coreLease and to two ParallelFor teams built together
+ * must be disjoint and all cores must be given back at the end.
+ *
+ */
+
+#if !defined(FF_CORE_BUDGET)
+#define FF_CORE_BUDGET
+#endif
+#include <vector>
+#include <ff/ff.hpp>
+#include <ff/parallel_for.hpp>
+
+using namespace ff;
+
+const long SIZE   = 1000;
+const long NTASKS = 20;
+
+struct Gen: ff_node_t<std::vector<long> > {
+    std::vector<long>* svc(std::vector<long>*) {
+        for(long i=0;i<NTASKS;++i)
+            ff_send_out(new std::vector<long>(SIZE, i));
+        return EOS;
+    }
+};
+struct Square: ff_node_t<std::vector<long> > {
+    std::vector<long>* svc(std::vector<long>* v) {
+        const ssize_t avail = coreBudget::instance()->available();
+        ParallelFor pf;
+        // the scheduler thread takes one of the free cores
+        if ((ssize_t)pf.getNWorkers() > std::max(avail-1, (ssize_t)1)) {
+            error("team of %ld threads, but only %ld free cores\n", pf.getNWorkers(), avail);
+            abort();
+        }
+        pf.parallel_for(0, SIZE, [v](const long i) { (*v)[i] *= (*v)[i]; });
+        return v;
+    }
+};
+struct Sink: ff_node_t<std::vector<long> > {
+    std::vector<long>* svc(std::vector<long>* v) {
+        for(long i=0;i<SIZE;++i)
+            if ((*v)[i] != cnt*cnt) {
+                error("wrong result %ld != %ld\n", (*v)[i], cnt*cnt);
+                abort();
+            }
+        ++cnt;
+        delete v;
+        return GO_ON;
+    }
+    long cnt=0;
+};
+
+// the cores of the threads of a ParallelFor team (workers and scheduler)
+static void team_cores(ParallelFor& pf, std::vector<int>& ids) {
+    const svector<ff_node*>& w = pf.getWorkers();
+    for(size_t i=0;i<w.size();++i)
+        if (w[i]->getCPUId()>=0) ids.push_back(w[i]->getCPUId());
+    if (pf.getEmitter()->getCPUId()>=0) ids.push_back(pf.getEmitter()->getCPUId());
+}
+
+int main() {
+    coreBudget *cb = coreBudget::instance();
+    const size_t total = cb->size();
+    printf("core budget: %ld cores\n", total);
+
+    {   // leases are disjoint and never exceed the budget
+        coreLease l1(total/2+1), l2(total);
+        if (l1.size()+l2.size() != total) abort();
+        for(size_t i=0;i<l1.size();++i)
+            for(size_t j=0;j<l2.size();++j)
+                if (l1[i]==l2[j]) abort();
+        if (cb->available() != 0) abort();
+    }
+    if (cb->available() != total) abort();
+
+    {   // two teams built together do not share cores
+        ParallelFor pf1(total), pf2(total);
+        std::vector<int> ids;
+        team_cores(pf1, ids);
+        team_cores(pf2, ids);
+        if (ids.size()+cb->available() != total) abort();
+        for(size_t i=0;i<ids.size();++i)
+            for(size_t j=i+1;j<ids.size();++j)
+                if (ids[i]==ids[j]) abort();
+        printf("two teams of %ld and %ld threads on %ld cores\n",
+               pf1.getNWorkers(), pf2.getNWorkers(), ids.size());
+    }
+    if (cb->available() != total) abort();
+
+    Gen gen; Square square; Sink sink;
+    ff_Pipe<> pipe(gen, square, sink);
+    if (pipe.run_and_wait_end()<0) {
+        error("running pipe\n");
+        return -1;
+    }
+    if (sink.cnt != NTASKS) abort();
+    if (cb->available() != total) {
+        error("%ld cores not given back\n", total-cb->available());
+        return -1;
+    }
+    printf("done\n");
+    return 0;
+}
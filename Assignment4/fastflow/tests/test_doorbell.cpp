@@ -0,0 +1,151 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/* ***************************************************************************
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ *  As a special exception, you may use this file as part of a free software
+ *  library without restriction.  Specifically, if other files instantiate
+ *  templates or use macros or inline functions from this file, or you compile
+ *  this file and link it with other files to produce an executable, this
+ *  file does not by itself cause the resulting executable to be covered by
+ *  the GNU General Public License.  This exception does not however
+ *  invalidate any other reasons why the executable file might be covered by
+ *  the GNU General Public License.
+ *
+ ****************************************************************************
+ */
+/*
+ * Tests the doorbell of the farm's Collector (see doorbell.hpp).
+ *
+ *            | -> Worker -> |
+ *   Gen ---> | -> ...    -> | ---> Collector
+ *            | -> Worker -> |
+ *
+ * With NWORKERS workers the Collector probes only the non-empty channels,
+ * if the channel type supports the doorbell. One task out of 8 produces a
+ * burst of BURST results, the others are dropped, so most of the channels
+ * are empty most of the time. Each result must be received exactly once.
+ * The test is repeated with a user gatherer redefining selectworker, that
+ * must not use the doorbell nor drain more than one task per selectworker
+ * call. Before, a single channel checks that only the
+ * pushes finding the channel empty set its bit.
+ */
+
+#include <cstdio>
+#include <vector>
+#include <ff/ff.hpp>
+
+using namespace ff;
+
+const long NWORKERS = 32;
+const long NTASKS   = 4000;
+const long BURST    = 16;
+
+struct Gen: ff_node_t<long> {
+    long* svc(long*) {
+        for(long i=1;i<=NTASKS;++i) ff_send_out((long*)i);
+        return EOS;
+    }
+};
+struct Worker: ff_node_t<long> {
+    long* svc(long* t) {
+        if ((long)t % 8) return GO_ON;
+        for(long k=0;k<BURST;++k) ff_send_out((long*)((long)t*BURST+k));
+        return GO_ON;
+    }
+};
+// it redefines the gathering policy (here the default one, counted)
+struct MyGT: ff_gatherer {
+    MyGT(int max_num_workers):ff_gatherer(max_num_workers) {}
+    ssize_t selectworker() { ++calls; return ff_gatherer::selectworker(); }
+    long calls = 0;
+};
+struct Collector: ff_node_t<long> {
+    long* svc(long* t) {
+        const long v = (long)t;
+        const long task = v / BURST;
+        if (task < 1 || task > NTASKS || seen[v-BURST]) {
+            error("wrong result %ld\n", v);
+            ++errors;
+        } else seen[v-BURST] = true;
+        ++cnt;
+        // each result has been selected by a call of the user selectworker
+        if (gt) {
+            if (gt->calls == lastcalls) ++bypassed;
+            lastcalls = gt->calls;
+        }
+        return GO_ON;
+    }
+    std::vector<bool> seen = std::vector<bool>(NTASKS*BURST, false);
+    long cnt=0, errors=0;
+    MyGT* gt = nullptr;
+    long lastcalls=0, bypassed=0;
+};
+
+// the doorbell is used only if the channels support it (see ff_set_doorbell)
+template<typename B>
+static auto supported(B* b, int) -> decltype(b->set_doorbell(nullptr, 0), bool()) { return true; }
+template<typename B>
+static bool supported(B*, long) { return false; }
+
+static bool run(MyGT* gt) {
+    std::vector<std::unique_ptr<ff_node> > W;
+    for(long i=0;i<NWORKERS;++i) W.push_back(make_unique<Worker>());
+    ff_Farm<long> farm(std::move(W));
+    Collector col;
+    col.gt = gt;
+    farm.add_collector(col);
+    if (gt) farm.setgt(gt);
+    Gen gen;
+    ff_Pipe<> pipe(gen, farm);
+    if (pipe.run_and_wait_end()<0) {
+        error("running pipe\n");
+        return false;
+    }
+    const long expected = (NTASKS/8)*BURST;
+    const bool bell = farm.getgt()->has_doorbell();
+    printf("%s gatherer: elapsed %.2f (ms), results %ld, doorbell %s\n", gt ? "user" : "default",
+           pipe.ffTime(), col.cnt, bell ? "yes" : "no");
+    if (col.errors || col.cnt != expected) return false;
+    if (gt) return !bell && col.bypassed == 0;
+    const bool expbell = NWORKERS >= FF_DOORBELL_MIN_CHANNELS && supported((FFBUFFER*)nullptr, 0);
+    return bell == expbell;
+}
+
+static bool channel() {
+    ff_doorbell bell(1);
+    uSWSR_Ptr_Buffer q(8);
+    if (!q.init()) return false;
+    q.set_doorbell(&bell, 0);
+    void* data;
+    bool ok = true;
+    for(long i=1;i<=40;++i) {   // the ring wraps around several times
+        q.push((void*)i);
+        ok = ok && bell.any(1);
+        bell.clear(0);
+        q.push((void*)-i);      // the channel is not empty
+        ok = ok && !bell.any(1);
+        ok = ok && q.pop(&data) && q.pop(&data) && !q.pop(&data);
+    }
+    printf("channel: %s\n", ok ? "ok" : "wrong doorbell");
+    return ok;
+}
+
+int main() {
+    MyGT gt(NWORKERS);
+    if (!channel() || !run(nullptr) || !run(&gt)) {
+        error("wrong result\n");
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,116 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/* ***************************************************************************
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ *  As a special exception, you may use this file as part of a free software
+ *  library without restriction.  Specifically, if other files instantiate
+ *  templates or use macros or inline functions from this file, or you compile
+ *  this file and link it with other files to produce an executable, this
+ *  file does not by itself cause the resulting executable to be covered by
+ *  the GNU General Public License.  This exception does not however
+ *  invalidate any other reasons why the executable file might be covered by
+ *  the GNU General Public License.
+ *
+ ****************************************************************************
+ */
+/*
+ * Tests the elastic farm (see elastic.hpp).
+ *
+ *            | -> Worker -> |
+ *   Gen ---> |     ...      | ---> Collector
+ *            | -> Worker -> |
+ *
+ * Gen sends the tasks at a high rate, then at a low rate and then again
+ * at a high rate. The manager must remove workers during the low rate
+ * phase and add them back in the last phase, each task must be received
+ * exactly once.
+ *
+ */
+
+#include <cstdio>
+#include <iostream>
+#include <unistd.h>
+#include <ff/ff.hpp>
+#include <ff/elastic.hpp>
+
+using namespace ff;
+
+const long NWORKERS = 8;
+const long SVC_US   = 1000;
+const long NHIGH    = 300, HIGH_US = 200;
+const long NLOW     = 100, LOW_US  = 5000;
+const long NTASKS   = 2*NHIGH + NLOW;
+
+struct Gen: ff_node_t<long> {
+    long* svc(long*) {
+        long k=1;
+        for(long i=0;i<NHIGH;++i) { ff_send_out((long*)k++); usleep(HIGH_US); }
+        for(long i=0;i<NLOW;++i)  { ff_send_out((long*)k++); usleep(LOW_US); }
+        for(long i=0;i<NHIGH;++i) { ff_send_out((long*)k++); usleep(HIGH_US); }
+        return EOS;
+    }
+};
+struct Worker: ff_node_t<long> {
+    long* svc(long* t) {
+        usleep(SVC_US);
+        return t;
+    }
+};
+struct Collector: ff_minode_t<long> {
+    long* svc(long* t) { sum += (long)t; ++cnt; return GO_ON; }
+    long sum=0, cnt=0;
+};
+
+int main() {
+    Gen       gen;
+    Collector col;
+    std::vector<std::unique_ptr<ff_node> > W;
+    for(long i=0;i<NWORKERS;++i) W.push_back(make_unique<Worker>());
+    ff_Farm<long> farm(std::move(W));
+    farm.add_collector(col);
+    ff_Pipe<> pipe(gen, farm);
+
+    ff_elastic_manager mgr(farm, 1, NWORKERS, 20);
+    if (pipe.run()<0) {
+        error("running pipe\n");
+        return -1;
+    }
+    if (mgr.start()<0) {
+        error("starting the manager\n");
+        return -1;
+    }
+    if (pipe.wait()<0) {
+        error("waiting pipe\n");
+        return -1;
+    }
+    mgr.stop();
+    mgr.report(std::cout);
+    printf("elapsed %.2f (ms)\n", pipe.ffTime());
+    if (col.cnt != NTASKS || col.sum != NTASKS*(NTASKS+1)/2) {
+        error("wrong result\n");
+        return -1;
+    }
+    const std::vector<ff_elastic_manager::decision> d = mgr.decisions();
+    size_t minactive = NWORKERS;
+    bool   regrown   = false;
+    for(size_t i=0;i<d.size();++i) {
+        if (d[i].newn < minactive) minactive = d[i].newn;
+        else if (minactive < NWORKERS/2 && d[i].newn > d[i].oldn) regrown = true;
+    }
+    if (minactive >= NWORKERS/2 || !regrown) {
+        error("the number of workers has not been adapted\n");
+        return -1;
+    }
+    return 0;
+}
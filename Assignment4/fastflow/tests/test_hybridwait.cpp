@@ -0,0 +1,103 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/* ***************************************************************************
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ *  As a special exception, you may use this file as part of a free software
+ *  library without restriction.  Specifically, if other files instantiate
+ *  templates or use macros or inline functions from this file, or you compile
+ *  this file and link it with other files to produce an executable, this
+ *  file does not by itself cause the resulting executable to be covered by
+ *  the GNU General Public License.  This exception does not however
+ *  invalidate any other reasons why the executable file might be covered by
+ *  the GNU General Public License.
+ *
+ ****************************************************************************
+ */
+/*
+ * Tests the hybrid spin-then-park wait of the blocking mode (see
+ * parking.hpp): the stream is made of bursts separated by idle periods,
+ * all the tasks must arrive and the threads waiting for the next burst
+ * must sleep, i.e. the process CPU time must be a fraction of the
+ * elapsed time.
+ *
+ *   Gen ---> Fwd ---> Sink
+ *
+ */
+
+#include <cstdio>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <ff/ff.hpp>
+
+using namespace ff;
+
+const long NBURSTS = 10;
+const long BURST   = 1000;
+const long IDLE_US = 50000;
+
+struct Gen: ff_node_t<long> {
+    long* svc(long*) {
+        for(long i=0;i<NBURSTS;++i) {
+            for(long j=1;j<=BURST;++j) ff_send_out((long*)j);
+            usleep(IDLE_US);
+        }
+        return EOS;
+    }
+};
+struct Fwd: ff_node_t<long> {
+    long* svc(long* t) { return t; }
+};
+struct Sink: ff_node_t<long> {
+    long* svc(long* t) {
+        ++cnt; sum += (long)t;
+        return GO_ON;
+    }
+    long cnt=0, sum=0;
+};
+
+static double cputime() {
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_utime.tv_sec*1000.0 + ru.ru_utime.tv_usec/1000.0 +
+           ru.ru_stime.tv_sec*1000.0 + ru.ru_stime.tv_usec/1000.0;
+}
+
+int main() {
+    Gen  gen;
+    Fwd  fwd;
+    Sink sink;
+    ff_Pipe<> pipe(gen, fwd, sink);
+    pipe.blocking_mode(true);
+
+    const double cpu0 = cputime();
+    if (pipe.run_and_wait_end()<0) {
+        error("running pipe\n");
+        return -1;
+    }
+    const double cpu  = cputime()-cpu0;
+    const double wall = pipe.ffTime();
+    printf("tasks %ld, elapsed %.2f (ms), cpu %.2f (ms)\n", sink.cnt, wall, cpu);
+
+    if (sink.cnt != NBURSTS*BURST || sink.sum != NBURSTS*(BURST*(BURST+1)/2)) {
+        error("wrong result\n");
+        return -1;
+    }
+    // the idle time is NBURSTS*IDLE_US, the threads must not spin through it
+    if (cpu > 0.5*wall) {
+        error("too much CPU time while idle\n");
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,200 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/* ***************************************************************************
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ *  As a special exception, you may use this file as part of a free software
+ *  library without restriction.  Specifically, if other files instantiate
+ *  templates or use macros or inline functions from this file, or you compile
+ *  this file and link it with other files to produce an executable, this
+ *  file does not by itself cause the resulting executable to be covered by
+ *  the GNU General Public License.  This exception does not however
+ *  invalidate any other reasons why the executable file might be covered by
+ *  the GNU General Public License.
+ *
+ ****************************************************************************
+ */
+/*
+ * Tests the key-partitioned farm (see ff_farm::set_scheduling_bykey).
+ *
+ *            | -> Worker -> |
+ *   Gen ---> | -> Worker -> | ---> Collector
+ *            | -> Worker -> |
+ *            | -> Worker -> |
+ *
+ * The keys are skewed (half of the tasks have one of HOTKEYS keys). Each
+ * worker keeps the last sequence number received for each of its keys and
+ * checks that the tasks of a key arrive in order, the state moves with the
+ * key (ff_keyed_state). In the middle of the stream the farm goes down to
+ * 2 workers and then back to 4 (elastic farm), so that keys are also moved
+ * by consistent hashing. At the end each key must be in the worker where
+ * the partitioner says it is.
+ *
+ * Before, the partitioner alone is fed with hot keys that change at each
+ * window: the keys moved by rebalance must go back to their owner in the
+ * ring when they are no longer hot, so the keys kept do not grow.
+ *
+ */
+
+#include <cstdio>
+#include <map>
+#include <unordered_map>
+#include <atomic>
+#include <thread>
+#include <unistd.h>
+#include <ff/ff.hpp>
+
+using namespace ff;
+
+const long NTASKS   = 40000;
+const long NWORKERS = 4;
+const long NKEYS    = 256;
+const long HOTKEYS  = 4;
+
+// workers started, the farm has been prepared
+static std::atomic<long> started{0};
+
+struct task_t {
+    uint64_t key;
+    long     seq;
+};
+
+struct Gen: ff_node_t<task_t> {
+    Gen(ff_loadbalancer* lb):lb(lb) {}
+    task_t* svc(task_t*) {
+        std::vector<long> seq(NKEYS, 0);
+        unsigned long r = 12345;
+        for(long i=0;i<NTASKS;++i) {
+            r = r*6364136223846793005UL + 1442695040888963407UL;
+            const uint64_t k = ((r>>33) & 1) ? (r>>40) % HOTKEYS : (r>>40) % NKEYS;
+            task_t* t = new task_t;
+            t->key = k; t->seq = ++seq[k];
+            ff_send_out(t);
+            if (i == NTASKS/3)         resize(2);
+            if (i == NTASKS/3+100)     wait_resize(2);
+            if (i == 2*NTASKS/3)       resize(NWORKERS);
+            if (i == 2*NTASKS/3+100)   wait_resize(NWORKERS);
+        }
+        return EOS;
+    }
+    void resize(size_t n) {
+        while(started.load() < NWORKERS) std::this_thread::yield();
+        if (lb->set_active_workers(n)<0) ++errors;
+    }
+    // the Emitter applies it when it schedules the next task
+    void wait_resize(size_t n) {
+        while(lb->get_active_workers() != n) std::this_thread::yield();
+    }
+    ff_loadbalancer* lb;
+    long errors=0;
+};
+struct Worker: ff_node_t<task_t>, ff_keyed_state {
+    int svc_init() { started.fetch_add(1); return 0; }
+    task_t* svc(task_t* t) {
+        long& last = state[t->key];
+        if (t->seq != last+1) {
+            error("worker %ld, key %lu: task %ld after %ld\n", get_my_id(), t->key, t->seq, last);
+            errors++;
+        }
+        last = t->seq;
+        return t;
+    }
+    void* extract_key_state(uint64_t key) {
+        std::map<uint64_t,long>::iterator it = state.find(key);
+        if (it == state.end()) return nullptr;
+        long* s = new long(it->second);
+        state.erase(it);
+        return s;
+    }
+    void install_key_state(uint64_t key, void* s) {
+        state[key] = *(long*)s;
+        delete (long*)s;
+    }
+    std::map<uint64_t,long> state;
+    long errors=0;
+};
+struct Collector: ff_minode_t<task_t> {
+    task_t* svc(task_t* t) { ++cnt; delete t; return GO_ON; }
+    long cnt=0;
+};
+
+static bool shifting_hot_keys() {
+    const long NWINDOWS = 50;
+    ff_key_partitioner kp([](void* t) { return (uint64_t)t; }, NWORKERS);
+    std::unordered_map<uint64_t,size_t> where;   // worker with the state of a key
+    long errors = 0;
+    size_t maxkeys = 0;
+    auto moved = [&](uint64_t k, size_t from, size_t to) {
+        if (where.count(k) && where[k] != from) ++errors;
+        where[k] = to;
+    };
+    unsigned long r = 6789;
+    for(long win=0; win<NWINDOWS; ++win) {
+        while(!kp.window_done()) {
+            r = r*6364136223846793005UL + 1442695040888963407UL;
+            // half of the tasks on the HOTKEYS keys of this window
+            const uint64_t k = ((r>>33) & 1) ? 100000*(win+1) + (r>>40) % HOTKEYS : (r>>40) % NKEYS;
+            size_t from;
+            const size_t w = kp.route(k, from);
+            if (from != w || !where.count(k)) moved(k, from, w);
+            else if (where[k] != w) ++errors;
+        }
+        const std::vector<ff_key_partitioner::move_t> m = kp.rebalance();
+        for(size_t i=0;i<m.size();++i) moved(m[i].key, m[i].from, m[i].to);
+        if (kp.nkeys() > maxkeys) maxkeys = kp.nkeys();
+    }
+    for(std::unordered_map<uint64_t,size_t>::iterator it=where.begin(); it!=where.end(); ++it)
+        if (kp.owner_of(it->first) != it->second) ++errors;
+    printf("shifting hot keys: moves %lu, keys kept at most %zu\n", kp.moves(), maxkeys);
+    return errors == 0 && kp.moves() > 0 && maxkeys <= 2*FF_KP_MAX_MOVES;
+}
+
+int main() {
+    if (!shifting_hot_keys()) {
+        error("wrong partitioning\n");
+        return -1;
+    }
+    std::vector<std::unique_ptr<ff_node> > W;
+    for(long i=0;i<NWORKERS;++i) W.push_back(make_unique<Worker>());
+    ff_Farm<task_t> farm(std::move(W));
+    Collector col;
+    farm.add_collector(col);
+    farm.set_scheduling_bykey([](task_t* t) { return t->key; });
+    farm.set_elastic();
+    Gen gen(farm.getlb());
+    ff_Pipe<> pipe(gen, farm);
+    if (pipe.run_and_wait_end()<0) {
+        error("running pipe\n");
+        return -1;
+    }
+    const ff_key_partitioner* kp = farm.getKeyPartitioner();
+    printf("elapsed %.2f (ms), keys moved %zu, moves %lu (resize %lu), hot keys %zu\n",
+           pipe.ffTime(), kp->nkeys(), kp->moves(), kp->resize_moves(), kp->hot_keys().size());
+    long errors = gen.errors, nkeys = 0;
+    for(long i=0;i<NWORKERS;++i) {
+        Worker* w = (Worker*)farm.getWorkers()[i];
+        errors += w->errors;
+        nkeys  += w->state.size();
+        for(std::map<uint64_t,long>::iterator it=w->state.begin(); it!=w->state.end(); ++it)
+            if (kp->owner_of(it->first) != (size_t)i) {
+                error("key %lu in worker %ld, its owner is %zu\n", it->first, i, kp->owner_of(it->first));
+                ++errors;
+            }
+        printf("worker %ld: %zu keys\n", i, w->state.size());
+    }
+    if (col.cnt != NTASKS || errors || nkeys != NKEYS || kp->resize_moves() == 0) {
+        error("wrong result\n");
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,137 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/* ***************************************************************************
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ *  As a special exception, you may use this file as part of a free software
+ *  library without restriction.  Specifically, if other files instantiate
+ *  templates or use macros or inline functions from this file, or you compile
+ *  this file and link it with other files to produce an executable, this
+ *  file does not by itself cause the resulting executable to be covered by
+ *  the GNU General Public License.  This exception does not however
+ *  invalidate any other reasons why the executable file might be covered by
+ *  the GNU General Public License.
+ *
+ ****************************************************************************
+ */
+/*
+ * Tests the load-aware scheduling policies of the farm (see
+ * ff_farm::set_scheduling_policy).
+ *
+ *            | -> Worker -> |
+ *   Gen ---> | -> Worker -> | ---> Collector
+ *            | -> Worker -> |
+ *            | -> Worker -> |
+ *
+ * The first worker is much slower than the others. With the round-robin
+ * Emitter it receives 1/NWORKERS of the tasks and the farm waits for it,
+ * with JSQ, P2C, least outstanding work and cost-aware scheduling it must
+ * receive fewer tasks. With cost-aware scheduling its estimated service
+ * time must be the highest. Each task must be received exactly once.
+ * Work-stealing cannot be used with least outstanding work and cost-aware
+ * scheduling (the thief would complete tasks sent to another worker).
+ *
+ */
+
+#include <cstdio>
+#include <unistd.h>
+#include <ff/ff.hpp>
+
+using namespace ff;
+
+const long NTASKS   = 400;
+const long NWORKERS = 4;
+const long SLOW_US  = 2000;
+const long GEN_US   = 200;
+
+struct Gen: ff_node_t<long> {
+    long* svc(long*) {
+        for(long i=1;i<=NTASKS;++i) {
+            ff_send_out((long*)i);
+            usleep(GEN_US);
+        }
+        return EOS;
+    }
+};
+struct Worker: ff_node_t<long> {
+    long* svc(long* t) {
+        if (get_my_id() == 0) usleep(SLOW_US);
+        ++cnt;
+        return t;
+    }
+    long cnt=0;
+};
+struct Collector: ff_minode_t<long> {
+    long* svc(long* t) { sum += (long)t; ++cnt; return GO_ON; }
+    long sum=0, cnt=0;
+};
+
+static int run(const char* name, ff_sched_t policy) {
+    Gen       gen;
+    Collector col;
+    std::vector<std::unique_ptr<ff_node> > W;
+    for(long i=0;i<NWORKERS;++i) W.push_back(make_unique<Worker>());
+    ff_Farm<long> farm(std::move(W));
+    farm.add_collector(col);
+    farm.set_scheduling_policy(policy);
+    ff_Pipe<> pipe(gen, farm);
+    if (pipe.run_and_wait_end()<0) {
+        error("running pipe\n");
+        return -1;
+    }
+    const long slow = ((Worker*)farm.getWorkers()[0])->cnt;
+    printf("%-8s elapsed %8.2f (ms)  tasks to the slow worker %ld\n", name, pipe.ffTime(), slow);
+    if (col.cnt != NTASKS || col.sum != NTASKS*(NTASKS+1)/2) {
+        error("wrong result\n");
+        return -1;
+    }
+    if (policy != FF_SCHED_RR && slow >= NTASKS/NWORKERS) {
+        error("the slow worker is not avoided\n");
+        return -1;
+    }
+    if (policy == FF_SCHED_COST) {
+        printf("         service times (ticks):");
+        for(long i=0;i<NWORKERS;++i) printf(" %.0f", farm.getWorkerServiceTime(i));
+        printf("\n");
+        for(long i=1;i<NWORKERS;++i)
+            if (farm.getWorkerServiceTime(i) >= farm.getWorkerServiceTime(0)) {
+                error("wrong service time estimates\n");
+                return -1;
+            }
+    }
+    return 0;
+}
+
+// a farm with work-stealing and \p policy must not start
+static int reject(ff_sched_t policy) {
+    std::vector<std::unique_ptr<ff_node> > W;
+    for(long i=0;i<NWORKERS;++i) W.push_back(make_unique<Worker>());
+    ff_Farm<long> farm(std::move(W));
+    farm.set_scheduling_policy(policy);
+    farm.set_scheduling_stealing();
+    if (farm.run_and_wait_end()>=0) {
+        error("work-stealing accepted with a load-aware policy\n");
+        return -1;
+    }
+    return 0;
+}
+
+int main() {
+    if (run("RR",  FF_SCHED_RR)<0)  return -1;
+    if (run("JSQ", FF_SCHED_JSQ)<0) return -1;
+    if (run("P2C", FF_SCHED_P2C)<0) return -1;
+    if (run("LOW", FF_SCHED_LOW)<0) return -1;
+    if (run("COST", FF_SCHED_COST)<0) return -1;
+    if (reject(FF_SCHED_LOW)<0 || reject(FF_SCHED_COST)<0) return -1;
+    return 0;
+}
@@ -0,0 +1,119 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/* ***************************************************************************
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ *  As a special exception, you may use this file as part of a free software
+ *  library without restriction.  Specifically, if other files instantiate
+ *  templates or use macros or inline functions from this file, or you compile
+ *  this file and link it with other files to produce an executable, this
+ *  file does not by itself cause the resulting executable to be covered by
+ *  the GNU General Public License.  This exception does not however
+ *  invalidate any other reasons why the executable file might be covered by
+ *  the GNU General Public License.
+ *
+ ****************************************************************************
+ */
+/*
+ * Stress test of mp_dynqueue with many producers and many consumers: P
+ * producers push ntasks/P distinct values each, C consumers pop them
+ * concurrently. Each value must be popped exactly once: a node re-used
+ * while a consumer is still reading it (see ff_ebr in mpdynqueue.hpp)
+ * shows up as a value popped twice or lost. It is repeated nrounds times
+ * on the same queue, so the nodes go through the limbo lists, the
+ * freelists and the pool many times.
+ *
+ * usage: test_mpdynqueue [ntasks [P [C [nrounds]]]]
+ *
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <sched.h>
+#include <ff/mpdynqueue.hpp>
+#include <ff/utils.hpp>
+
+using namespace ff;
+
+static long ntasks  = 200000;
+static long nprod   = 4;
+static long ncons   = 4;
+static long nrounds = 10;
+
+static bool round(mp_dynqueue& q, std::vector<std::atomic<unsigned char> >& seen) {
+    const long n = ntasks/nprod;
+    const long N = n*nprod;
+    std::atomic<long> popped{0};
+    for(long i=0;i<N;++i) seen[i].store(0, std::memory_order_relaxed);
+
+    std::vector<std::thread> th;
+    for(long p=0;p<nprod;++p)
+        th.push_back(std::thread([&q,n,p]() {
+            for(long i=1;i<=n;++i)
+                q.mp_push((void*)(p*n+i));
+        }));
+    for(long c=0;c<ncons;++c)
+        th.push_back(std::thread([&]() {
+            long cnt = 0;
+            while(popped.load(std::memory_order_relaxed) < N) {
+                void *t;
+                if (!q.mp_pop(&t)) {
+                    if (++cnt == 1024) { cnt=0; sched_yield(); }
+                    continue;
+                }
+                const long v = (long)t;
+                if (v < 1 || v > N) {
+                    error("value %ld out of range\n", v);
+                    abort();
+                }
+                seen[v-1].fetch_add(1, std::memory_order_relaxed);
+                popped.fetch_add(1, std::memory_order_relaxed);
+            }
+        }));
+    for(size_t i=0;i<th.size();++i) th[i].join();
+
+    void* t;
+    bool ok = !q.mp_pop(&t);
+    for(long i=0;i<N;++i)
+        if (seen[i].load(std::memory_order_relaxed) != 1) {
+            printf("value %ld popped %d times\n", i+1, (int)seen[i].load());
+            ok = false;
+        }
+    return ok;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc>1) ntasks  = atol(argv[1]);
+    if (argc>2) nprod   = atol(argv[2]);
+    if (argc>3) ncons   = atol(argv[3]);
+    if (argc>4) nrounds = atol(argv[4]);
+    if (nprod < 1) nprod = 1;
+    if (ncons < 1) ncons = 1;
+
+    mp_dynqueue q;
+    if (!q.init()) {
+        error("init failed\n");
+        return -1;
+    }
+    std::vector<std::atomic<unsigned char> > seen(ntasks);
+    for(long r=0;r<nrounds;++r)
+        if (!round(q, seen)) {
+            printf("test_mpdynqueue: FAILED (round %ld)\n", r);
+            return -1;
+        }
+    printf("test_mpdynqueue: OK (%ld producers, %ld consumers, %ld rounds)\n", nprod, ncons, nrounds);
+    return 0;
+}
@@ -0,0 +1,110 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/* ***************************************************************************
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ *  As a special exception, you may use this file as part of a free software
+ *  library without restriction.  Specifically, if other files instantiate
+ *  templates or use macros or inline functions from this file, or you compile
+ *  this file and link it with other files to produce an executable, this
+ *  file does not by itself cause the resulting executable to be covered by
+ *  the GNU General Public License.  This exception does not however
+ *  invalidate any other reasons why the executable file might be covered by
+ *  the GNU General Public License.
+ *
+ ****************************************************************************
+ */
+/*
+ * Tests the multipop method of the SWSR_Ptr_Buffer and uSWSR_Ptr_Buffer
+ * (wrap-around, full buffer, crossing of the internal buffers) and then the
+ * batched pops done by the nodes and by the farm collector:
+ *
+ *   Gen --> Check --> farm(Id x 4) --> Sink
+ *
+ * Check verifies the FIFO order of a single channel, Sink the total count.
+ *
+ */
+
+#include <cstdio>
+#include <ff/ff.hpp>
+
+using namespace ff;
+
+const long NTASKS = 100000;
+
+static void check(bool c, const char *msg) {
+    if (!c) { error("%s\n", msg); abort(); }
+}
+
+struct Gen: ff_node_t<long> {
+    long* svc(long*) {
+        for(long i=1;i<=NTASKS;++i) ff_send_out((long*)i);
+        return EOS;
+    }
+};
+struct Check: ff_node_t<long> {
+    long* svc(long* t) {
+        check((long)t == ++expected, "Check, wrong order");
+        return t;
+    }
+    long expected=0;
+};
+struct Id: ff_node_t<long> {
+    long* svc(long* t) { return t; }
+};
+struct Sink: ff_node_t<long> {
+    long* svc(long* t) { sum += (long)t; ++cnt; return GO_ON; }
+    long cnt=0, sum=0;
+};
+
+int main() {
+    void *out[64];
+    {
+        SWSR_Ptr_Buffer b(8);
+        check(b.init(), "SWSR init");
+        check(b.multipop(out, 4) == 0, "SWSR empty");
+        for(long i=1;i<=6;++i) b.push((void*)i);
+        check(b.multipop(out, 4) == 4, "SWSR multipop 4");
+        for(long i=0;i<4;++i) check((long)out[i] == i+1, "SWSR order");
+        for(long i=7;i<=12;++i) check(b.push((void*)i), "SWSR push");
+        check(!b.push((void*)13), "SWSR full");
+        // full buffer, wrap-around and max greater than the size
+        check(b.multipop(out, 64) == 8, "SWSR multipop full");
+        for(long i=0;i<8;++i) check((long)out[i] == i+5, "SWSR order (wrap)");
+        check(b.empty() && b.push((void*)14), "SWSR slots given back");
+    }
+    {
+        uSWSR_Ptr_Buffer u(4, false);
+        check(u.init(), "uSWSR init");
+        for(long i=1;i<=1000;++i) u.push((void*)i);
+        long expected=1;
+        size_t n;
+        while((n=u.multipop(out, 7)) > 0)
+            for(size_t i=0;i<n;++i) check((long)out[i] == expected++, "uSWSR order");
+        check(expected == 1001, "uSWSR count");
+    }
+
+    Gen gen; Check chk; Sink sink;
+    std::vector<std::unique_ptr<ff_node> > W;
+    for(int i=0;i<4;++i) W.push_back(make_unique<Id>());
+    ff_Farm<long> farm(std::move(W));
+    ff_Pipe<> pipe(gen, chk, farm, sink);
+    if (pipe.run_and_wait_end()<0) {
+        error("running pipe\n");
+        return -1;
+    }
+    check(chk.expected == NTASKS, "Check count");
+    check(sink.cnt == NTASKS && sink.sum == NTASKS*(NTASKS+1)/2, "Sink count");
+    printf("done\n");
+    return 0;
+}
@@ -0,0 +1,112 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/* ***************************************************************************
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as 
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ *  As a special exception, you may use this file as part of a free software
+ *  library without restriction.  Specifically, if other files instantiate
+ *  templates or use macros or inline functions from this file, or you compile
+ *  this file and link it with other files to produce an executable, this
+ *  file does not by itself cause the resulting executable to be covered by
+ *  the GNU General Public License.  This exception does not however
+ *  invalidate any other reasons why the executable file might be covered by
+ *  the GNU General Public License.
+ *
+ ****************************************************************************
+ */
+
+/*  
+ *   Ordered farm with on-demand scheduling and a small reorder window.
+ *               
+ *           --> Worker -->         
+ *          |              |        
+ * Start --> --> Worker -->  ---> Stop
+ *          |              |        
+ *           --> Worker -->         
+ *
+ *  Worker 0 is slow, the other workers get ahead of it until the reorder
+ *  window is full and the Emitter has to wait for the Collector.
+ */
+
+#include <vector>
+#include <iostream>
+#include <ff/ff.hpp>
+using namespace ff;
+
+struct Start: ff_node_t<long> {
+    Start(long streamlen):streamlen(streamlen) {}
+    long* svc(long*) {
+        for(long i=1;i<=streamlen;++i) ff_send_out((long*)i);
+        return EOS;
+    }
+    long streamlen;
+};
+
+struct Worker: ff_node_t<long> {
+    long* svc(long* task) {
+        if (get_my_id() == 0) usleep(1000);
+        return task;
+    }
+};
+
+struct Stop: ff_node_t<long> {
+    long* svc(long* task) {
+        if ((long)task != ++expected) {
+            printf("ERROR: task received out of order, received %ld expected %ld\n", (long)task, expected);
+            error = true;
+        }
+        return GO_ON;
+    }
+    long expected=0;
+    bool error=false;
+};
+
+int main(int argc, char * argv[]) {
+    int  nworkers  = 3;
+    long streamlen = 2000;
+    long memory    = 1;
+    if (argc>1) {
+        if (argc<4) {
+            std::cerr << "use: " << argv[0] << " nworkers streamlen memory\n";
+            return -1;
+        }
+        nworkers  = atoi(argv[1]);
+        streamlen = atol(argv[2]);
+        memory    = atol(argv[3]);
+    }
+    if (nworkers<=0 || streamlen<=0 || memory<=0) {
+        std::cerr << "Wrong parameters values\n";
+        return -1;
+    }
+
+    Start start(streamlen);
+    Stop  stop;
+    std::vector<std::unique_ptr<ff_node> > W;
+    for(int i=0;i<nworkers;++i) W.push_back(make_unique<Worker>());
+    ff_Farm<long> ofarm(std::move(W), start, stop);
+    ofarm.set_ordered(memory);
+    ofarm.set_scheduling_ondemand();
+
+    if (ofarm.run_and_wait_end()<0) {
+        error("running ofarm\n");
+        return -1;
+    }
+    ff_reorder_window* w = reinterpret_cast<ordered_lb*>(ofarm.getlb())->window();
+    std::cout << "Time: " << ofarm.ffTime() << " (ms), window " << w->size()
+              << ", emitter stalls " << w->stalls() << "\n";
+    if (stop.error || stop.expected != streamlen) {
+        error("wrong result\n");
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,100 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/* ***************************************************************************
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ *  As a special exception, you may use this file as part of a free software
+ *  library without restriction.  Specifically, if other files instantiate
+ *  templates or use macros or inline functions from this file, or you compile
+ *  this file and link it with other files to produce an executable, this
+ *  file does not by itself cause the resulting executable to be covered by
+ *  the GNU General Public License.  This exception does not however
+ *  invalidate any other reasons why the executable file might be covered by
+ *  the GNU General Public License.
+ *
+ ****************************************************************************
+ */
+/*
+ *
+ *   Gen --> Fast --> Slow --> farm(Slower x 4) --> Sink
+ *
+ * This program tests the ff_pipeline_profiler: the task counts must match,
+ * the bottleneck must be the Slow stage (the farm executes a 2x longer svc
+ * but with 4 workers) and the achieved throughput cannot be greater than
+ * the expected one (with some tolerance).
+ *
+ */
+
+#include <iostream>
+#include <ff/ff.hpp>
+#include <ff/profiler.hpp>
+
+using namespace ff;
+
+const long NTASKS = 200;
+
+struct Gen: ff_node_t<long> {
+    long* svc(long*) {
+        for(long i=1;i<=NTASKS;++i) ff_send_out((long*)i);
+        return EOS;
+    }
+};
+struct Work: ff_node_t<long> {
+    Work(long us): us(us) {}
+    long* svc(long* t) {
+        if (us) usleep(us);
+        return t;
+    }
+    const long us;
+};
+struct Sink: ff_node_t<long> {
+    long* svc(long*) { ++cnt; return GO_ON; }
+    long cnt=0;
+};
+
+int main() {
+    Gen gen; Work fast(0), slow(1000); Sink sink;
+    std::vector<std::unique_ptr<ff_node> > W;
+    for(int i=0;i<4;++i) W.push_back(make_unique<Work>(2000));
+    ff_Farm<long> farm(std::move(W));
+    ff_Pipe<> pipe(gen, fast, slow, farm, sink);
+
+    ff_pipeline_profiler prof(pipe, 1.0);
+    prof.start();
+    if (pipe.run_and_wait_end()<0) {
+        error("running pipe\n");
+        return -1;
+    }
+    prof.stop();
+    prof.report(std::cout);
+
+    const std::vector<ff_pipeline_profiler::stage_stats> s = prof.stats();
+    if (s.size() != 5 || sink.cnt != NTASKS) abort();
+    if (s[0].nouts != (unsigned long)NTASKS) abort();
+    for(size_t i=1;i<s.size();++i)
+        if (s[i].ntasks != (unsigned long)NTASKS) {
+            error("stage %ld received %ld tasks\n", i, s[i].ntasks);
+            abort();
+        }
+    if (s[3].nworkers != 4) abort();
+    if (prof.bottleneck() != 2) {
+        error("wrong bottleneck %ld\n", prof.bottleneck());
+        abort();
+    }
+    if (prof.achieved_throughput() > 1.2*prof.expected_throughput()) {
+        error("achieved throughput greater than the expected one\n");
+        abort();
+    }
+    printf("done\n");
+    return 0;
+}
@@ -0,0 +1,157 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/* ***************************************************************************
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ *  As a special exception, you may use this file as part of a free software
+ *  library without restriction.  Specifically, if other files instantiate
+ *  templates or use macros or inline functions from this file, or you compile
+ *  this file and link it with other files to produce an executable, this
+ *  file does not by itself cause the resulting executable to be covered by
+ *  the GNU General Public License.  This exception does not however
+ *  invalidate any other reasons why the executable file might be covered by
+ *  the GNU General Public License.
+ *
+ ****************************************************************************
+ */
+/*
+ * Tests the automatic capacity tuning of the bounded channels (see
+ * qtuner.hpp).
+ *
+ *   Gen ---> Slow ---> Sink
+ *
+ * In the first phase Gen is much faster than Slow, so the channel between
+ * them fills and its capacity must be increased. In the second phase Gen
+ * sends a few tasks from time to time, the channels stay almost empty and
+ * their capacity must be reduced.
+ *
+ * Then the tuner runs on a farm with on-demand scheduling,
+ *
+ *   Gen ---> farm(Slow x NWORKERS) ---> Sink
+ *
+ * the input channels of the workers are full most of the time but their
+ * capacity must not change.
+ *
+ */
+
+#include <cstdio>
+#include <iostream>
+#include <unistd.h>
+#include <ff/ff.hpp>
+#include <ff/qtuner.hpp>
+
+using namespace ff;
+
+const long NFAST  = 100000;
+const long NSLOW  = 150;
+const long SLOWUS = 2000;
+const long NWORKERS = 4;
+
+struct Gen: ff_node_t<long> {
+    long* svc(long*) {
+        for(long i=1;i<=NFAST;++i) ff_send_out((long*)i);
+        for(long i=1;i<=NSLOW;++i) {
+            ff_send_out((long*)i);
+            usleep(SLOWUS);
+        }
+        return EOS;
+    }
+};
+struct Slow: ff_node_t<long> {
+    long* svc(long* t) {
+        ticks_wait(3000);
+        return t;
+    }
+};
+struct Sink: ff_node_t<long> {
+    long* svc(long*) { ++cnt; return GO_ON; }
+    long cnt=0;
+};
+
+static bool ondemand() {
+    std::vector<std::unique_ptr<ff_node> > W;
+    for(long i=0;i<NWORKERS;++i) W.push_back(make_unique<Slow>());
+    ff_Farm<long> farm(std::move(W));
+    farm.set_scheduling_ondemand();
+    Gen  gen;
+    Sink sink;
+    ff_Pipe<> pipe(gen, farm, sink);
+    pipe.setFixedSize(true);
+
+    ff_queue_tuner tuner(pipe, 2.0);
+    if (pipe.run()<0) {
+        error("running pipe\n");
+        return false;
+    }
+    tuner.start();
+    if (pipe.wait()<0) {
+        error("waiting pipe\n");
+        return false;
+    }
+    tuner.stop();
+    tuner.report(std::cout);
+    if (sink.cnt != NFAST+NSLOW) return false;
+    const svector<ff_node*>& w = farm.getWorkers();
+    for(size_t i=0;i<w.size();++i)
+        if (w[i]->get_in_buffer()->capacity() != (size_t)farm.ondemand_buffer()) return false;
+    const std::vector<ff_queue_tuner::decision> d = tuner.decisions();
+    for(size_t i=0;i<d.size();++i)
+        if (d[i].channel.find(".worker") != std::string::npos) return false;
+    return true;
+}
+
+int main() {
+    if (!ff_queue_tuner::supported()) {
+        printf("test_qtuner: the channels (FFBUFFER) cannot be resized, test skipped\n");
+        return 0;
+    }
+    Gen  gen;
+    Slow slow;
+    Sink sink;
+    ff_Pipe<> pipe(gen, slow, sink);
+    pipe.setFixedSize(true);
+
+    ff_queue_tuner tuner(pipe, 2.0);
+    if (pipe.run()<0) {
+        error("running pipe\n");
+        return -1;
+    }
+    tuner.start();
+    if (pipe.wait()<0) {
+        error("waiting pipe\n");
+        return -1;
+    }
+    tuner.stop();
+    tuner.report(std::cout);
+    tuner.print_config(std::cout);
+
+    if (sink.cnt != NFAST+NSLOW) {
+        error("wrong result\n");
+        return -1;
+    }
+    bool grown=false, shrunk=false;
+    const std::vector<ff_queue_tuner::decision> d = tuner.decisions();
+    for(size_t i=0;i<d.size();++i) {
+        if (d[i].channel == "stage1.in" && d[i].newsz > d[i].oldsz) grown = true;
+        if (d[i].newsz < d[i].oldsz) shrunk = true;
+    }
+    if (!grown || !shrunk) {
+        error("the channels have not been tuned\n");
+        return -1;
+    }
+    if (!ondemand()) {
+        error("the channels of the on-demand farm have been tuned\n");
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,132 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/* ***************************************************************************
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ *  As a special exception, you may use this file as part of a free software
+ *  library without restriction.  Specifically, if other files instantiate
+ *  templates or use macros or inline functions from this file, or you compile
+ *  this file and link it with other files to produce an executable, this
+ *  file does not by itself cause the resulting executable to be covered by
+ *  the GNU General Public License.  This exception does not however
+ *  invalidate any other reasons why the executable file might be covered by
+ *  the GNU General Public License.
+ *
+ ****************************************************************************
+ */
+/*
+ * Tests the allocation of the channel rings on huge pages and their
+ * placement on the NUMA node of the consumer (see ringmem.hpp).
+ *
+ *            | -> Worker -> |
+ *   Gen ---> | -> Worker -> | ---> Collector
+ *            | -> Worker -> |
+ *
+ * The placement (of a ring being read and of the cached rings of an
+ * unbounded channel) may not be allowed (e.g. in a container), in that case
+ * only the allocation is tested.
+ *
+ */
+
+#if !defined(FF_RING_HUGEPAGES)
+#define FF_RING_HUGEPAGES
+#endif
+#if !defined(FF_RING_NUMA)
+#define FF_RING_NUMA
+#endif
+
+#include <cstdio>
+#include <cstdint>
+#include <ff/ff.hpp>
+
+using namespace ff;
+
+const long NTASKS   = 100000;
+const long NWORKERS = 3;
+
+struct Gen: ff_node_t<long> {
+    long* svc(long*) {
+        for(long i=1;i<=NTASKS;++i) ff_send_out((long*)i);
+        return EOS;
+    }
+};
+struct Worker: ff_node_t<long> {
+    long* svc(long* t) { return t; }
+};
+struct Collector: ff_minode_t<long> {
+    long* svc(long* t) { sum += (long)t; return GO_ON; }
+    long sum=0;
+};
+
+int main() {
+    const int node = ff_my_numanode();
+    printf("NUMA node of the main thread: %d (cpu0 on node %d)\n", node, ff_cpu_numanode(0));
+
+    // a ring is on its own huge page(s)
+    size_t mapped;
+    void** r = (void**)ff_ring_alloc(64, 1000*sizeof(void*), mapped);
+    if (!r || ((uintptr_t)r % FF_HUGEPAGE_SIZE) || (mapped % FF_HUGEPAGE_SIZE) || mapped < 1000*sizeof(void*)) {
+        error("wrong ring allocation\n");
+        return -1;
+    }
+    for(long i=0;i<1000;++i) r[i] = (void*)i;
+    printf("ring of %zu bytes, placed on node %d: %s\n", mapped, node,
+           ff_ring_bind(r, mapped, node) ? "yes" : "no");
+    ff_ring_free(r, mapped);
+
+    SWSR_Ptr_Buffer b(4096);
+    if (!b.init()) {
+        error("init failed\n");
+        return -1;
+    }
+    b.place(node);
+    for(long i=1;i<=4096;++i) if (!b.push((void*)i)) { error("push failed\n"); return -1; }
+    for(long i=1;i<=4096;++i) {
+        void* t;
+        if (!b.pop(&t) || (long)t != i) { error("pop failed\n"); return -1; }
+    }
+
+    // the cached rings of an unbounded channel are moved too, the
+    // channel keeps all of them and works as before
+    uSWSR_Ptr_Buffer u(1024, false, true);
+    if (!u.init()) {
+        error("init failed (unbounded)\n");
+        return -1;
+    }
+    const size_t footprint = u.footprint();
+    u.place(node);
+    if (u.footprint() != footprint) { error("cached rings lost\n"); return -1; }
+    for(long i=1;i<=8*1024;++i) u.push((void*)i);
+    for(long i=1;i<=8*1024;++i) {
+        void* t;
+        if (!u.pop(&t) || (long)t != i) { error("pop failed (unbounded)\n"); return -1; }
+    }
+
+    Gen       gen;
+    Collector col;
+    std::vector<std::unique_ptr<ff_node> > W;
+    for(long i=0;i<NWORKERS;++i) W.push_back(make_unique<Worker>());
+    ff_Farm<long> farm(std::move(W));
+    farm.add_collector(col);
+    ff_Pipe<> pipe(gen, farm);
+    if (pipe.run_and_wait_end()<0) {
+        error("running pipe\n");
+        return -1;
+    }
+    printf("sum %ld, elapsed %.2f (ms)\n", col.sum, pipe.ffTime());
+    if (col.sum != NTASKS*(NTASKS+1)/2) {
+        error("wrong result\n");
+        return -1;
+    }
+    return 0;
+}
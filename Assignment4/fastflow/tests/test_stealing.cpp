@@ -0,0 +1,156 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/* ***************************************************************************
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ *  As a special exception, you may use this file as part of a free software
+ *  library without restriction.  Specifically, if other files instantiate
+ *  templates or use macros or inline functions from this file, or you compile
+ *  this file and link it with other files to produce an executable, this
+ *  file does not by itself cause the resulting executable to be covered by
+ *  the GNU General Public License.  This exception does not however
+ *  invalidate any other reasons why the executable file might be covered by
+ *  the GNU General Public License.
+ *
+ ****************************************************************************
+ */
+/*
+ * Tests the work-stealing farm (see ff_farm::set_scheduling_stealing).
+ *
+ *            | -> Worker -> |
+ *   Gen ---> | -> Worker -> | ---> Collector
+ *            | -> Worker -> |
+ *            | -> Worker -> |
+ *
+ * The Emitter is round-robin and one task out of NWORKERS is long, so
+ * all the long tasks go to the first worker. Without stealing the other
+ * workers are idle while the first one drains its queue, with stealing
+ * they take its tasks. The farm is run without stealing and with FIFO and
+ * LIFO stealing, each task must be received exactly once.
+ * Then a multi-output Emitter also broadcasts NBCAST tasks: each worker
+ * must receive each broadcast once, a copy is never stolen.
+ *
+ */
+
+#include <cstdio>
+#include <unistd.h>
+#include <ff/ff.hpp>
+
+using namespace ff;
+
+const long NTASKS   = 400;
+const long NWORKERS = 4;
+const long LONG_US  = 2000;
+const long NBCAST   = 20;
+const long BCAST    = NTASKS+1;
+
+static long errors = 0;
+static long nbcast = 0;   // broadcasts expected by each worker
+
+struct Gen: ff_node_t<long> {
+    long* svc(long*) {
+        for(long i=1;i<=NTASKS;++i) ff_send_out((long*)i);
+        return EOS;
+    }
+};
+struct BcastGen: ff_monode_t<long> {
+    long* svc(long*) {
+        for(long i=1;i<=NTASKS;++i) {
+            ff_send_out((long*)i);
+            if (i % (NTASKS/NBCAST) == 0) broadcast_task((long*)BCAST);
+        }
+        return EOS;
+    }
+};
+struct Worker: ff_node_t<long> {
+    long* svc(long* t) {
+        if ((long)t == BCAST) { ++bcast; return GO_ON; }
+        if ((long)t % NWORKERS == 1) usleep(LONG_US);
+        return t;
+    }
+    void svc_end() {
+        if (bcast != nbcast) {
+            printf("worker %zd: %ld broadcasts received\n", get_my_id(), bcast);
+            ++errors;
+        }
+    }
+    long bcast = 0;
+};
+struct Collector: ff_minode_t<long> {
+    long* svc(long* t) { sum += (long)t; ++cnt; return GO_ON; }
+    long sum=0, cnt=0;
+};
+
+static int check(ff_farm& farm, const Collector& col, bool stealing) {
+    if (col.cnt != NTASKS || col.sum != NTASKS*(NTASKS+1)/2) {
+        error("\nwrong result\n");
+        return -1;
+    }
+    if (!stealing) { printf("\n"); return 0; }
+    const ff_steal_group* g = farm.getStealGroup();
+    unsigned long steals=0, stolen=0;
+    for(size_t i=0;i<g->size();++i) { steals += g->steals(i); stolen += g->stolen(i); }
+    printf("  steals %lu (from worker 0 %lu)\n", steals, g->stolen(0));
+    if (steals != stolen || g->stolen(0) == 0) {
+        error("wrong stealing statistics\n");
+        return -1;
+    }
+    return 0;
+}
+
+static int run(const char* name, bool stealing, ff_steal_t policy=FF_STEAL_FIFO) {
+    Gen       gen;
+    Collector col;
+    std::vector<std::unique_ptr<ff_node> > W;
+    for(long i=0;i<NWORKERS;++i) W.push_back(make_unique<Worker>());
+    ff_Farm<long> farm(std::move(W));
+    farm.add_collector(col);
+    if (stealing) farm.set_scheduling_stealing(policy);
+    ff_Pipe<> pipe(gen, farm);
+    if (pipe.run_and_wait_end()<0) {
+        error("running pipe\n");
+        return -1;
+    }
+    printf("%-14s elapsed %8.2f (ms)", name, pipe.ffTime());
+    return check(farm, col, stealing);
+}
+
+// the Emitter broadcasts, the workers count the copies in svc_end
+static int run_bcast(const char* name, ff_steal_t policy) {
+    BcastGen  gen;
+    Collector col;
+    std::vector<std::unique_ptr<ff_node> > W;
+    for(long i=0;i<NWORKERS;++i) W.push_back(make_unique<Worker>());
+    ff_Farm<long> farm(std::move(W), gen, col);
+    farm.set_scheduling_stealing(policy);
+    nbcast = NBCAST;
+    if (farm.run_and_wait_end()<0) {
+        error("running farm\n");
+        return -1;
+    }
+    printf("%-14s elapsed %8.2f (ms)", name, farm.ffTime());
+    if (errors) {
+        error("\nwrong broadcasts\n");
+        return -1;
+    }
+    return check(farm, col, true);
+}
+
+int main() {
+    if (run("no stealing", false)<0) return -1;
+    if (run("FIFO stealing", true, FF_STEAL_FIFO)<0) return -1;
+    if (run("LIFO stealing", true, FF_STEAL_LIFO)<0) return -1;
+    if (run_bcast("FIFO broadcast", FF_STEAL_FIFO)<0) return -1;
+    if (run_bcast("LIFO broadcast", FF_STEAL_LIFO)<0) return -1;
+    return 0;
+}
@@ -0,0 +1,100 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/* ***************************************************************************
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ *  As a special exception, you may use this file as part of a free software
+ *  library without restriction.  Specifically, if other files instantiate
+ *  templates or use macros or inline functions from this file, or you compile
+ *  this file and link it with other files to produce an executable, this
+ *  file does not by itself cause the resulting executable to be covered by
+ *  the GNU General Public License.  This exception does not however
+ *  invalidate any other reasons why the executable file might be covered by
+ *  the GNU General Public License.
+ *
+ ****************************************************************************
+ */
+/*
+ * Tests the typed by-value channels (see valuechannel.hpp):
+ *
+ *   Gen --> Fwd --> farm(Worker x 4) --> Sink
+ *
+ * Gen sends tuple_t by value through a ring smaller than the stream (so
+ * the slots are re-used many times), Fwd returns its input as it is (the
+ * slot is then released by the Workers), the Workers send result_t by value
+ * to Sink.
+ *
+ */
+
+#include <cstdio>
+#include <ff/ff.hpp>
+
+using namespace ff;
+
+const long NTASKS = 100000;
+
+struct tuple_t  { long key; long value; double ts; };
+struct result_t { long key; long value; };
+
+static void check(bool c, const char *msg) {
+    if (!c) { error("%s\n", msg); abort(); }
+}
+
+struct Gen: ff_node_t<long, tuple_t> {
+    Gen() { set_output_values(2048); }
+    tuple_t* svc(long*) {
+        for(long i=1;i<=NTASKS;++i) ff_send_value(tuple_t{i, 3*i, 0.0});
+        return EOS;
+    }
+};
+struct Fwd: ff_node_t<tuple_t> {
+    Fwd() { set_input_values(); }
+    tuple_t* svc(tuple_t* t) {
+        check(t->key == ++expected, "Fwd, wrong order");
+        return t;
+    }
+    long expected=0;
+};
+struct Worker: ff_node_t<tuple_t, result_t> {
+    Worker() { set_input_values(); }
+    result_t* svc(tuple_t* t) {
+        check(t->value == 3*t->key, "Worker, corrupted tuple");
+        ff_send_value(result_t{t->key, t->value - t->key});
+        return GO_ON;
+    }
+};
+struct Sink: ff_node_t<result_t> {
+    Sink() { set_input_values(); }
+    result_t* svc(result_t* r) {
+        check(r->value == 2*r->key, "Sink, corrupted result");
+        sum += r->key; ++cnt;
+        return GO_ON;
+    }
+    long cnt=0, sum=0;
+};
+
+int main() {
+    Gen gen; Fwd fwd; Sink sink;
+    std::vector<std::unique_ptr<ff_node> > W;
+    for(int i=0;i<4;++i) W.push_back(make_unique<Worker>());
+    ff_Farm<tuple_t, result_t> farm(std::move(W));
+    ff_Pipe<> pipe(gen, fwd, farm, sink);
+    if (pipe.run_and_wait_end()<0) {
+        error("running pipe\n");
+        return -1;
+    }
+    check(fwd.expected == NTASKS, "Fwd count");
+    check(sink.cnt == NTASKS && sink.sum == NTASKS*(NTASKS+1)/2, "Sink count");
+    printf("done\n");
+    return 0;
+}
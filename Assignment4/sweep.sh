@@ -0,0 +1,17 @@
+#!/bin/bash
+# Runs main_a4 for every size and backend and collects the per-run lines
+# (N, backend, mode, time, throughput, latency) in sweep.log
+# usage: ./sweep.sh [num_mat]
+
+NUM_MAT=${1:-100}
+NUM_ITER=2
+
+g++ -I./fastflow -O3 -fopenmp -o main_a4 assignment4.cpp || exit 1
+
+for n in 40 100 250 500 1000; do
+    for b in seq ff omp ff:omp omp:ff; do
+        for mode in "" fused farm "farm fused"; do
+            ./main_a4 $n $NUM_ITER $NUM_MAT $b $mode quiet
+        done
+    done
+done 2>&1 | tee sweep.log